@@ -5,9 +5,15 @@ import random
 import time
 import copy
 from math import exp
+from math import log
 from multiprocessing.pool import Pool
+from multiprocessing.pool import ThreadPool
 
 from baxcat.state import BCState
+from baxcat.state import BCEnsemble
+from baxcat.state import dependence_probability_matrix
+from baxcat.state import dependence_probability_pairs
+from baxcat.state import BCRowSimilarity
 from baxcat.utils import data_utils as du
 from baxcat.utils import model_utils as mu
 from baxcat.utils import plot_utils as pu
@@ -17,6 +23,7 @@ import matplotlib.pyplot as plt
 import seaborn as sns
 import pandas as pd
 import numpy as np
+from scipy.misc import logsumexp
 
 sns.set_style("white")
 
@@ -27,12 +34,21 @@ except ImportError:
     import pickle as pkl
 
 
+def _resume_kwargs(model):
+    """ BCState keyword arguments that rebuild the state in `model` """
+    return {'Zv': model['col_assignment'],
+            'Zrcv': model['row_assignments'],
+            'col_hypers': model['col_hypers'],
+            'state_alpha': model['state_alpha'],
+            'view_alphas': model['view_alphas']}
+
+
 def _initialize(args):
     data = args[0]
     kwargs = args[1]
 
     t_start = time.time()
-    state = BCState(data.T, **kwargs)  # transpose data to col-major
+    state = BCState(data.T, **kwargs)  # col-major view; not copied
 
     metadata = state.get_metadata()
     diagnostics = {
@@ -62,7 +78,7 @@ def _run(args):
         n_sweeps = int(n_iter/checkpoint)
 
     diagnostics = []
-    state = BCState(data.T, **init_kwargs)  # transpose dat to col-major
+    state = BCState(data.T, **init_kwargs)  # col-major view; not copied
     for i in range(n_sweeps):
         t_start = time.time()
         state.transition(**trans_kwargs)
@@ -121,9 +137,16 @@ class Engine(object):
             Positive integer seed for the random number generators.
         mapper : callable
             A map function that returns a list. For example: `mp.Pool.map` or
-            `lambda f, args: list(map(f, args))`.
+            `lambda f, args: list(map(f, args))`. Without a mapper, and unless
+            the models are subsampled, the states stay live in this process
+            between calls to `run` (see `run`).
         use_mp : bool, optional
             If True (default), model-parallel tasts are run in parallel.
+        use_threads : bool, optional
+            If True, model-parallel tasks run in a pool of threads in this
+            process rather than in a pool of processes, so the models share
+            the data and nothing is pickled. BCState releases the GIL while
+            it runs. Default is False.
         index_col : int or None
             If `df` is a file name, index col is the integer index of the
             index column. Assumes the first columns (0) by default.
@@ -161,6 +184,7 @@ class Engine(object):
 
         guess_n_unique_cutoff = kwargs.get('guess_n_unique_cutoff', 20)
         use_mp = kwargs.get('use_mp', True)
+        use_threads = kwargs.get('use_threads', False)
         mapper = kwargs.get('mapper', None)
 
         output = du.process_dataframe(df, n_models, metadata,
@@ -180,15 +204,19 @@ class Engine(object):
             np.random.seed(self._seed)
             random.seed(self._seed)
 
+        # without a mapper, the pool is made by the first run that needs it
+        # (see _map); the live states never do
         self._pool = None
-        if mapper is None:
-            if use_mp:
-                self._pool = Pool()
-                self._mapper = self._pool.map
-            else:
-                self._mapper = lambda func, args: list(map(func, args))
-        else:
-            self._mapper = mapper
+        self._use_mp = use_mp
+        self._use_threads = use_threads
+        self._mapper = mapper
+
+        # live states, kept between runs when there is no custom mapper
+        self._ensemble = None
+        self._resident = mapper is None
+
+        # row similarity index over the current models; built on first use
+        self._row_similarity = None
 
         self._initialized = False
         self._models = []
@@ -241,6 +269,11 @@ class Engine(object):
         self._converters['row2idx_sf'] = row2idx_sf
         self._converters['idx2row_sf'] = idx2row_sf
 
+        if self._resident and not self._subsampled:
+            self._init_resident_models(structureless)
+            self._initialized = True
+            return
+
         args = []
         for m_ix in range(self._n_models):
             sd = np.random.randint(2**31-1)
@@ -255,13 +288,123 @@ class Engine(object):
             data_i = self._data[rows, :]
             args.append((data_i, kwarg,))
 
-        res = self._mapper(_initialize, args)
+        res = self._map(_initialize, args)
         for model, diagnostics in res:
             self._models.append(model)
             self._diagnostic_tables.append(diagnostics)
 
         self._initialized = True
 
+    def _map(self, func, args):
+        """ Map func over args with the mapper, making the default pool if
+        there is no mapper yet. """
+        if self._mapper is None:
+            if self._use_threads:
+                self._pool = ThreadPool()
+                self._mapper = self._pool.map
+            elif self._use_mp:
+                self._pool = Pool()
+                self._mapper = self._pool.map
+            else:
+                self._mapper = lambda func, args: list(map(func, args))
+        return self._mapper(func, args)
+
+    def _init_resident_models(self, structureless):
+        """ init_models for live states: every model goes in one ensemble
+        over the full data. """
+        self._ensemble = BCEnsemble(self._data.T, self._dtypes,
+                                    self._distargs)
+        t_starts = []
+        for m_ix in range(self._n_models):
+            sd = np.random.randint(2**31-1)
+            kwarg = {'seed': sd}
+            if structureless:
+                kwarg['Zv'] = [0]*self._n_cols
+                kwarg['Zrcv'] = [[0]*self._n_rows]
+
+            t_starts.append(time.time())
+            self._ensemble.add_state(**kwarg)
+            t_starts[-1] = time.time() - t_starts[-1]
+
+        log_scores = self._ensemble.log_scores()
+        for m_ix in range(self._n_models):
+            diagnostics = {
+                'log_score': log_scores[m_ix],
+                'iters': 0,
+                'time': t_starts[m_ix]}
+            self._models.append(self._ensemble.get_metadata(m_ix))
+            self._diagnostic_tables.append([diagnostics])
+
+    def _live_ensemble(self):
+        """ The live states, or None if each run rebuilds its states. After
+        `load` the states are rebuilt once from the saved metadata. """
+        if self._ensemble is None and self._resident and \
+                not getattr(self, '_subsampled', True):
+            ensemble = BCEnsemble(self._data.T, self._dtypes, self._distargs)
+            for model in self._models:
+                ensemble.add_state(seed=np.random.randint(2**31-1),
+                                   **_resume_kwargs(model))
+            self._ensemble = ensemble
+        return self._ensemble
+
+    def _draw(self, ensemble, col_idxs, given=None, n=1, model_idxs=None):
+        """ n joint draws of col_idxs in a new row from the live states.
+        Each draw comes from a random model in model_idxs (all by default).
+        Returns the draws and the model of each. """
+        if model_idxs is None:
+            model_idxs = list(range(self._n_models))
+
+        # a new row: one past the rows the states hold
+        row = self._n_rows
+        query_indices = [[row, col_idx] for col_idx in col_idxs]
+        constraint_indices = None
+        constraint_values = None
+        if given is not None:
+            constraint_indices = [[row, col_idx] for col_idx, _ in given]
+            constraint_values = [float(val) for _, val in given]
+
+        midxs = np.asarray(model_idxs)[np.random.randint(len(model_idxs),
+                                                         size=n)]
+        samples = np.zeros((n, len(col_idxs),))
+        for m_ix in np.unique(midxs):
+            rows = np.nonzero(midxs == m_ix)[0]
+            samples[rows, :] = ensemble.predictive_draw(
+                int(m_ix), query_indices, constraint_indices,
+                constraint_values, N=len(rows))
+
+        return samples, midxs
+
+    def _marginal_logps(self, ensemble, x, col_idx):
+        """ The log probability of each value in x in a new row of col_idx,
+        averaged over the live states. """
+        row = self._n_rows
+        values = [float(xi) for xi in np.asarray(x).flatten()]
+        query_indices = [[row, col_idx]]*len(values)
+        logps = np.array([
+            ensemble.predictive_probability(m_ix, query_indices, values)
+            for m_ix in range(self._n_models)])
+
+        return logsumexp(logps, axis=0) - log(self._n_models)
+
+    def _joint_entropy(self, model_idxs, col_idxs, n_samples):
+        """ mu.joint_entropy over the models in model_idxs, with the samples
+        drawn from the live states if there are any. """
+        ensemble = self._live_ensemble()
+        if ensemble is None:
+            models = [self._models[m_ix] for m_ix in model_idxs]
+            return mu.joint_entropy(models, col_idxs, n_samples)
+
+        x, midxs = self._draw(ensemble, col_idxs, n=n_samples,
+                              model_idxs=model_idxs)
+        # the states only give marginals, so the joint density of each draw
+        # is taken from the metadata of the model it came from
+        logps = np.zeros(n_samples)
+        for i, m_ix in enumerate(midxs):
+            logps[i] = mu.probability(x[i:i+1, :], [self._models[m_ix]],
+                                      col_idxs)[0]
+
+        return -np.sum(logps) / n_samples
+
     @classmethod
     def load(cls, filename):
         """ Create an engine given metadata from a pickle file.
@@ -285,7 +428,8 @@ class Engine(object):
         """ Save to a zipped pickle file.
 
         The resulting file can be used to initialize Engine object using
-        `Engine.load(filename)`.
+        `Engine.load(filename)`. Only the model metadata is saved; live states
+        are rebuilt from it by the first `run` after loading.
 
         Parameters
         ----------
@@ -299,6 +443,7 @@ class Engine(object):
             'cls_attrs': {
                 'models': self._models,
                 'n_models': self._n_models,
+                'subsampled': getattr(self, '_subsampled', False),
                 'diagnostic_tables': self._diagnostic_tables,
                 'converters': self._converters}}
 
@@ -376,6 +521,14 @@ class Engine(object):
             Keyword arguments sent to `BCState.transition`
         verbose : bool
             If True, print disagnostic info at every checkpoint
+
+        Notes
+        -----
+        Without a custom mapper, and if the models are not subsampled, the
+        states live in this process between runs, so a run picks up where the
+        last one stopped without rebuilding them from metadata. The models run
+        in parallel threads (one model per thread). With a mapper, each run
+        rebuilds its states from metadata in the mapper's workers.
         """
 
         if trans_kwargs is None:
@@ -386,18 +539,20 @@ class Engine(object):
         if model_idxs is None:
             model_idxs = list(range(self._n_models))
 
+        ensemble = self._live_ensemble()
+        if ensemble is not None:
+            self._run_resident(ensemble, checkpoint, model_idxs, verbose,
+                               trans_kwargs)
+            return
+
         args = []
         for m_ix in model_idxs:
             model = self._models[m_ix]
             sd = np.random.randint(2**31-1)
             init_kwarg = {'dtypes': self._dtypes,
                           'distargs': self._distargs,
-                          'Zv': model['col_assignment'],
-                          'Zrcv': model['row_assignments'],
-                          'col_hypers': model['col_hypers'],
-                          'state_alpha': model['state_alpha'],
-                          'view_alphas': model['view_alphas'],
                           'seed': sd}
+            init_kwarg.update(_resume_kwargs(model))
 
             rows = sorted(self._converters['idx2row_df'][m_ix].keys())
             data_i = self._data[rows, :]
@@ -405,10 +560,50 @@ class Engine(object):
             args.append((data_i, checkpoint, m_ix, verbose, init_kwarg,
                          trans_kwargs,))
 
-        res = self._mapper(_run, args)
+        res = self._map(_run, args)
         for idx, (model, diagnostics) in zip(model_idxs, res):
             self._models[idx] = model
             self._diagnostic_tables[idx].extend(diagnostics)
+        self._row_similarity = None
+
+    def _run_resident(self, ensemble, checkpoint, model_idxs, verbose,
+                      trans_kwargs):
+        """ run for live states """
+        trans_kwargs = dict(trans_kwargs)
+        n_iter = trans_kwargs['N']
+        if checkpoint is None:
+            checkpoint = n_iter
+            n_sweeps = 1
+        else:
+            trans_kwargs['N'] = checkpoint
+            n_sweeps = int(n_iter/checkpoint)
+
+        for i in range(n_sweeps):
+            t_start = time.time()
+            ensemble.transition(state_idxs=model_idxs, **trans_kwargs)
+            t_iter = time.time() - t_start
+
+            log_scores = ensemble.log_scores()
+            for m_ix in model_idxs:
+                model = ensemble.get_metadata(m_ix)
+                n_views = len(set(model['col_assignment']))
+                self._models[m_ix] = model
+                self._row_similarity = None
+
+                diagnostic = {
+                    'log_score': log_scores[m_ix],
+                    'n_views': n_views,
+                    'iters': checkpoint,
+                    'time': t_iter}
+                self._diagnostic_tables[m_ix].append(diagnostic)
+
+                if verbose:
+                    msg = "Model {}:\n\t+ sweep {} of {} in {} sec."
+                    msg += "\n\t+ log score: {}"
+                    msg += "\n\t+ n_views: {}\n"
+
+                    print(msg.format(m_ix, i, n_sweeps, t_iter,
+                                     log_scores[m_ix], n_views))
 
     def sample(self, cols, given=None, n=1):
         """ Draw samples from cols
@@ -435,7 +630,11 @@ class Engine(object):
 
         col_idxs = [self._converters['col2idx'][col] for col in cols]
 
-        data_out = mu.sample(self._models, col_idxs, given=given, n=n)
+        ensemble = self._live_ensemble()
+        if ensemble is None:
+            data_out = mu.sample(self._models, col_idxs, given=given, n=n)
+        else:
+            data_out, _ = self._draw(ensemble, col_idxs, given=given, n=n)
 
         x = du.convert_data(data_out, cols, self._dtypes, self._converters,
                             to_val=True)
@@ -640,37 +839,103 @@ class Engine(object):
 
         return depprob
 
+    def dependence_probability_matrix(self, cols=None, threshold=None):
+        """ The dependence probability of every pair of columns, in one call.
+
+        Parameters
+        ----------
+        cols : list(index), optional
+            The columns to include. All columns by default.
+        threshold : float, optional
+            If given, return only the pairs whose dependence probability is at
+            least `threshold`.
+
+        Returns
+        -------
+        pandas.DataFrame
+            If `threshold` is None, a square matrix indexed by `cols`.
+            Otherwise, one row per pair with columns `col_a`, `col_b`, and
+            `dependence_probability`; each pair is listed once, with `col_a`
+            before `col_b` in `cols`.
+        """
+        if cols is None:
+            cols = self._col_names
+
+        col_idxs = [self._converters['col2idx'][col] for col in cols]
+        col_assignments = [[model['col_assignment'][c] for c in col_idxs]
+                           for model in self._models]
+
+        if threshold is None:
+            mat = dependence_probability_matrix(col_assignments)
+            return pd.DataFrame(mat, index=cols, columns=cols)
+
+        idx_a, idx_b, depprob = dependence_probability_pairs(col_assignments,
+                                                             threshold)
+        cols = np.asarray(cols, dtype=object)
+        return pd.DataFrame({'col_a': cols[idx_a],
+                             'col_b': cols[idx_b],
+                             'dependence_probability': depprob},
+                            columns=['col_a', 'col_b',
+                                     'dependence_probability'])
+
+    def _row_similarity_index(self):
+        """ The row similarity index of the current models, and a map from
+        row name to row position. Rebuilt after the models change. """
+        if self._row_similarity is None:
+            model_rows = None
+            if getattr(self, '_subsampled', False):
+                model_rows = [sorted(self._converters['idx2row_df'][m].keys())
+                              for m in range(self._n_models)]
+            index = BCRowSimilarity(
+                self._n_rows,
+                [model['col_assignment'] for model in self._models],
+                [model['row_assignments'] for model in self._models],
+                model_rows)
+            row2pos = dict((row, ix) for ix, row in enumerate(self._row_names))
+            self._row_similarity = (index, row2pos)
+        return self._row_similarity
+
     def row_similarity(self, row_a, row_b, wrt=None):
         """ The similarity between two rows in terms of their partitions. """
-        if wrt is not None:
-            colidxs = [self._converters['col2idx'][col] for col in wrt]
-
         if row_a == row_b:
             # XXX: we will assume that the user meant to do this
             return 1.0
 
+        if wrt is not None:
+            wrt = [self._converters['col2idx'][col] for col in wrt]
 
-        sim = [] 
-        for midx, model in enumerate(self._models):
-            idx_a = self._converters['row2idx_sf'][midx].get(row_a, None)
-            idx_b = self._converters['row2idx_sf'][midx].get(row_b, None)
-            
-            if idx_a is None or idx_b is None:
-                continue
+        index, row2pos = self._row_similarity_index()
+        return index.similarity(row2pos[row_a], row2pos[row_b], wrt)
 
-            if wrt is not None:
-                relviews = set([model['col_assignment'][c] for c in colidxs])
-            else:
-                relviews = list(range(len(model['row_assignments'])))
+    def most_similar_rows(self, row, k=10, wrt=None):
+        """ The k rows most similar to `row`.
 
-            sim.append(0.0)
-            for vidx in relviews:
-                asgn = model['row_assignments'][vidx]
-                sim[-1] += (asgn[idx_a] == asgn[idx_b])
+        Only the rows that share a cluster with `row` in some model are
+        visited, so the cost grows with the size of `row`'s clusters rather
+        than with the number of rows.
 
-            sim[-1] /= float(len(relviews))
+        Parameters
+        ----------
+        row : index
+            The query row.
+        k : int
+            The number of rows to return.
+        wrt : list(column index), optional
+            Measure similarity with respect to these columns only.
 
-        return np.mean(sim)
+        Returns
+        -------
+        pandas.Series
+            The similarity of each of (at most) `k` rows to `row`, indexed by
+            row and sorted from most to least similar. Rows that share no
+            cluster with `row` are left out.
+        """
+        if wrt is not None:
+            wrt = [self._converters['col2idx'][col] for col in wrt]
+
+        index, row2pos = self._row_similarity_index()
+        rows, sims = index.top_k(row2pos[row], k, wrt)
+        return pd.Series(sims, index=self._row_names[rows])
 
     # TODO: allow multiple columns for joint entropy
     def entropy(self, col, n_samples=500):
@@ -696,6 +961,7 @@ class Engine(object):
 
         col_idx = self._converters['col2idx'][col]
         dtype = self._dtypes[col_idx]
+        ensemble = self._live_ensemble()
 
         # Unless x is enumerable (is categorical), we approximate h(x) using
         # an importance sampling extimate of h(x) using p(x) as the importance
@@ -703,12 +969,19 @@ class Engine(object):
         if dtype == 'categorical':
             k = self._distargs[col_idx][0]
             x = np.array([[i] for i in range(k)])
-            logps = mu.probability(x, self._models, (col_idx,))
+            if ensemble is None:
+                logps = mu.probability(x, self._models, (col_idx,))
+            else:
+                logps = self._marginal_logps(ensemble, x, col_idx)
             assert logps.shape == (k,)
             h = -np.sum(np.exp(logps)*logps)
         else:
-            x = mu.sample(self._models, (col_idx,), n=n_samples)
-            logps = mu.probability(x, self._models, (col_idx,))
+            if ensemble is None:
+                x = mu.sample(self._models, (col_idx,), n=n_samples)
+                logps = mu.probability(x, self._models, (col_idx,))
+            else:
+                x, _ = self._draw(ensemble, (col_idx,), n=n_samples)
+                logps = self._marginal_logps(ensemble, x, col_idx)
 
             h = -np.sum(logps) / n_samples
 
@@ -743,18 +1016,18 @@ class Engine(object):
         idx_a = self._converters['col2idx'][col_a]
         idx_b = self._converters['col2idx'][col_b]
 
-        models = []
-        for model in self._models:
+        model_idxs = []
+        for m_ix, model in enumerate(self._models):
             if model['col_assignment'][idx_a] == \
                     model['col_assignment'][idx_b]:
-                models.append(model)
+                model_idxs.append(m_ix)
 
-        if len(models) == 0:
+        if len(model_idxs) == 0:
             mi = 0.0
         else:
             h_a = self.entropy(col_a, n_samples=n_samples)
             h_b = self.entropy(col_b, n_samples=n_samples)
-            h_ab = mu.joint_entropy(models, [idx_a, idx_b], n_samples)
+            h_ab = self._joint_entropy(model_idxs, [idx_a, idx_b], n_samples)
             mi = h_a + h_b - h_ab
 
             # XXX: Differential entropy can be negative. Here we prevent
@@ -799,7 +1072,8 @@ class Engine(object):
         """
         col_idxs = [self._converters['col2idx'][col_a],
                     self._converters['col2idx'][col_b]]
-        h_ab = mu.joint_entropy(self._models, col_idxs, n_samples)
+        h_ab = self._joint_entropy(list(range(self._n_models)), col_idxs,
+                                   n_samples)
         h_b = self.entropy(col_b, n_samples)
         h_c = h_ab - h_b
 
@@ -835,6 +1109,9 @@ class Engine(object):
                 msg = 'Unexpected functype ({}} for func {}'
                 raise ValueError(msg.format(functype, func))
 
+        if func == 'dependence_probability':
+            return self.dependence_probability_matrix(idxs)
+
         mat = np.eye(len(idxs))
         if itertype == 'comb':
             for i, idx_a in enumerate(idxs):
@@ -952,12 +1229,8 @@ class Engine(object):
 
         model = self._models[state_idx]
         init_kwargs = {'dtypes': self._dtypes,
-                       'distargs': self._distargs,
-                       'Zv': model['col_assignment'],
-                       'Zrcv': model['row_assignments'],
-                       'col_hypers': model['col_hypers'],
-                       'state_alpha': model['state_alpha'],
-                       'view_alphas': model['view_alphas']}
+                       'distargs': self._distargs}
+        init_kwargs.update(_resume_kwargs(model))
         state = BCState(self._data.T, **init_kwargs)
         model_logps = state.get_logps()
         pu.plot_cc_model(self._data, model, model_logps, self._df.index,
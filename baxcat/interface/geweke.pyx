@@ -25,8 +25,9 @@ cdef extern from "geweke_tester.hpp" namespace "baxcat":
     cdef cppclass GewekeTester:
         GewekeTester(size_t num_rows, size_t num_cols,
                      vector[string] datatypes, unsigned int seed, size_t m,
-                     bool do_hypers, bool do_row_alpha, bool do_row_z,
-                     bool do_col_z, bool ct_kernel) except +
+                     bool do_hypers, bool do_row_alpha, bool do_col_alpha,
+                     bool do_row_z, bool do_col_z, size_t ct_kernel,
+                     size_t rt_kernel) except +
 
         void run(size_t num_times, size_t num_posterior_chains, bool do_init)
 
@@ -45,8 +46,8 @@ cdef class Geweke:
     cdef bool _do_col_z
 
     def __init__(self, n_rows, n_cols, dtypes, seed, m=1,
-                 do_hypers=True, do_row_alpha=True, do_row_z=True,
-                 do_col_z=True, ct_kernel=0):
+                 do_hypers=True, do_row_alpha=True, do_col_alpha=True,
+                 do_row_z=True, do_col_z=True, ct_kernel=0, rt_kernel=0):
         if len(dtypes) != n_cols:
             raise ValueError('Must be a dtype for each column')
         if not all(dt in valid_dtypes for dt in dtypes):
@@ -57,8 +58,9 @@ cdef class Geweke:
         self.n_rows = n_rows
         self._do_col_z = do_col_z
         self.geweke = new GewekeTester(n_rows, n_cols, dtypes, seed, m,
-                                       do_hypers, do_row_alpha, do_row_z,
-                                       do_col_z, ct_kernel)
+                                       do_hypers, do_row_alpha,
+                                       do_col_alpha, do_row_z, do_col_z,
+                                       ct_kernel, rt_kernel)
 
     def run(self, n_samples, n_chains, lag):
         self.geweke.run(n_samples, n_chains, lag)
@@ -2,6 +2,7 @@ from libcpp.vector cimport vector
 from libcpp.string cimport string
 from libcpp cimport bool
 from libcpp.map cimport map as cmap
+from libcpp.memory cimport shared_ptr
 from cython.operator import dereference
 
 from baxcat.utils import validation
@@ -25,6 +26,48 @@ valid_transitions = [
     "column_hypers"]
 
 
+valid_kernels = [0, 1, 2]
+
+
+def validate_transition_args(n_rows, n_cols, transition_list, which_rows,
+                             which_cols, which_kernel, which_row_kernel):
+    """ Check the arguments of BCState.transition before the GIL is released.
+    Returns transition_list as bytes. """
+    transitions = []
+    for transition in transition_list:
+        if isinstance(transition, str):
+            transition = bytes(transition, 'ascii')
+        if transition.decode('ascii') not in valid_transitions:
+            raise ValueError('invalid transition: {}'.format(transition))
+        transitions.append(transition)
+    if which_kernel not in valid_kernels:
+        raise ValueError('which_kernel must be one of {}'.format(valid_kernels))
+    if which_row_kernel not in valid_kernels:
+        raise ValueError('which_row_kernel must be one of {}'.format(
+            valid_kernels))
+    if any(row < 0 or row >= n_rows for row in which_rows):
+        raise IndexError('which_rows out of range')
+    if any(col < 0 or col >= n_cols for col in which_cols):
+        raise IndexError('which_cols out of range')
+    return transitions
+
+
+def validate_predictive_indices(n_cols, index_list, list_type='query'):
+    """ Check that index_list is a list of (row, col) pairs with rows
+    non-negative and columns in range before the GIL is released. Rows at or
+    past n_rows are new rows. """
+    validation.validate_index_list(index_list, list_type=list_type)
+    if any(row < 0 or col < 0 or col >= n_cols for row, col in index_list):
+        raise IndexError('{}_indices out of range'.format(list_type))
+
+
+cdef extern from "column_file.hpp" namespace "baxcat":
+    cdef cppclass ColumnFile:
+        ColumnFile(string path) except +
+        size_t numRows()
+        size_t numColumns()
+
+
 cdef extern from "state.hpp" namespace "baxcat":
     cdef cppclass State:
         State(vector[vector[double]] X,
@@ -42,12 +85,47 @@ cdef extern from "state.hpp" namespace "baxcat":
               vector[double] view_alpha,
               vector[cmap[string, double]] hyper_maps) except +
 
+        State(const double *X, size_t n_rows, size_t n_cols,
+              size_t row_stride, size_t col_stride,
+              vector[string] dtypes,
+              vector[vector[double]] distargs,
+              size_t rng_seed) except +
+
+        State(const double *X, size_t n_rows, size_t n_cols,
+              size_t row_stride, size_t col_stride,
+              vector[string] dtypes,
+              vector[vector[double]] distargs,
+              size_t rng_seed,
+              vector[size_t] Zv,
+              vector[vector[size_t]] Zrcv,
+              double state_alpha,
+              vector[double] view_alpha,
+              vector[cmap[string, double]] hyper_maps) except +
+
+        State(shared_ptr[ColumnFile] file,
+              vector[string] dtypes,
+              vector[vector[double]] distargs,
+              size_t rng_seed) except +
+
+        State(shared_ptr[ColumnFile] file,
+              vector[string] dtypes,
+              vector[vector[double]] distargs,
+              size_t rng_seed,
+              vector[size_t] Zv,
+              vector[vector[size_t]] Zrcv,
+              double state_alpha,
+              vector[double] view_alpha,
+              vector[cmap[string, double]] hyper_maps) except +
+
+        # the calls marked nogil are safe to run while other threads run
+        # other states (BCState releases the GIL around them)
         void transition(vector[string] transition_list,
                         vector[size_t] which_rows,
                         vector[size_t] which_cols,
                         size_t which_kernel,
                         size_t N,
-                        size_t m)
+                        size_t m,
+                        size_t which_row_kernel) nogil except +
 
         # getters
         vector[size_t] getColumnAssignment()
@@ -59,7 +137,9 @@ cdef extern from "state.hpp" namespace "baxcat":
         size_t getNumViews()
         vector[vector[size_t]] getViewCounts()
         vector[vector[cmap[string, double]]] getSuffstats()
-        double logScore();
+        cmap[string, size_t] getCacheStats()
+        cmap[string, size_t] getSplitMergeStats()
+        double logScore() nogil except +
 
         vector[double] getViewLogps();
         vector[double] getFeatureLogps();
@@ -71,6 +151,7 @@ cdef extern from "state.hpp" namespace "baxcat":
                             vector[double] hyperprior_config)
         void setHypers(size_t column_index, cmap[string, double] hypers_map)
         void setHypers(size_t column_index, vector[double] hypers_vec)
+        void setSIMD(bool use_simd)
 
         # append and pop row
         void appendRow(vector[double] data_row, bool assign_to_max_p_cluster)
@@ -81,35 +162,85 @@ cdef extern from "state.hpp" namespace "baxcat":
         vector[double] predictiveLogp(vector[vector[size_t]] query_indices,
                                       vector[double] query_values,
                                       vector[vector[size_t]] constraint_indices,
-                                      vector[double] constraint_values)
+                                      vector[double] constraint_values) nogil except +
+
+        vector[double] predictiveLogpBatch(
+                vector[vector[size_t]] query_indices,
+                vector[double] query_values,
+                vector[vector[vector[size_t]]] constraint_indices,
+                vector[vector[double]] constraint_values) nogil except +
 
         vector[vector[double]] predictiveDraw(
                 vector[vector[size_t]] query_indices,
                 vector[vector[size_t]] constraint_indices,
                 vector[double] constraint_values,
-                size_t N)
+                size_t N) nogil except +
+
+
+cdef extern from "ensemble.hpp" namespace "baxcat":
+    cdef cppclass Ensemble:
+        Ensemble(const double *X, size_t n_rows, size_t n_cols,
+                 size_t row_stride, size_t col_stride,
+                 vector[string] dtypes,
+                 vector[vector[double]] distargs) except +
+
+        Ensemble(shared_ptr[ColumnFile] file,
+                 vector[string] dtypes,
+                 vector[vector[double]] distargs) except +
+
+        size_t addState(size_t rng_seed) except +
+        size_t addState(size_t rng_seed,
+                        vector[size_t] Zv,
+                        vector[vector[size_t]] Zrcv,
+                        double state_alpha,
+                        vector[double] view_alpha,
+                        vector[cmap[string, double]] hyper_maps) except +
+
+        void transition(vector[size_t] which_states,
+                        vector[string] transition_list,
+                        vector[size_t] which_rows,
+                        vector[size_t] which_cols,
+                        size_t which_kernel,
+                        size_t N,
+                        size_t m,
+                        size_t which_row_kernel) nogil except +
+
+        size_t size()
+        State& getState(size_t index)
+        vector[double] logScores() nogil except +
+
+
+cdef extern from "dependence.hpp" namespace "baxcat":
+    cdef cppclass DependencePairs:
+        vector[size_t] first
+        vector[size_t] second
+        vector[double] probability
 
+    void dependenceProbabilityMatrix(vector[vector[size_t]] col_assignments,
+                                     double *out) nogil except +
 
-cdef emptyvecvec(intype):
-    cdef vector[vector[double]] ret_double
-    cdef vector[vector[size_t]] ret_size_t
-    if intype == 'double':
-        return ret_double
-    elif intype == 'size_t':
-        return ret_size_t
-    else:
-        raise ValueError
+    DependencePairs dependenceProbabilityPairs(
+            vector[vector[size_t]] col_assignments,
+            double threshold) nogil except +
 
 
-cdef emptyvec(intype):
-    cdef vector[double] ret_double
-    cdef vector[size_t] ret_size_t
-    if intype == 'double':
-        return ret_double
-    elif intype == 'size_t':
-        return ret_size_t
-    else:
-        raise ValueError
+cdef extern from "row_similarity.hpp" namespace "baxcat":
+    cdef cppclass SimilarRows:
+        vector[size_t] rows
+        vector[double] similarity
+
+    cdef cppclass RowSimilarity:
+        RowSimilarity(size_t n_rows,
+                      vector[vector[size_t]] col_assignments,
+                      vector[vector[vector[size_t]]] row_assignments,
+                      vector[vector[size_t]] model_rows) except +
+
+        double similarity(size_t row_a, size_t row_b,
+                          vector[size_t] wrt) nogil except +
+        SimilarRows topK(size_t row, size_t k,
+                         vector[size_t] wrt) nogil except +
+        vector[SimilarRows] topKBatch(vector[size_t] rows, size_t k,
+                                      vector[size_t] wrt) nogil except +
 
 
 def dictstr_dec(d):
@@ -119,17 +250,176 @@ def dictstr_enc(d):
     return dict([(k.encode(), v) for k, v in d.items()])
 
 
+def as_float_buffer(X):
+    """ X as a float64 array whose strides are whole, non-negative numbers of
+    elements. Copies only if X does not already qualify. """
+    X = np.asarray(X, dtype=np.float64)
+    if any(st < 0 or st % X.itemsize for st in X.strides):
+        X = np.ascontiguousarray(X)
+    return X
+
+
+cdef shared_ptr[ColumnFile] open_column_file(path) except *:
+    """ Map the column file at path (see data_utils.write_column_file). """
+    cdef string c_path = bytes(path, 'utf-8')
+    return shared_ptr[ColumnFile](new ColumnFile(c_path))
+
+
+def dependence_probability_matrix(col_assignments):
+    """ The dependence probability of every pair of columns.
+
+    col_assignments[m] is the column assignment ('col_assignment' in the
+    metadata) of model m. Returns an n_cols by n_cols array whose (i, j)
+    entry is the fraction of models that put columns i and j in the same
+    view.
+    """
+    cdef vector[vector[size_t]] Z = col_assignments
+    if Z.size() == 0:
+        raise ValueError('col_assignments is empty')
+
+    out = np.empty((Z[0].size(), Z[0].size()), dtype=np.float64)
+    cdef size_t address = out.ctypes.data
+    cdef double *out_ptr = <double *> address
+    with nogil:
+        dependenceProbabilityMatrix(Z, out_ptr)
+    return out
+
+
+def dependence_probability_pairs(col_assignments, threshold):
+    """ The pairs of columns (i, j), i < j, with dependence probability at
+    least threshold. Returns arrays i, j, and probability, sorted by i then
+    j. """
+    cdef vector[vector[size_t]] Z = col_assignments
+    cdef double c_threshold = threshold
+    cdef DependencePairs pairs
+    with nogil:
+        pairs = dependenceProbabilityPairs(Z, c_threshold)
+    return (np.array(pairs.first, dtype=int),
+            np.array(pairs.second, dtype=int),
+            np.array(pairs.probability))
+
+
+cdef state_metadata(State *state, vector[string] datatypes):
+    metadata = dict()
+
+    metadata['dtypes'] = datatypes
+    metadata['col_assignment'] = state.getColumnAssignment()
+    metadata['row_assignments'] = state.getRowAssignments()
+    # metadata['hyperprior_configs'] = []  # what is this for? 
+    hypers = state.getColumnHypers()
+    metadata['col_hypers'] = [dictstr_dec(hp) for hp in hypers]
+    metadata['state_alpha'] = state.getStateCRPAlpha()
+    metadata['view_alphas'] = state.getViewCRPAlphas()
+    suffstats = state.getSuffstats()
+    sfsts = []
+    for col_sfst in suffstats:
+        sfsts.append([dictstr_dec(sfst) for sfst in col_sfst])
+    metadata['col_suffstats'] = sfsts
+    metadata['view_counts'] = state.getViewCounts() 
+
+    return metadata
+
+
+cdef predictive_probability(State *state, n_cols, query_indices, query_values,
+                            constraint_indices, constraint_values):
+    """ BCState.predictive_probability on state """
+    validate_predictive_indices(n_cols, query_indices, 'query')
+    if not isinstance(query_values, list):
+        raise TypeError('query_values must be a list')
+    if len(query_indices) != len(query_values):
+        raise ValueError('query_indices and query_values must have the '
+                         'same number of values')
+
+    cdef vector[vector[size_t]] c_query_indices = query_indices
+    cdef vector[double] c_query_values = query_values
+    cdef vector[vector[size_t]] c_constraint_indices
+    cdef vector[double] c_constraint_values
+    cdef vector[double] logps
+
+    if constraint_indices is not None:
+        validate_predictive_indices(n_cols, constraint_indices,
+                                    'constraint')
+        c_constraint_indices = constraint_indices
+
+    if constraint_values is not None:
+        if not isinstance(constraint_values, list):
+            raise TypeError('constraint_values must be a list')
+        if len(constraint_values) != c_constraint_indices.size():
+            raise ValueError('constraint_indices and constraint_values '
+                             'must be the same length')
+        c_constraint_values = constraint_values
+
+    with nogil:
+        logps = state.predictiveLogp(c_query_indices, c_query_values,
+                                     c_constraint_indices,
+                                     c_constraint_values)
+    return logps
+
+
+cdef predictive_draw(State *state, n_cols, query_indices, constraint_indices,
+                     constraint_values, N):
+    """ BCState.predictive_draw on state """
+    validate_predictive_indices(n_cols, query_indices, 'query')
+
+    cdef vector[vector[size_t]] c_query_indices = query_indices
+    cdef vector[vector[size_t]] c_constraint_indices
+    cdef vector[double] c_constraint_values
+    cdef size_t c_N = N
+    cdef vector[vector[double]] draws
+
+    if constraint_indices is not None:
+        validate_predictive_indices(n_cols, constraint_indices,
+                                    'constraint')
+        c_constraint_indices = constraint_indices
+
+    if constraint_values is not None:
+        if not isinstance(constraint_values, list):
+            raise TypeError('constraint_values must be a list')
+        if len(constraint_values) != c_constraint_indices.size():
+            raise ValueError('constraint_indices and constraint_values '
+                             'must be the same length')
+        c_constraint_values = constraint_values
+
+    with nogil:
+        draws = state.predictiveDraw(c_query_indices, c_constraint_indices,
+                                     c_constraint_values, c_N)
+    return draws
+
+
 cdef class BCState:
     cdef State *statePtr
     cdef size_t n_rows
     cdef size_t n_cols
     cdef vector[string] datatypes
+    # the state reads continuous columns straight from this array's buffer
+    # (None if the state is over a column file, which the state keeps mapped)
+    cdef object X
 
     def __cinit__(self, X, dtypes=None, distargs=None, col_hypers=None,
                   Zv=None, Zrcv=None, state_alpha=-1, view_alphas=None,
                   n_grid=31, seed=None):
-        # data is column major (the rows in X become the crosscat columns)
-        self.n_cols, self.n_rows = X.shape
+        # data is column major (the rows in X become the crosscat columns).
+        # Any strided float64 array (e.g. data.T) is used without copying.
+        # If X is a str, it is the path of a column file (see
+        # data_utils.write_column_file), which is mapped rather than read.
+        cdef shared_ptr[ColumnFile] file
+        cdef size_t col_stride = 0
+        cdef size_t row_stride = 0
+        cdef size_t address = 0
+        cdef const double *X_ptr = NULL
+        if isinstance(X, str):
+            file = open_column_file(X)
+            self.X = None
+            self.n_rows = file.get().numRows()
+            self.n_cols = file.get().numColumns()
+        else:
+            X = as_float_buffer(X)
+            self.X = X
+            self.n_cols, self.n_rows = X.shape
+            col_stride = X.strides[0] // X.itemsize
+            row_stride = X.strides[1] // X.itemsize
+            address = X.ctypes.data
+            X_ptr = <const double *> address
         if seed is None or seed < 0:
             seed = int(time.time())
 
@@ -152,14 +442,26 @@ cdef class BCState:
         self.datatypes = dtl 
 
         if all(m == None for m in[col_hypers, Zv, Zrcv]):
-            self.statePtr = new State(X, dtl, distargs, seed)
-        elif all(m is not None for m in [col_hypers, Zv, Zrcv]):
-            col_hypers = [dictstr_enc(hyper) for hyper in col_hypers]
-            self.statePtr = new State(X, dtl, distargs, seed, Zv, Zrcv,
-                                      state_alpha, view_alphas, col_hypers)
-        elif (col_hypers is None) and (Zv is not None) and (Zrcv is not None):
-            self.statePtr = new State(X, dtl, distargs, seed, Zv, Zrcv,
-                                      state_alpha, view_alphas, [])
+            if file.get() != NULL:
+                self.statePtr = new State(file, dtl, distargs, seed)
+            else:
+                self.statePtr = new State(X_ptr, self.n_rows, self.n_cols,
+                                          row_stride, col_stride, dtl,
+                                          distargs, seed)
+        elif (Zv is not None) and (Zrcv is not None):
+            if col_hypers is None:
+                col_hypers = []
+            else:
+                col_hypers = [dictstr_enc(hyper) for hyper in col_hypers]
+            if file.get() != NULL:
+                self.statePtr = new State(file, dtl, distargs, seed, Zv, Zrcv,
+                                          state_alpha, view_alphas, col_hypers)
+            else:
+                self.statePtr = new State(X_ptr, self.n_rows, self.n_cols,
+                                          row_stride, col_stride, dtl,
+                                          distargs, seed, Zv, Zrcv,
+                                          state_alpha, view_alphas,
+                                          col_hypers)
         else:
             raise ValueError('No initializer for this variable set.')
 
@@ -169,17 +471,46 @@ cdef class BCState:
 
     def log_score(self):
         """ Returns the log score of the state. Runs in O(rows*cols). """
-        return self.statePtr.logScore()
+        cdef double score
+        with nogil:
+            score = self.statePtr.logScore()
+        return score
 
     @property
     def n_views(self):
         return self.statePtr.getNumViews()
 
     def transition(self, transition_list=(), which_rows=(), which_cols=(),
-                   which_kernel=0, N=1, m=1):
-        # TODO: validate input
-        self.statePtr.transition(transition_list, which_rows, which_cols,
-                                 which_kernel, N, m)
+                   which_kernel=0, N=1, m=1, which_row_kernel=0):
+        """ Run N rounds of the transitions in transition_list.
+
+        which_kernel selects the column kernel (0: Gibbs, 1: Gibbs with
+        bootstrapped singletons, 2: enumeration). which_row_kernel selects
+        the row kernel: 0 sweeps views in parallel, one thread per view; 1
+        sweeps views one at a time and splits the work within each row across
+        threads by column. Both are exact Gibbs and give the same chain for
+        any number of threads. Use 1 when one view holds most of the columns.
+        Inside a parallel region, such as a state run by BCEnsemble, kernel 1
+        quietly runs plain serial Gibbs (kernel 0) in each view instead. 2
+        runs one split-merge proposal per cluster before each Gibbs sweep (see
+        get_split_merge_stats).
+
+        The GIL is released while the state runs, so Python threads can run
+        different states at once. Don't run one state from two threads.
+        """
+        transition_list = validate_transition_args(
+            self.n_rows, self.n_cols, transition_list, which_rows, which_cols,
+            which_kernel, which_row_kernel)
+        cdef vector[string] c_transitions = transition_list
+        cdef vector[size_t] c_rows = which_rows
+        cdef vector[size_t] c_cols = which_cols
+        cdef size_t c_kernel = which_kernel
+        cdef size_t c_N = N
+        cdef size_t c_m = m
+        cdef size_t c_row_kernel = which_row_kernel
+        with nogil:
+            self.statePtr.transition(c_transitions, c_rows, c_cols, c_kernel,
+                                     c_N, c_m, c_row_kernel)
 
     def get_logps(self):
         logps = {}
@@ -189,6 +520,21 @@ cdef class BCState:
         logps['cluster_logps'] = self.statePtr.getClusterLogps()
         return logps
 
+    def get_cache_stats(self):
+        """ Returns the hits and misses of the cluster predictive caches. """
+        return dictstr_dec(self.statePtr.getCacheStats())
+
+    def get_split_merge_stats(self):
+        """ Returns the split/merge proposals and acceptances of row kernel 2.
+        """
+        return dictstr_dec(self.statePtr.getSplitMergeStats())
+
+    def set_simd(self, use_simd):
+        """ Score rows with SIMD kernels (faster) or the scalar path (the
+        default). SIMD results depend on the CPU, so with it on the same seed
+        only reproduces the same chain on the same hardware. """
+        self.statePtr.setSIMD(bool(use_simd))
+
 
     def predictive_probability(self, query_indices, query_values,
                                constraint_indices=None,
@@ -196,77 +542,69 @@ cdef class BCState:
         """
         Get the predictive probability
         """
-        validation.validate_index_list(query_indices, list_type='query')
-        if not isinstance(query_values, list):
-            raise TypeError('query_values must be a list')
+        return predictive_probability(self.statePtr, self.n_cols,
+                                      query_indices,
+                                      query_values, constraint_indices,
+                                      constraint_values)
+
+    def predictive_probability_batch(self, query_indices, query_values,
+                                     constraint_indices=None,
+                                     constraint_values=None):
+        """ Log predictive probability of many queries, each with its own
+        constraints.
+
+        query_indices[q] is the (row, col) of query q and query_values[q] its
+        value. constraint_indices[q] and constraint_values[q] are the
+        (row, col) pairs and values query q is conditioned on. Leave both as
+        None for no constraints. The queries run in parallel and do not
+        change the state.
+        """
+        validate_predictive_indices(self.n_cols, query_indices, 'query')
         if len(query_indices) != len(query_values):
             raise ValueError('query_indices and query_values must have the '
                              'same number of values')
 
-        if constraint_indices is None:
-            constraint_indices = emptyvecvec('size_t')
-        else:
-            validation.validate_index_list(constraint_indices,
-                                           list_type='constraint')
-
-        if constraint_values is None:
-            constraint_values = emptyvec('double')
-        else:
-            if not isinstance(constraint_values, list):
-                raise TypeError('constraint_values must be a list')
-            if len(constraint_values) != len(constraint_indices):
-                raise ValueError('constraint_indices and constraint_values '
-                                 'must be the same length')
-
-        return self.statePtr.predictiveLogp(query_indices, query_values,
-                                            constraint_indices,
-                                            constraint_values)
+        cdef vector[vector[size_t]] c_query_indices = query_indices
+        cdef vector[double] c_query_values = query_values
+        cdef vector[vector[vector[size_t]]] c_indices
+        cdef vector[vector[double]] c_values
+        cdef vector[double] logps
+        if (constraint_indices is None) != (constraint_values is None):
+            raise ValueError('give both constraint_indices and '
+                             'constraint_values or neither')
+        if constraint_indices is not None:
+            if len(constraint_indices) != len(query_indices) or \
+                    len(constraint_values) != len(query_indices):
+                raise ValueError('there must be one constraint list per query')
+            for indices, values in zip(constraint_indices, constraint_values):
+                validate_predictive_indices(self.n_cols, indices, 'constraint')
+                if len(indices) != len(values):
+                    raise ValueError('each query needs one constraint value '
+                                     'per constraint index')
+            c_indices = constraint_indices
+            c_values = constraint_values
+
+        with nogil:
+            logps = self.statePtr.predictiveLogpBatch(c_query_indices,
+                                                      c_query_values,
+                                                      c_indices, c_values)
+        return logps
 
     def predictive_draw(self, query_indices, constraint_indices=None,
                         constraint_values=None, N=1):
-        """
-        Predictive draw from state.
-        """
-        # FIXME: no constraints doesn't work.
-        validation.validate_index_list(query_indices, list_type='query')
+        """ N predictive draws of the (row, col) pairs in query_indices.
 
-        if constraint_indices is None:
-            constraint_indices = emptyvecvec('size_t')
-        else:
-            validation.validate_index_list(constraint_indices,
-                                           list_type='constraint')
-
-        if constraint_values is None:
-            constraint_values = emptyvec('double')
-        else:
-            if not isinstance(constraint_values, list):
-                raise TypeError('constraint_values must be a list')
-            if len(constraint_values) != len(constraint_indices):
-                raise ValueError('constraint_indices and constraint_values '
-                                 'must be the same length')
-
-        return self.statePtr.predictiveDraw(query_indices, constraint_indices,
-                                            constraint_values, N)
+        Rows at or past n_rows are new rows. The queries in each new row are
+        drawn jointly: every draw picks one cluster per view, weighted by the
+        CRP and by the constraints given in that row, and draws the row's
+        queried columns in that view from it. Returns an N by
+        len(query_indices) list of lists.
+        """
+        return predictive_draw(self.statePtr, self.n_cols, query_indices,
+                               constraint_indices, constraint_values, N)
 
     def get_metadata(self):
-        metadata = dict()
-
-        metadata['dtypes'] = self.datatypes
-        metadata['col_assignment'] = self.statePtr.getColumnAssignment()
-        metadata['row_assignments'] = self.statePtr.getRowAssignments()
-        # metadata['hyperprior_configs'] = []  # what is this for? 
-        hypers = self.statePtr.getColumnHypers()
-        metadata['col_hypers'] = [dictstr_dec(hp) for hp in hypers]
-        metadata['state_alpha'] = self.statePtr.getStateCRPAlpha()
-        metadata['view_alphas'] = self.statePtr.getViewCRPAlphas()
-        suffstats = self.statePtr.getSuffstats()
-        sfsts = []
-        for col_sfst in suffstats:
-            sfsts.append([dictstr_dec(sfst) for sfst in col_sfst])
-        metadata['col_suffstats'] = sfsts
-        metadata['view_counts'] = self.statePtr.getViewCounts() 
-
-        return metadata
+        return state_metadata(self.statePtr, self.datatypes)
 
     # FIXME: This is not excatly what we want. We don't want to have to
     # resample entire rows. We'd like to resample parts of rows, for example,
@@ -347,3 +685,229 @@ cdef class BCState:
                 self.statePtr.replaceRowData(row_index, y)
 
         return acr/float(num_samples)
+
+
+cdef class BCEnsemble:
+    """ Several states over one shared copy of the data, run in parallel.
+
+    The states live in C++ for the life of the ensemble, so running them
+    again needs no rebuilding or pickling. X is column major, as for BCState,
+    and is not copied if it is a float64 array (e.g. data.T). X may also be
+    the path of a column file, which the ensemble maps and shares.
+    """
+    cdef Ensemble *ensemblePtr
+    cdef size_t n_rows
+    cdef size_t n_cols
+    cdef vector[string] datatypes
+    # the states read continuous columns straight from this array's buffer
+    # (None if the ensemble is over a column file)
+    cdef object X
+
+    def __cinit__(self, X, dtypes=None, distargs=None):
+        cdef shared_ptr[ColumnFile] file
+        cdef size_t col_stride = 0
+        cdef size_t row_stride = 0
+        cdef size_t address = 0
+        cdef const double *X_ptr = NULL
+        if isinstance(X, str):
+            file = open_column_file(X)
+            self.X = None
+            self.n_rows = file.get().numRows()
+            self.n_cols = file.get().numColumns()
+        else:
+            X = as_float_buffer(X)
+            self.X = X
+            self.n_cols, self.n_rows = X.shape
+            col_stride = X.strides[0] // X.itemsize
+            row_stride = X.strides[1] // X.itemsize
+            address = X.ctypes.data
+            X_ptr = <const double *> address
+
+        if dtypes is None:
+            dtypes = ['continuous']*self.n_cols
+        if distargs is None:
+            distargs = np.zeros((self.n_cols, 1))
+        if len(dtypes) != self.n_cols:
+            raise ValueError("Should be a dtype for each column.")
+        if len(distargs) != self.n_cols:
+            raise ValueError("Should be a distarg for each column.")
+
+        dtl = [bytes(st, 'ascii') for st in dtypes]
+        self.datatypes = dtl
+
+        if file.get() != NULL:
+            self.ensemblePtr = new Ensemble(file, dtl, distargs)
+        else:
+            self.ensemblePtr = new Ensemble(X_ptr, self.n_rows, self.n_cols,
+                                            row_stride, col_stride, dtl,
+                                            distargs)
+
+    def __dealloc__(self):
+        del self.ensemblePtr
+
+    @property
+    def n_states(self):
+        return self.ensemblePtr.size()
+
+    def add_state(self, col_hypers=None, Zv=None, Zrcv=None, state_alpha=-1,
+                  view_alphas=None, seed=None):
+        """ Add a state, from the prior or from a partition (see BCState).
+        Returns the index of the new state. """
+        if seed is None or seed < 0:
+            seed = int(time.time())
+        if view_alphas is None:
+            view_alphas = []
+
+        if Zv is None and Zrcv is None:
+            if col_hypers is not None:
+                raise ValueError('col_hypers requires Zv and Zrcv.')
+            return self.ensemblePtr.addState(seed)
+        elif Zv is not None and Zrcv is not None:
+            if col_hypers is None:
+                col_hypers = []
+            else:
+                col_hypers = [dictstr_enc(hyper) for hyper in col_hypers]
+            return self.ensemblePtr.addState(seed, Zv, Zrcv, state_alpha,
+                                             view_alphas, col_hypers)
+        else:
+            raise ValueError('No initializer for this variable set.')
+
+    def transition(self, state_idxs=(), transition_list=(), which_rows=(),
+                   which_cols=(), which_kernel=0, N=1, m=1,
+                   which_row_kernel=0):
+        """ Run BCState.transition on the states in state_idxs (all states by
+        default), one state per thread. The GIL is released while they run.
+        """
+        if any(idx < 0 or idx >= self.ensemblePtr.size()
+               for idx in state_idxs):
+            raise IndexError('state_idxs out of range')
+        if len(set(state_idxs)) != len(state_idxs):
+            raise ValueError('state_idxs lists a state more than once')
+        transition_list = validate_transition_args(
+            self.n_rows, self.n_cols, transition_list, which_rows, which_cols,
+            which_kernel, which_row_kernel)
+        cdef vector[size_t] c_states = state_idxs
+        cdef vector[string] c_transitions = transition_list
+        cdef vector[size_t] c_rows = which_rows
+        cdef vector[size_t] c_cols = which_cols
+        cdef size_t c_kernel = which_kernel
+        cdef size_t c_N = N
+        cdef size_t c_m = m
+        cdef size_t c_row_kernel = which_row_kernel
+        with nogil:
+            self.ensemblePtr.transition(c_states, c_transitions, c_rows,
+                                        c_cols, c_kernel, c_N, c_m,
+                                        c_row_kernel)
+
+    def set_simd(self, use_simd):
+        """ BCState.set_simd for every state added so far. """
+        cdef size_t i
+        for i in range(self.ensemblePtr.size()):
+            self.ensemblePtr.getState(i).setSIMD(bool(use_simd))
+
+    def log_scores(self):
+        cdef vector[double] scores
+        with nogil:
+            scores = self.ensemblePtr.logScores()
+        return scores
+
+    def get_metadata(self, state_idx):
+        if state_idx >= self.ensemblePtr.size():
+            raise IndexError('state_idx out of range')
+        return state_metadata(&self.ensemblePtr.getState(state_idx),
+                              self.datatypes)
+
+    def predictive_probability(self, state_idx, query_indices, query_values,
+                               constraint_indices=None,
+                               constraint_values=None):
+        """ BCState.predictive_probability on state state_idx. """
+        if state_idx >= self.ensemblePtr.size():
+            raise IndexError('state_idx out of range')
+        return predictive_probability(&self.ensemblePtr.getState(state_idx),
+                                      self.n_cols, query_indices, query_values,
+                                      constraint_indices, constraint_values)
+
+    def predictive_draw(self, state_idx, query_indices,
+                        constraint_indices=None, constraint_values=None, N=1):
+        """ BCState.predictive_draw on state state_idx. """
+        if state_idx >= self.ensemblePtr.size():
+            raise IndexError('state_idx out of range')
+        return predictive_draw(&self.ensemblePtr.getState(state_idx),
+                               self.n_cols, query_indices, constraint_indices,
+                               constraint_values, N)
+
+
+cdef class BCRowSimilarity:
+    """ Row similarity over a set of models, indexed by cluster.
+
+    Built once from the models' metadata; a top-k query only looks at the
+    rows in the query row's clusters. Rows are positions in the full table.
+
+    Parameters
+    ----------
+    n_rows : int
+        The number of rows in the full table.
+    col_assignments : list(list(int))
+        The 'col_assignment' of each model.
+    row_assignments : list(list(list(int)))
+        The 'row_assignments' of each model.
+    model_rows : list(list(int)), optional
+        For subsampled models, model_rows[m][i] is the row of the full table
+        that is row i of model m.
+    """
+    cdef RowSimilarity *rsPtr
+
+    def __cinit__(self, n_rows, col_assignments, row_assignments,
+                  model_rows=None):
+        if model_rows is None:
+            model_rows = []
+        self.rsPtr = new RowSimilarity(n_rows, col_assignments,
+                                       row_assignments, model_rows)
+
+    def __dealloc__(self):
+        del self.rsPtr
+
+    def similarity(self, row_a, row_b, wrt=None):
+        """ Similarity of two rows with respect to the columns in wrt (all
+        columns by default). NaN if no model holds both rows. """
+        cdef size_t a = row_a
+        cdef size_t b = row_b
+        cdef vector[size_t] c_wrt
+        cdef double sim
+        if wrt is not None:
+            c_wrt = wrt
+        with nogil:
+            sim = self.rsPtr.similarity(a, b, c_wrt)
+        return sim
+
+    def top_k(self, row, k, wrt=None):
+        """ The (at most) k rows most similar to row, most similar first, as
+        arrays of rows and similarities. Rows with zero similarity are left
+        out. """
+        cdef size_t c_row = row
+        cdef size_t c_k = k
+        cdef vector[size_t] c_wrt
+        cdef SimilarRows similar
+        if wrt is not None:
+            c_wrt = wrt
+        with nogil:
+            similar = self.rsPtr.topK(c_row, c_k, c_wrt)
+        return np.array(similar.rows, dtype=int), np.array(similar.similarity)
+
+    def top_k_batch(self, rows, k, wrt=None):
+        """ top_k for each row in rows, run in parallel. Returns a list of
+        (rows, similarities) tuples. """
+        cdef vector[size_t] c_rows = rows
+        cdef size_t c_k = k
+        cdef vector[size_t] c_wrt
+        cdef vector[SimilarRows] similar
+        cdef size_t q
+        if wrt is not None:
+            c_wrt = wrt
+        with nogil:
+            similar = self.rsPtr.topKBatch(c_rows, c_k, c_wrt)
+        out = []
+        for q in range(similar.size()):
+            out.append((np.array(similar[q].rows, dtype=int),
+                        np.array(similar[q].similarity)))
+        return out
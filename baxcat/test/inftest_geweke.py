@@ -12,8 +12,9 @@ if not os.path.exists(RESDIR):
 
 @pytest.mark.inference
 @pytest.mark.parametrize('seed', [1337])
-def test_geweke(seed):
+@pytest.mark.parametrize('rt_kernel', [0, 1, 2])
+def test_geweke(seed, rt_kernel):
     dtypes = ['categorical']*5 + ['continuous']*5
-    gwk = Geweke(10, 10, dtypes, seed, ct_kernel=0, m=1)
+    gwk = Geweke(10, 10, dtypes, seed, ct_kernel=0, m=1, rt_kernel=rt_kernel)
     gwk.run(5000, 5, 1)
     assert not gwk.output(RESDIR)
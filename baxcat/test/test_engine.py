@@ -5,6 +5,7 @@ import pandas as pd
 import numpy as np
 
 from multiprocessing.pool import Pool
+from multiprocessing.pool import ThreadPool
 
 from baxcat.engine import Engine
 from baxcat.metrics import SquaredError
@@ -133,6 +134,26 @@ def test_engine_with_mapper_mp(gendf):
         assert len(engine.models) == 4
 
 
+@pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
+def test_engine_with_mapper_threads(gendf):
+    with ThreadPool(2) as pool:
+        engine = Engine(gendf(), n_models=4, mapper=pool.map)
+        engine.init_models()
+        engine.run(2)
+
+        assert len(engine.models) == 4
+
+
+@pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
+def test_engine_use_threads_subsampled(gendf):
+    engine = Engine(gendf(), n_models=4, use_threads=True)
+    engine.init_models(subsample_size=0.5)
+    engine.run(2)
+
+    assert len(engine.models) == 4
+    assert all(len(table) == 2 for table in engine._diagnostic_tables)
+
+
 @pytest.mark.skipif(NO_IPP, reason='No IPython parallel installed, or '
                     'no cluster')
 @pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
@@ -279,6 +300,53 @@ def test_view_alpha_should_change_if_transition(gendf):
     assert view_alpha_start != view_alpha_end
 
 
+@pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
+def test_run_should_keep_states_live_between_runs(gendf):
+    df = gendf()
+
+    engine = Engine(df, n_models=3, use_mp=False)
+    engine.init_models()
+    ensemble = engine._ensemble
+    assert ensemble is not None
+
+    engine.run(2)
+    engine.run(2, model_idxs=[1])
+
+    assert engine._ensemble is ensemble
+    for m_ix in range(3):
+        assert engine._models[m_ix] == ensemble.get_metadata(m_ix)
+
+
+def test_live_states_should_not_make_a_pool():
+    engine = Engine(smalldf(), n_models=2)
+    engine.init_models()
+    engine.run(2)
+
+    assert engine._ensemble is not None
+    assert engine._pool is None
+
+
+def test_subsampled_models_should_make_a_pool_on_first_use():
+    engine = Engine(smalldf(), n_models=2, use_threads=True)
+    assert engine._pool is None
+
+    engine.init_models(subsample_size=0.5)
+    pool = engine._pool
+    assert isinstance(pool, ThreadPool)
+
+    engine.run(2)
+    assert engine._pool is pool
+
+
+def test_run_with_mapper_should_not_keep_states_live():
+    engine = Engine(smalldf(), n_models=2,
+                    mapper=lambda f, args: list(map(f, args)))
+    engine.init_models()
+    engine.run(2)
+
+    assert engine._ensemble is None
+
+
 # save and load
 # ---
 @pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
@@ -324,6 +392,24 @@ def test_save_and_load_equivalence(gendf):
         assert all(engine._col_names == new_engine._col_names)
 
 
+@pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
+def test_run_after_load_should_rebuild_live_states(gendf):
+    df = gendf()
+
+    engine = Engine(df, n_models=2, use_mp=False)
+    engine.init_models()
+
+    with tempfile.NamedTemporaryFile('wb') as tf:
+        engine.save(tf.name)
+        new_engine = Engine.load(tf.name)
+
+    assert new_engine._ensemble is None
+    new_engine.run(2)
+
+    assert new_engine._ensemble is not None
+    assert len(new_engine._diagnostic_tables[0]) == 2
+
+
 # dependence probability
 # ---
 def test_dependence_probability():
@@ -371,6 +457,29 @@ def test_pairwise_dependence_probability():
     assert depprob.ix[1, 2] == depprob.ix[2, 1]
 
 
+def test_dependence_probability_matrix_should_match_pairs():
+    df = smalldf()
+
+    engine = Engine(df, n_models=6, use_mp=False)
+    engine.init_models()
+    engine.run(5)
+
+    depprob = engine.dependence_probability_matrix()
+    for col_a in df.columns:
+        for col_b in df.columns:
+            if col_a != col_b:
+                assert depprob.loc[col_a, col_b] == \
+                    engine.dependence_probability(col_a, col_b)
+
+    pairs = engine.dependence_probability_matrix(threshold=.5)
+    for _, row in pairs.iterrows():
+        assert row['dependence_probability'] >= .5
+        assert row['dependence_probability'] == \
+            depprob.loc[row['col_a'], row['col_b']]
+    n_above = int(((depprob.values >= .5).sum() - len(df.columns))/2)
+    assert len(pairs) == n_above
+
+
 # Row similarity
 # ---
 def test_row_similarity():
@@ -427,6 +536,27 @@ def test_row_similarity_wrt():
     assert engine.row_similarity(0, 1, wrt=['c2']) == 1.
 
 
+def test_most_similar_rows_should_match_row_similarity():
+    df = smalldf()
+
+    engine = Engine(df, n_models=3, use_mp=False)
+    engine.init_models()
+    engine.run(5)
+
+    for wrt in [None, ['x_1', 'x_3']]:
+        similar = engine.most_similar_rows(0, k=5, wrt=wrt)
+        assert len(similar) <= 5
+        assert 0 not in similar.index
+        assert all(np.diff(similar.values) <= 0)
+        for row, sim in similar.items():
+            assert sim == engine.row_similarity(0, row, wrt=wrt)
+
+        others = [row for row in df.index
+                  if row != 0 and row not in similar.index]
+        for row in others:
+            assert engine.row_similarity(0, row, wrt=wrt) <= similar.min()
+
+
 # probability
 # ---
 @pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
@@ -578,6 +708,26 @@ def test_sample_multi_col_multi_mixed(gendf):
     assert isinstance(x[2, 1], str)
 
 
+def test_predictive_queries_should_draw_from_live_states(monkeypatch):
+    engine = gen_engine(smalldf())
+    assert engine._ensemble is not None
+
+    def no_metadata_sample(*args, **kwargs):
+        raise AssertionError('sampled from metadata')
+
+    monkeypatch.setattr('baxcat.engine.mu.sample', no_metadata_sample)
+
+    x = engine.sample(['x_1', 'x_3'], given=[('x_2', 1.0)], n=5)
+    assert x.shape == (5, 2,)
+    assert all(isinstance(xi, str) for xi in x[:, 1])
+
+    assert np.isfinite(engine.entropy('x_1', n_samples=20))
+    assert np.isfinite(engine.entropy('x_3'))
+    mi = engine.mutual_information('x_1', 'x_4', normed=False,
+                                   n_samples=20)
+    assert 0. <= mi
+
+
 # surprisal
 # ---
 @pytest.mark.parametrize('gendf', [smalldf, smalldf_mssg])
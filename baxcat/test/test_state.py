@@ -198,6 +198,17 @@ def test_predictive_probability_constrained_invalid_input(blank):
         bcstate.predictive_probability([[2, 2]], [0.0], [[0, 0], [1, 2]], [1.])
 
 
+@pytest.mark.parametrize('args', [
+    ([[2, 4]], [0.0], None, None),
+    ([[2, -1]], [0.0], None, None),
+    ([[2, 2]], [0.0], [[[0, 4]]], [[1.2]]),
+    ([[2, 2]], [0.0], [[[0, 0], [1, 1]]], [[1.2]]),
+    ([[2, 2]], [0.0], [[[0, 0]]], [[1.2, 1.1]])])
+def test_predictive_probability_batch_should_reject_bad_input(blank, args):
+    with pytest.raises((ValueError, IndexError,)):
+        blank.predictive_probability_batch(*args)
+
+
 def test_predictive_probability_constrained_valid_output(blank):
     bcstate = blank
     res = bcstate.predictive_probability([[2, 2]], [0.0], [[0, 0]], [1.2])
@@ -268,6 +279,17 @@ def test_transition_should_change_metadata(blank):
     assert hash_a != hash_b
 
 
+@pytest.mark.parametrize('kwargs', [
+    {'which_kernel': 3},
+    {'which_row_kernel': 3},
+    {'transition_list': [b'not_a_transition']},
+    {'which_rows': [10]},
+    {'which_cols': [4]}])
+def test_transition_should_reject_bad_input(blank, kwargs):
+    with pytest.raises((ValueError, IndexError,)):
+        blank.transition(**kwargs)
+
+
 # ---
 def test_conditioned_row_resample_should_change_metadata(blank):
     bcstate = blank
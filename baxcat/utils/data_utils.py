@@ -145,6 +145,28 @@ def dataframe_to_array(df, valmaps):
     return data
 
 
+def write_column_file(data, path):
+    """ Write a 2-D float array (rows by columns, as from dataframe_to_array)
+    to path in the baxcat column file format (see doc/column_file.rst). NaN
+    marks missing values. Columns are written one at a time, so only one
+    column is copied at once.
+    """
+    data = np.asarray(data, dtype=float)
+    n_rows, n_cols = data.shape
+
+    header = np.zeros(64, dtype=np.uint8)
+    header[:8] = np.frombuffer(b'BXCOLS\0\0', dtype=np.uint8)
+    header[8:16] = np.frombuffer(np.array([1, 0], dtype='<u4').tobytes(),
+                                 dtype=np.uint8)
+    header[16:32] = np.frombuffer(
+        np.array([n_rows, n_cols], dtype='<u8').tobytes(), dtype=np.uint8)
+
+    with open(path, 'wb') as f:
+        f.write(header.tobytes())
+        for cidx in range(n_cols):
+            f.write(np.ascontiguousarray(data[:, cidx], dtype='<f8').tobytes())
+
+
 def gen_valmaps(df, dtypes, metadata):
     """ FIXME: Write """
     valmaps = dict()
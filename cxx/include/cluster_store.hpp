@@ -0,0 +1,238 @@
+
+#ifndef baxcat_cxx_cluster_store_guard
+#define baxcat_cxx_cluster_store_guard
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+#include "debug.hpp"
+#include "prng.hpp"
+
+namespace baxcat{
+
+// Cluster store
+// ````````````````````````````````````````````````````````````````````````````
+// Holds the clusters (component models) of a Feature. The default store keeps
+// one DataType object per cluster. A datatype may specialize ClusterStore to
+// lay out its sufficient statistics differently (see datatypes/continuous.hpp)
+// as long as it provides the same interface. DataTypes held by the default
+// store must provide insertElementDeferred and updateConstants for the bulk
+// insert.
+template <class DataType>
+class ClusterStore
+{
+public:
+    // Add/remove clusters
+    // append an empty cluster with hypers
+    void pushBack(const std::vector<double> &distargs, const std::vector<double> &hypers)
+    {
+        _models.emplace_back(distargs);
+        _models.back().setHypers(hypers);
+    }
+
+    // remove cluster k
+    void erase(size_t k)
+    {
+        _models.erase(_models.begin()+k);
+    }
+
+    // remove the clusters in the sorted list ks in one pass
+    void erase(const std::vector<size_t> &ks)
+    {
+        size_t j = 0;
+        size_t k_new = 0;
+        for(size_t k = 0; k < _models.size(); ++k){
+            if(j < ks.size() and ks[j] == k){
+                ++j;
+                continue;
+            }
+            if(k_new != k)
+                _models[k_new] = std::move(_models[k]);
+            ++k_new;
+        }
+        _models.erase(_models.begin()+k_new, _models.end());
+    }
+
+    // replace the clusters with num_clusters empty clusters. The store may have held clusters
+    // with other distargs (as scratch stores do), so every cluster is rebuilt from distargs.
+    void reset(size_t num_clusters, const std::vector<double> &distargs,
+               const std::vector<double> &hypers)
+    {
+        _models.assign(num_clusters, DataType(distargs));
+        for(auto &model : _models)
+            model.setHypers(hypers);
+    }
+
+    // remove all clusters
+    void clear()
+    {
+        _models.clear();
+    }
+
+    // clear the sufficient statistics of every cluster
+    void clearSuffstats(const std::vector<double> &distargs)
+    {
+        for(auto &model : _models)
+            model.clear(distargs);
+    }
+
+    // Add/remove data
+    template <typename T>
+    void insertElement(size_t k, T x)
+    {
+        _models[k].insertElement(x);
+    }
+
+    // insert every set element i of data into cluster assignment[i]. The counts go in first
+    // and the cached terms are rebuilt once per cluster rather than once per element.
+    template <class Container>
+    void insertElements(const Container &data, const std::vector<size_t> &assignment)
+    {
+        data.for_each_set([&](size_t i){
+            _models[assignment[i]].insertElementDeferred(data.at(i));
+        });
+        for(auto &model : _models)
+            model.updateConstants();
+    }
+
+    template <typename T>
+    void removeElement(size_t k, T x)
+    {
+        _models[k].removeElement(x);
+    }
+
+    // Probabilities
+    template <typename T>
+    double elementLogp(size_t k, T x) const
+    {
+        return _models[k].elementLogp(x);
+    }
+
+    // logp of x under cluster k with the elements in given added to it. The store is unchanged.
+    template <typename T>
+    double elementLogpGiven(size_t k, T x, const std::vector<T> &given) const
+    {
+        DataType model = _models[k];
+        for(auto y : given)
+            model.insertElement(y);
+        return model.elementLogp(x);
+    }
+
+    // adds the logp of x under each cluster to logps. x is taken out of
+    // current_cluster while it is scored there.
+    template <typename T>
+    void addElementLogps(T x, size_t current_cluster, std::vector<double> &logps)
+    {
+        const size_t num_clusters = _models.size();
+        for(size_t k = 0; k < num_clusters; ++k){
+            DataType &model = _models[k];
+            if(k == current_cluster){
+                model.removeElement(x);
+                logps[k] += model.elementLogp(x);
+                model.insertElement(x);
+            }else{
+                logps[k] += model.elementLogp(x);
+            }
+        }
+    }
+
+    template <typename T>
+    double singletonLogp(T x) const
+    {
+        return _models[0].singletonLogp(x);
+    }
+
+    double logp(size_t k) const
+    {
+        return _models[k].logp();
+    }
+
+    double hyperpriorLogp(const std::vector<double> &hyperprior_config) const
+    {
+        return _models[0].hyperpriorLogp(hyperprior_config);
+    }
+
+    // draw from cluster k
+    double draw(size_t k, baxcat::PRNG *rng) const
+    {
+        return double(_models[k].draw(rng));
+    }
+
+    // draw from cluster k with the elements in given added to it. The store is unchanged.
+    template <typename T>
+    double drawGiven(size_t k, const std::vector<T> &given, baxcat::PRNG *rng) const
+    {
+        DataType model = _models[k];
+        for(auto y : given)
+            model.insertElement(y);
+        return double(model.draw(rng));
+    }
+
+    // Hypers
+    // resample the hyperparameters of all clusters. returns the new hypers
+    std::vector<double> resampleHypers(const std::vector<double> &hyperprior_config,
+                                       baxcat::PRNG *rng)
+    {
+        auto hypers = DataType::resampleHypers(_models, hyperprior_config, rng);
+        for(auto &model : _models)
+            model.setHypers(hypers);
+        return hypers;
+    }
+
+    void setHypers(const std::vector<double> &hypers)
+    {
+        for(auto &model : _models)
+            model.setHypers(hypers);
+    }
+
+    void setHypersByMap(const std::map<std::string, double> &hypers_map)
+    {
+        for(auto &model : _models)
+            model.setHypersByMap(hypers_map);
+    }
+
+    // Getters
+    size_t size() const
+    {
+        return _models.size();
+    }
+
+    size_t getCount(size_t k) const
+    {
+        return _models[k].getCount();
+    }
+
+    std::vector<double> getHypers() const
+    {
+        return _models[0].getHypers();
+    }
+
+    std::map<std::string, double> getHypersMap(size_t k) const
+    {
+        return _models[k].getHypersMap();
+    }
+
+    std::map<std::string, double> getSuffstatsMap(size_t k) const
+    {
+        return _models[k].getSuffstatsMap();
+    }
+
+    // the default store has no SIMD kernels, so this does nothing
+    void setSIMD(bool use_simd) {}
+
+    // the default store has no predictive cache
+    std::map<std::string, size_t> getCacheStats() const
+    {
+        return {{"hits", 0}, {"misses", 0}};
+    }
+
+private:
+    std::vector<DataType> _models;
+};
+
+} // end namespace baxcat
+
+#endif
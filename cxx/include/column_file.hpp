@@ -0,0 +1,52 @@
+
+#ifndef baxcat_cxx_column_file_guard
+#define baxcat_cxx_column_file_guard
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+namespace baxcat{
+
+// Column file
+// ````````````````````````````````````````````````````````````````````````````
+// A read-only memory map of a table stored column by column on disk (the format is described in
+// doc/column_file.rst). Features built over a ColumnFile borrow their column straight from the
+// map (see DataContainer), so only the pages a sweep touches are resident and the OS page cache
+// decides which stay. The map lives as long as the ColumnFile; share it with a shared_ptr.
+class ColumnFile
+{
+public:
+    static const size_t HEADER_BYTES = 64;
+    static const uint32_t VERSION = 1;
+
+    // map the file at path. throws std::runtime_error if it can't be opened or isn't a column
+    // file
+    explicit ColumnFile(const std::string &path);
+    ~ColumnFile();
+
+    ColumnFile(const ColumnFile &) = delete;
+    ColumnFile &operator=(const ColumnFile &) = delete;
+
+    // write X (X[f] is column f; every column the same length) to path
+    static void write(const std::string &path, const std::vector<std::vector<double>> &X);
+
+    size_t numRows() const {return _num_rows;};
+    size_t numColumns() const {return _num_columns;};
+
+    // the table; element (r, f) is at data()[f*numRows() + r]
+    const double *data() const {return _data;};
+    const double *column(size_t f) const {return _data + f*_num_rows;};
+
+private:
+    void *_map;
+    size_t _map_bytes;
+    size_t _num_rows;
+    size_t _num_columns;
+    const double *_data;
+};
+
+} // end namespace baxcat
+
+#endif
@@ -50,7 +50,7 @@ public:
     // are also assigned to the model
     virtual T drawConstrained(std::vector<T> constraints, baxcat::PRNG *rng) const = 0;
 
-    size_t getCount(){ return static_cast<size_t>(_n+.5); };
+    size_t getCount() const { return static_cast<size_t>(_n+.5); };
 protected:
     // Number of data points assigned to the model
     double _n;
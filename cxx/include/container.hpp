@@ -1,123 +1,236 @@
-
 #ifndef baxcat_cxx_container_guard
 #define baxcat_cxx_container_guard
 
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <utility>
 
 namespace baxcat{
 
 // base template for integral types
+//
+// A container either owns its values or borrows a caller-owned buffer of doubles (see the
+// strided-buffer constructor). A borrowed container reads straight from the buffer, which must
+// outlive it and every copy of it. The first mutation copies the buffer into owned storage.
+//
+// Which elements are set (observed) is kept in a bitmap of 64-bit words: bit i%64 of word i/64
+// is on if element i is set. Bits past size() are always off. for_each_set visits the set
+// elements a word at a time, so runs of missing data are skipped 64 elements at once.
 template <typename T>
 class DataContainer
 {
     std::vector<T> _data;
-    std::vector<bool> _is_initalized;
+    std::vector<uint64_t> _set_bits;
+    size_t _size = 0;
+
+    // borrowed buffer; _borrowed is null when the container owns its values
+    const double *_borrowed = nullptr;
+    size_t _stride = 1;
+
+    static const size_t WORD_BITS = 64;
+
+    // copy a borrowed buffer into _data so that it can be changed
+    void __own()
+    {
+        if(_borrowed == nullptr)
+            return;
+        _data.resize(_size);
+        for(size_t i = 0; i < _size; ++i)
+            _data[i] = at(i);
+        _borrowed = nullptr;
+        _stride = 1;
+    }
+
+    // size the bitmap for N elements, all unset
+    void __resetBits(size_t N)
+    {
+        _size = N;
+        _set_bits.assign((N + WORD_BITS - 1)/WORD_BITS, 0);
+    }
+
+    void __setBit(size_t index)
+    {
+        _set_bits[index/WORD_BITS] |= uint64_t(1) << (index % WORD_BITS);
+    }
+
+    void __clearBit(size_t index)
+    {
+        _set_bits[index/WORD_BITS] &= ~(uint64_t(1) << (index % WORD_BITS));
+    }
+
+    // grow by one element, set or unset
+    void __pushBit(bool is_set)
+    {
+        if(_size % WORD_BITS == 0)
+            _set_bits.push_back(0);
+        ++_size;
+        if(is_set)
+            __setBit(_size-1);
+    }
 
 public:
-    DataContainer(const DataContainer &dc) : _data(dc._data), _is_initalized(dc._is_initalized){};
+    DataContainer(const DataContainer &dc) = default;
+    DataContainer(DataContainer &&dc) = default;
+    DataContainer &operator=(const DataContainer &dc) = default;
+    DataContainer &operator=(DataContainer &&dc) = default;
 
 	DataContainer(){};
 
     DataContainer(size_t N)
     {
         _data.resize(N);
-        _is_initalized.resize(N);
+        __resetBits(N);
     };
 
     DataContainer(std::vector<double> data)
     {
-        _data.resize(data.size());
-        _is_initalized.resize(data.size());
-        for(size_t i = 0; i < data.size(); ++i){
-            double x_double = data[i]+.5; // add .5 then truncate (avoid cast to lower value)
+        load_and_cast_data(std::move(data));
+    }
+
+    // Read size values from data, stride doubles apart (e.g. one column of a column-major
+    // buffer). Values are cast into owned storage; DataContainer<double> borrows data instead.
+    DataContainer(const double *data, size_t size, size_t stride=1)
+    {
+        _data.resize(size);
+        __resetBits(size);
+        for(size_t i = 0; i < size; ++i){
+            double x_double = data[i*stride]+.5;
             if( !std::isnan(x_double ) ){
                 _data[i] = (T)x_double;
-                _is_initalized[i] = true;
+                __setBit(i);
             }
         }
     }
 
     void set(size_t index, T value)
     {
+        __own();
         _data[index] = value;
-        _is_initalized[index] = true;
+        __setBit(index);
     }
 
     void cast_and_set(size_t index, double value)
     {
+        __own();
         _data[index] = static_cast<T>(value + .5);
-        _is_initalized[index] = true;
+        __setBit(index);
     }
 
     void append(T value)
     {
+        __own();
         _data.push_back( value );
-        _is_initalized.push_back(true);
+        __pushBit(true);
     }
 
     void cast_and_append(double value)
     {
+        __own();
         _data.push_back( static_cast<T>(value+.5) );
-        _is_initalized.push_back(true);
+        __pushBit(true);
     }
 
     void append_unset_element()
     {
+        __own();
         _data.push_back(0);
-        _is_initalized.push_back(false);
+        __pushBit(false);
     }
 
     void pop_back()
     {
-        _is_initalized.pop_back();
+        __own();
+        __clearBit(_size-1);
+        --_size;
+        if(_size % WORD_BITS == 0)
+            _set_bits.pop_back();
         _data.pop_back();
     }
 
     void unset(size_t index)
     {
-        _is_initalized[index] = false;
+        __clearBit(index);
     }
 
     bool is_set(size_t index) const
     {
-        return _is_initalized[index];
+        return (_set_bits[index/WORD_BITS] >> (index % WORD_BITS)) & 1;
     }
 
     bool is_missing(size_t index) const
     {
-        return !_is_initalized[index];
+        return !is_set(index);
     }
 
     T at(size_t index) const
     {
+        if(_borrowed != nullptr)
+            return static_cast<T>(_borrowed[index*_stride]);
     	return _data[index];
     }
 
     size_t size() const
     {
-        return _data.size();
+        return _size;
+    }
+
+    // the number of set elements
+    size_t count_set() const
+    {
+        size_t count = 0;
+        for(auto word : _set_bits)
+            count += __builtin_popcountll(word);
+        return count;
+    }
+
+    // call f(i) for each set element i in increasing order. Words with every bit set are walked
+    // as a plain counted loop; empty words are skipped.
+    template <class F>
+    void for_each_set(F f) const
+    {
+        for(size_t w = 0; w < _set_bits.size(); ++w){
+            uint64_t word = _set_bits[w];
+            const size_t base = w*WORD_BITS;
+            if(word == ~uint64_t(0)){
+                for(size_t i = base; i < base+WORD_BITS; ++i)
+                    f(i);
+            }else{
+                while(word != 0){
+                    f(base + __builtin_ctzll(word));
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    // true if the values are read from a caller-owned buffer
+    bool is_borrowed() const
+    {
+        return _borrowed != nullptr;
     }
 
     std::vector<double> getSetData() const
     {
         std::vector<double> set_data;
-        for(size_t i = 0; i < _data.size(); ++i){
-            if(_is_initalized[i])
-                set_data.push_back(static_cast<double>(_data[i]));
-        }
+        set_data.reserve(count_set());
+        for_each_set([&](size_t i){
+            set_data.push_back(static_cast<double>(at(i)));
+        });
         return set_data;
     }
 
     void load_and_cast_data(std::vector<double> data)
     {
+        _borrowed = nullptr;
+        _stride = 1;
         _data.resize(data.size());
-        _is_initalized.resize(data.size());
+        __resetBits(data.size());
         for(size_t i = 0; i < data.size(); ++i){
-            double x_double = data[i]+.5;
+            double x_double = data[i]+.5; // add .5 then truncate (avoid cast to lower value)
             if( !std::isnan(x_double ) ){
                 _data[i] = (T)x_double;
-                _is_initalized[i] = true;
+                __setBit(i);
             }
         }
     }
@@ -127,15 +240,15 @@ public:
 
 // partial specialization for doubles
 //`````````````````````````````````````````````````````````````````````````````````````````````````
-// TODO: move semantics for?
+// doubles are not copied; the container borrows data (see the class comment)
 template<>
-inline DataContainer<double>::DataContainer(std::vector<double> data)
+inline DataContainer<double>::DataContainer(const double *data, size_t size, size_t stride)
+    : _borrowed(data), _stride(stride)
 {
-    _is_initalized.resize(data.size());
-    _data = data;
-    for(size_t i = 0; i < data.size(); ++i){
-        if(!std::isnan( _data[i]))
-            _is_initalized[i] = true;
+    __resetBits(size);
+    for(size_t i = 0; i < size; ++i){
+        if(!std::isnan(data[i*stride]))
+            __setBit(i);
     }
 };
 
@@ -143,11 +256,13 @@ inline DataContainer<double>::DataContainer(std::vector<double> data)
 template<>
 inline void DataContainer<double>::load_and_cast_data(std::vector<double> data)
 {
-    _is_initalized.resize(data.size());
-    _data = data;
-    for(size_t i = 0; i < data.size(); ++i){
+    _borrowed = nullptr;
+    _stride = 1;
+    __resetBits(data.size());
+    _data = std::move(data);
+    for(size_t i = 0; i < _data.size(); ++i){
         if(!std::isnan(_data[i]))
-            _is_initalized[i] = true;
+            __setBit(i);
     }
 };
 
@@ -155,53 +270,32 @@ inline void DataContainer<double>::load_and_cast_data(std::vector<double> data)
 template<>
 inline void DataContainer<double>::cast_and_append(double value)
 {
-    _is_initalized.push_back(true);
+    __own();
     _data.push_back( value );
+    __pushBit(true);
 };
 
 
-template<>
-inline std::vector<double> DataContainer<double>::getSetData() const
-{
-    std::vector<double> set_data;
-    for(size_t i = 0; i < _data.size(); ++i){
-        if(_is_initalized[i])
-            set_data.push_back(_data[i]);
-    }
-    return set_data;
-};
-
 template<>
 inline void DataContainer<double>::cast_and_set(size_t index, double value)
 {
+    __own();
     _data[index] = static_cast<double>(value);
-    _is_initalized[index] = true;
+    __setBit(index);
 };
 
 // partial specialization for bools
 //`````````````````````````````````````````````````````````````````````````````````````````````````
-template<>
-inline DataContainer<bool>::DataContainer(std::vector<double> data)
-{
-    _is_initalized.resize(data.size());
-    _data.resize(data.size());
-    for(size_t i = 0; i < data.size(); ++i){
-        if(!std::isnan(data[i])){
-            _is_initalized[i] = true;
-            _data[i] = static_cast<bool>(data[i]);
-        }
-    }
-};
-
-
 template<>
 inline void DataContainer<bool>::load_and_cast_data(std::vector<double> data)
 {
-    _is_initalized.resize(data.size());
+    _borrowed = nullptr;
+    _stride = 1;
     _data.resize(data.size());
+    __resetBits(data.size());
     for(size_t i = 0; i < data.size(); ++i){
         if(!std::isnan( data[i])){
-            _is_initalized[i] = true;
+            __setBit(i);
             _data[i] = static_cast<bool>(data[i]);
         }
     }
@@ -211,8 +305,8 @@ inline void DataContainer<bool>::load_and_cast_data(std::vector<double> data)
 template<>
 inline void DataContainer<bool>::cast_and_append(double value)
 {
-    _is_initalized.push_back(true);
     _data.push_back(static_cast<bool>(value));
+    __pushBit(true);
 };
 
 
@@ -220,10 +314,10 @@ template<>
 inline std::vector<double> DataContainer<bool>::getSetData() const
 {
     std::vector<double> set_data;
-    for(size_t i = 0; i < _data.size(); ++i){
-        if(_is_initalized[i])
-            set_data.push_back(_data[i] ? 1.0 : 0.0);
-    }
+    set_data.reserve(count_set());
+    for_each_set([&](size_t i){
+        set_data.push_back(_data[i] ? 1.0 : 0.0);
+    });
     return set_data;
 };
 
@@ -21,13 +21,13 @@ namespace datatypes{
 
 
 // TODO: update to accept multiple integral types
-class Categorical : public SubComponent<Categorical, size_t>{
+class Categorical final : public SubComponent<Categorical, size_t>{
 public:
-	Categorical(std::vector<double> &distargs) : _dirichlet_alpha(1)
+	Categorical(const std::vector<double> &distargs) : _dirichlet_alpha(1)
 	{
 		_n = 0;
 		_counts.resize(static_cast<size_t>(distargs[0]+.5), 0);
-		_log_Z0 = 0;
+		updateConstants();
 	}
 
 	Categorical(double n, std::vector<size_t> counts, double dirichlet_alpha)
@@ -35,11 +35,14 @@ public:
 		_n = n;
 		_counts = counts;
 		_dirichlet_alpha = dirichlet_alpha;
-		_log_Z0 = 0;
+		updateConstants();
 	}
 
 	// cleanup
 	virtual void insertElement(size_t x) override;
+    // insert x without updating the cached lgamma terms. Call updateConstants after the last
+    // insert; until then the probabilities are stale.
+    void insertElementDeferred(size_t x);
     virtual void removeElement(size_t x) override;
     virtual void clear(const std::vector<double> &distargs) override;
 
@@ -74,7 +77,7 @@ public:
     static std::function<double(double)> constructDirichletAlphaConditional(
         const std::vector<Categorical> &models, const std::vector<double> &hyperprior_config);
 
-    // updates normalizing constants
+    // updates normalizing constants and rebuilds the lgamma table and its running sum
     void updateConstants();
 
 protected:
@@ -89,10 +92,23 @@ private:
 	enum hyperprior_config {DIRICHLET_ALPHA_SCALE=0};
 
 	double _log_Z0;
+	// log(n + K*alpha), the predictive normalizer
+	double _log_ZN;
 
 	// sufficient statistics
 	std::vector<size_t> _counts;
 
+	// lgamma(counts[k] + alpha) for every category, and the running sum of the entries of the
+	// occupied categories. Empty categories cancel against the K*lgamma(alpha) term of the
+	// marginal likelihood, so they are left out of the sum.
+	std::vector<double> _lgamma_counts;
+	double _sum_lgamma;
+	double _num_occupied;
+
+	// lgamma(alpha) and lgamma(K*alpha)
+	double _lgamma_alpha;
+	double _lgamma_A;
+
 	// hyperparameters
 	double _dirichlet_alpha;
 };
@@ -15,16 +15,18 @@
 #include "distributions/students_t.hpp"
 #include "distributions/inverse_gamma.hpp"
 
+#include "container.hpp"
 #include "component.hpp"
+#include "cluster_store.hpp"
 #include "models/nng.hpp"
 
 namespace baxcat{
 namespace datatypes{
 
-class Continuous : public SubComponent<Continuous, double>{
+class Continuous final : public SubComponent<Continuous, double>{
 public:
 
-    Continuous(std::vector<double> &distargs) :
+    Continuous(const std::vector<double> &distargs) :
         _sum_x(0), _sum_x_sq(0), _m(0), _r(1), _s(1), _nu(1)
     {
         _n = 0;
@@ -128,6 +130,109 @@ private:
     double _nu;
 };
 
-}} // end namespaces (baxcat::wrappers)
+}} // end namespaces (baxcat::datatypes)
+
+
+namespace baxcat{
+
+// Structure-of-arrays store for Continuous clusters. The sufficient statistics and cached
+// posterior normalizing constant of each cluster live in contiguous arrays. The hyperparameters
+// and the prior normalizing constant are shared by every cluster in a feature, so they are held
+// once. Continuous objects are built on demand only where the hyperparameter samplers need them.
+template <>
+class ClusterStore<datatypes::Continuous>
+{
+public:
+    ClusterStore();
+
+    // add/remove clusters
+    void pushBack(const std::vector<double> &distargs, const std::vector<double> &hypers);
+    void erase(size_t k);
+    void erase(const std::vector<size_t> &ks);
+    void reset(size_t num_clusters, const std::vector<double> &distargs,
+               const std::vector<double> &hypers);
+    void clear();
+    void clearSuffstats(const std::vector<double> &distargs);
+
+    // add/remove data
+    void insertElement(size_t k, double x);
+    void removeElement(size_t k, double x);
+    // insert every set element i of data into cluster assignment[i]. The normalizing constants
+    // are updated once per cluster rather than once per element.
+    void insertElements(const DataContainer<double> &data, const std::vector<size_t> &assignment);
+
+    // probabilities
+    double elementLogp(size_t k, double x) const;
+    double elementLogpGiven(size_t k, double x, const std::vector<double> &given) const;
+    void addElementLogps(double x, size_t current_cluster, std::vector<double> &logps);
+    double singletonLogp(double x) const;
+    double logp(size_t k) const;
+    double hyperpriorLogp(const std::vector<double> &hyperprior_config) const;
+
+    // draw
+    double draw(size_t k, baxcat::PRNG *rng) const;
+    double drawGiven(size_t k, const std::vector<double> &given, baxcat::PRNG *rng) const;
+
+    // hypers
+    std::vector<double> resampleHypers(const std::vector<double> &hyperprior_config,
+                                       baxcat::PRNG *rng);
+    void setHypers(const std::vector<double> &hypers);
+    void setHypersByMap(std::map<std::string, double> hypers_map);
+
+    // getters
+    size_t size() const;
+    size_t getCount(size_t k) const;
+    std::vector<double> getHypers() const;
+    std::map<std::string, double> getHypersMap(size_t k) const;
+    std::map<std::string, double> getSuffstatsMap(size_t k) const;
+
+    // hits and misses of the predictive constant cache in addElementLogps
+    std::map<std::string, size_t> getCacheStats() const;
+
+    // score addElementLogps with the widest SIMD kernel the CPU has (true) or with the scalar
+    // path (false, the default). SIMD is faster, but its logps differ from the scalar ones in the
+    // last bits and by CPU, so the same seed can give a different chain on another machine.
+    void setSIMD(bool use_simd);
+
+private:
+    // recompute the posterior normalizing constant of cluster k and bump its version
+    void __updateConstants(size_t k);
+
+    // rebuild the predictive constants of every stale cluster except skip
+    void __refreshPredictiveCache(size_t skip);
+
+    // sufficient statistics, one entry per cluster
+    std::vector<double> _n;
+    std::vector<double> _sum_x;
+    std::vector<double> _sum_x_sq;
+
+    // posterior normalizing constants, one entry per cluster
+    std::vector<double> _log_ZN;
+
+    // Student-t predictive constants, one entry per cluster. Cluster k is fresh when
+    // _cached_version[k] == _version[k]; _version[k] changes whenever cluster k or the hypers do.
+    std::vector<size_t> _version;
+    std::vector<size_t> _cached_version;
+    std::vector<double> _t_loc;
+    std::vector<double> _t_prec;
+    std::vector<double> _t_shape;
+    std::vector<double> _t_log_const;
+
+    size_t _cache_hits;
+    size_t _cache_misses;
+
+    // output buffer for the batched predictive in addElementLogps and the kernel that fills it
+    std::vector<double> _logps_buffer;
+    models::nng_simd::kernel_level _kernel_level;
+
+    // hyperparameters and prior normalizing constant shared by all clusters
+    double _m;
+    double _r;
+    double _s;
+    double _nu;
+    double _log_Z0;
+};
+
+} // end namespace baxcat
 
 #endif
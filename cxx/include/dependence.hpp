@@ -0,0 +1,44 @@
+
+#ifndef baxcat_cxx_dependence_guard
+#define baxcat_cxx_dependence_guard
+
+#include <vector>
+#include <cstddef>
+
+namespace baxcat{
+
+// Dependence probability
+// ````````````````````````````````````````````````````````````````````````````
+// The dependence probability of columns i and j is the fraction of models that put i and j in
+// the same view. Every function here takes the column assignment of each model
+// (col_assignments[m][c] is the view of column c in model m; every model has the same number of
+// columns) and throws std::invalid_argument if the models disagree on the number of columns.
+//
+// The pairs are counted in square blocks of columns, one block of rows per task, over OpenMP
+// threads. The results do not depend on the number of threads.
+
+// pairs of columns whose dependence probability is at least a threshold, in coordinate form:
+// pair k is (first[k], second[k]) with probability[k]. Only pairs with first < second are listed,
+// sorted by first then second.
+struct DependencePairs
+{
+    std::vector<size_t> first;
+    std::vector<size_t> second;
+    std::vector<double> probability;
+};
+
+// write the num_columns by num_columns dependence probability matrix into out, row major. The
+// diagonal is 1.
+void dependenceProbabilityMatrix(const std::vector<std::vector<size_t>> &col_assignments,
+                                 double *out);
+
+std::vector<double> dependenceProbabilityMatrix(
+    const std::vector<std::vector<size_t>> &col_assignments);
+
+// the pairs with dependence probability >= threshold
+DependencePairs dependenceProbabilityPairs(
+    const std::vector<std::vector<size_t>> &col_assignments, double threshold);
+
+} // end namespace baxcat
+
+#endif
@@ -0,0 +1,87 @@
+
+#ifndef baxcat_cxx_ensemble_guard
+#define baxcat_cxx_ensemble_guard
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "state.hpp"
+
+namespace baxcat{
+
+// Ensemble
+// ````````````````````````````````````````````````````````````````````````````
+// A set of States over one read-only table. The table is held once; each state's continuous
+// features borrow their columns from it (see State's buffer constructor). transition runs the
+// states in parallel, one state per thread. Each state draws from a stream keyed by its own PRNG,
+// so a state's chain does not depend on the number of threads or on the other states.
+class Ensemble{
+public:
+    // copy X (X[f] is column f) into one column-major table for the states to share
+    Ensemble(const std::vector<std::vector<double>> &X,
+             std::vector<std::string> datatypes,
+             std::vector<std::vector<double>> distargs);
+
+    // share a caller-owned buffer laid out as for State's buffer constructor. X must outlive the
+    // ensemble.
+    Ensemble(const double *X, size_t num_rows, size_t num_columns, size_t row_stride,
+             size_t column_stride,
+             std::vector<std::string> datatypes,
+             std::vector<std::vector<double>> distargs);
+
+    // share a memory-mapped column file. The states are built over the file (see State), so they
+    // sweep rows in file order, and the ensemble keeps the map alive.
+    Ensemble(std::shared_ptr<ColumnFile> file,
+             std::vector<std::string> datatypes,
+             std::vector<std::vector<double>> distargs);
+
+    // add a state drawn from the prior. Returns its index.
+    size_t addState(unsigned int rng_seed);
+
+    // add a state with a set partition (see State). Returns its index.
+    size_t addState(unsigned int rng_seed,
+                    std::vector<size_t> Zv,
+                    std::vector<std::vector<size_t>> Zrcv,
+                    double state_alpha,
+                    std::vector<double> view_alphas,
+                    std::vector<std::map<std::string, double>> hyper_maps);
+
+    // run State::transition on the states in which_states (every state if empty). Throws
+    // std::invalid_argument if which_states holds an index out of range or lists a state twice.
+    void transition(std::vector<size_t> which_states,
+                    std::vector<std::string> which_transitions,
+                    std::vector<size_t> which_rows, std::vector<size_t> which_cols,
+                    size_t which_kernel, int N, size_t m=1, size_t which_row_kernel=0);
+
+    // getters
+    size_t size() const;
+    size_t getNumRows() const;
+    size_t getNumColumns() const;
+    State &getState(size_t index);
+    const State &getState(size_t index) const;
+    std::vector<double> logScores();
+
+private:
+    // the table, if the ensemble owns it
+    std::vector<double> _table;
+    // the mapped file the table is in, if the ensemble was built over one
+    std::shared_ptr<ColumnFile> _column_file;
+
+    const double *_X;
+    size_t _num_rows;
+    size_t _num_columns;
+    size_t _row_stride;
+    size_t _column_stride;
+
+    std::vector<std::string> _datatypes;
+    std::vector<std::vector<double>> _distargs;
+
+    // states live on the heap so that references to them survive addState
+    std::vector<std::unique_ptr<State>> _states;
+};
+
+} // end namespace baxcat
+
+#endif
@@ -8,6 +8,7 @@
 #include <cmath>
 
 #include "container.hpp"
+#include "cluster_store.hpp"
 #include "component.hpp"
 #include "prng.hpp"
 #include "utils.hpp"
@@ -34,8 +35,16 @@ public:
 
     // logp of the element in row in cluster
     virtual double elementLogp(size_t row, size_t cluster) const = 0;
+    // adds the logp of the element in row under each cluster k to logps[k]. The element is taken
+    // out of current_cluster while it is scored there. One call scores every cluster.
+    virtual void addElementLogps(size_t row, size_t current_cluster,
+                                 std::vector<double> &logps) = 0;
     // logp of a specific value
     virtual double valueLogp(double value, size_t cluster) const = 0;
+    // logp of value in cluster as if the values in given had been inserted into cluster first.
+    // Does not change the feature.
+    virtual double valueLogpGiven(double value, size_t cluster,
+                                  const std::vector<double> &given) const = 0;
     // log p of the element in row in its own cluster
     virtual double singletonLogp(size_t row) const = 0;
     // log p of the element x in its own cluster
@@ -54,8 +63,14 @@ public:
     virtual void destroySingletonCluster(size_t row, size_t to_destroy, size_t move_to) = 0;
     // remove X[row] from cluster[current] and create a singleton
     virtual void createSingletonCluster(size_t row, size_t current) = 0;
+    // erase the (empty) clusters in the sorted list clusters and renumber the rest in order
+    virtual void eraseClusters(const std::vector<size_t> &clusters) = 0;
     // delete all clusters and reassing X according to Z
-    virtual void reassign(std::vector<size_t> assignment) = 0;
+    virtual void reassign(const std::vector<size_t> &assignment) = 0;
+    // the logp the feature would have if it were reassigned to assignment, which has
+    // num_clusters clusters. Leaves the feature untouched, so it is safe to call concurrently.
+    virtual double assignmentLogp(const std::vector<size_t> &assignment,
+                                  size_t num_clusters) const = 0;
 
     // getters
     // returns the feature index
@@ -73,6 +88,8 @@ public:
     // clusters
     virtual std::vector<std::map<std::string, double>> getModelHypers() const = 0;
     virtual std::map<std::string, double> getHypersMap() const = 0;
+    // returns the hits and misses of the cluster predictive cache
+    virtual std::map<std::string, size_t> getCacheStats() const = 0;
     // get the set (not missing) data
     virtual std::vector<double> getData() const = 0;
     virtual double getDataAt(size_t row_index) const = 0;
@@ -86,6 +103,9 @@ public:
     virtual void setHypers(std::vector<double> hypers_vec) = 0;
     // sets the hyperprior config
     virtual void setHyperConfig(std::vector<double> hyperprior_config) = 0;
+    // score addElementLogps with SIMD kernels where the datatype has them. Off by default
+    // because the results then depend on the CPU (see ClusterStore<Continuous>::setSIMD).
+    virtual void setSIMD(bool use_simd) = 0;
     // cast and append datum to last row in a singleton cluster
     virtual void appendRow(double datum) = 0;
     // pop the last dataum
@@ -96,6 +116,12 @@ public:
     // draw
     // draw from cluster
     virtual double drawFromCluster(size_t cluster_idx, baxcat::PRNG *rng) = 0;
+    // draw from cluster as if the values in given had been inserted into cluster first. Does not
+    // change the feature.
+    virtual double drawFromClusterGiven(size_t cluster_idx, const std::vector<double> &given,
+                                        baxcat::PRNG *rng) const = 0;
+    // draw from a new, empty cluster (the prior predictive)
+    virtual double drawFromSingleton(baxcat::PRNG *rng) const = 0;
 
     // replace value in data
     virtual void replaceValue(size_t which_row, size_t which_cluster, double x) = 0;
@@ -122,7 +148,7 @@ private:
         std::vector<double> _hypers;
         std::vector<double> _hyperprior_config;
         baxcat::DataContainer<T> _data;
-        std::vector<DataType> _clusters;
+        baxcat::ClusterStore<DataType> _clusters;
 
 public:
 
@@ -146,8 +172,12 @@ public:
     virtual void updateHypers() override;
 
     virtual double elementLogp(size_t row, size_t cluster) const final;
+    virtual void addElementLogps(size_t row, size_t current_cluster,
+                                 std::vector<double> &logps) final;
     virtual double singletonLogp(size_t row) const final;
     virtual double valueLogp(double value, size_t cluster) const final;
+    virtual double valueLogpGiven(double value, size_t cluster,
+                                  const std::vector<double> &given) const final;
     virtual double singletonValueLogp(double value) const final;
     virtual double clusterLogp(size_t cluster) const final;
     virtual double logp() const final;
@@ -156,7 +186,10 @@ public:
     virtual void moveToCluster(size_t row, size_t move_from, size_t move_to) final;
     virtual void destroySingletonCluster(size_t row, size_t to_destroy, size_t move_to) final;
     virtual void createSingletonCluster(size_t row, size_t current) override;
-    virtual void reassign(std::vector<size_t> assignment) override;
+    virtual void eraseClusters(const std::vector<size_t> &clusters) final;
+    virtual void reassign(const std::vector<size_t> &assignment) override;
+    virtual double assignmentLogp(const std::vector<size_t> &assignment,
+                                  size_t num_clusters) const final;
 
     virtual size_t getIndex() const final;
     virtual size_t getN() const final;
@@ -165,6 +198,7 @@ public:
     virtual std::vector<std::map<std::string, double>> getModelSuffstats() const final;
     virtual std::vector<std::map<std::string, double>> getModelHypers() const final;
     virtual std::map<std::string, double> getHypersMap() const final;
+    virtual std::map<std::string, size_t> getCacheStats() const final;
     virtual std::vector<double> getData() const final;
     virtual double getDataAt(size_t row_index) const final;
 
@@ -172,12 +206,16 @@ public:
     virtual void setHypers(std::map<std::string, double> hypers_map) final;
     virtual void setHypers(std::vector<double> hypers_vec) final;
     virtual void setHyperConfig(std::vector<double> hyperprior_config) final;
+    virtual void setSIMD(bool use_simd) final;
     virtual void appendRow(double datum) final;
     virtual void popRow(size_t cluster_assignment) final;
 
     virtual void replaceValue(size_t which_row, size_t which_cluster, double x) final;
 
     virtual double drawFromCluster(size_t cluster_idx, baxcat::PRNG *rng) final;
+    virtual double drawFromClusterGiven(size_t cluster_idx, const std::vector<double> &given,
+                                        baxcat::PRNG *rng) const final;
+    virtual double drawFromSingleton(baxcat::PRNG *rng) const final;
 
     virtual void __geweke_resampleRow(size_t which_row, size_t which_category, baxcat::PRNG *rng) final;
     virtual void __geweke_clear() final;
@@ -7,9 +7,9 @@ using std::map;
 template<class DataType, typename T>
 baxcat::Feature<DataType, T>::Feature(unsigned int idx, baxcat::DataContainer<T> data,
                                       vector<double> args, baxcat::PRNG *rng_ptr)
-    : _index(idx), _data(data), _rng(rng_ptr)
+    : _index(idx), _data(std::move(data)), _rng(rng_ptr)
 {
-    _N = data.size();
+    _N = _data.size();
     _distargs = args;
     _hyperprior_config = DataType::constructHyperpriorConfig(_data.getSetData());
     _hypers = DataType::initHypers(_hyperprior_config , _rng);
@@ -20,24 +20,21 @@ baxcat::Feature<DataType, T>::Feature(unsigned int idx, baxcat::DataContainer<T>
 template<class DataType, typename T>
 baxcat::Feature<DataType, T>::Feature(unsigned int idx, baxcat::DataContainer<T> data,
                                       vector<double> args, vector<size_t> Z, baxcat::PRNG *rngptr)
-    : _index(idx), _data(data), _rng(rngptr)
+    : _index(idx), _data(std::move(data)), _rng(rngptr)
 {
-    _N = data.size();
+    _N = _data.size();
     _distargs = args;
     _hyperprior_config = DataType::constructHyperpriorConfig(_data.getSetData());
     _hypers = DataType::initHypers(_hyperprior_config , _rng);
 
     _clusters.clear();
     size_t K = utils::vector_max(Z) + 1;
-    for(size_t k = 0; k < K; k++){
-        _clusters.emplace_back(_distargs);
-        _clusters[k].setHypers(_hypers);
-    }
+    for(size_t k = 0; k < K; k++)
+        _clusters.pushBack(_distargs, _hypers);
 
     ASSERT_EQUAL(std::cout, _clusters.size(), K);
 
-    for( size_t i = 0; i < _N; i++)
-        this->insertElement( i, Z[i] );
+    _clusters.insertElements(_data, Z);
 }
 
 
@@ -46,9 +43,9 @@ template<class DataType, typename T>
 baxcat::Feature<DataType, T>::Feature(unsigned int idx, baxcat::DataContainer<T> data,
                                       vector<double> args, baxcat::PRNG *rng_ptr,
                                       vector<double> hypers, vector<double> hyperprior_config)
-    : _index(idx), _data(data), _rng(rng_ptr), _hyperprior_config(hyperprior_config)
+    : _index(idx), _data(std::move(data)), _rng(rng_ptr), _hyperprior_config(hyperprior_config)
 {
-    _N = data.size();
+    _N = _data.size();
     if(hypers.empty()){
         _hypers = DataType::initHypers(_hyperprior_config, _rng);
     }else{
@@ -63,15 +60,14 @@ template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::insertElement(size_t row, size_t cluster)
 {
     if(_data.is_set(row))
-        _clusters[cluster].insertElement(_data.at(row));
+        _clusters.insertElement(cluster, _data.at(row));
 }
 
 
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::insertElementToSingleton(size_t row)
 {
-    _clusters.emplace_back(_distargs);
-    _clusters.back().setHypers(_hypers);
+    _clusters.pushBack(_distargs, _hypers);
     this->insertElement(row, _clusters.size()-1);
 }
 
@@ -80,21 +76,21 @@ template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::removeElement(size_t row, size_t cluster)
 {
     if(_data.is_set(row))
-        _clusters[cluster].removeElement(_data.at(row));
+        _clusters.removeElement(cluster, _data.at(row));
 }
 
 
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::insertValue(double value, size_t cluster)
 {
-    _clusters[cluster].insertElement(T(value));
+    _clusters.insertElement(cluster, T(value));
 }
 
 
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::removeValue(double value, size_t cluster)
 {
-    _clusters[cluster].insertElement(T(value));
+    _clusters.removeElement(cluster, T(value));
 }
 
 
@@ -103,9 +99,7 @@ void baxcat::Feature<DataType, T>::removeValue(double value, size_t cluster)
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::updateHypers()
 {
-    _hypers = DataType::resampleHypers(_clusters, _hyperprior_config, _rng);
-    for(auto &cluster : _clusters)
-        cluster.setHypers(_hypers);
+    _hypers = _clusters.resampleHypers(_hyperprior_config, _rng);
 }
 
 
@@ -114,35 +108,71 @@ void baxcat::Feature<DataType, T>::updateHypers()
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::elementLogp(size_t row, size_t cluster) const
 {
-    return _data.is_missing(row) ? 0.0 : _clusters[cluster].elementLogp(_data.at(row));
+    return _data.is_missing(row) ? 0.0 : _clusters.elementLogp(cluster, _data.at(row));
+}
+
+
+// Scores the row against every cluster in one pass. The current cluster is scored with the
+// element removed (the same remove/score/insert sequence View::rowLogp uses) so results equal
+// rowLogp up to rounding.
+template<class DataType, typename T>
+void baxcat::Feature<DataType, T>::addElementLogps(size_t row, size_t current_cluster,
+                                                   vector<double> &logps)
+{
+    if(_data.is_missing(row))
+        return;
+
+    ASSERT(std::cout, logps.size() >= _clusters.size());
+
+    _clusters.addElementLogps(_data.at(row), current_cluster, logps);
 }
 
 
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::singletonLogp(size_t row) const
 {
-    return _data.is_missing(row) ? 0.0 : _clusters[0].singletonLogp(_data.at(row));
+    return _data.is_missing(row) ? 0.0 : _clusters.singletonLogp(_data.at(row));
 }
 
 
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::valueLogp(double value, size_t cluster) const
 {
-    return std::isnan(value) ? 0.0 : _clusters[cluster].elementLogp(T(value));
+    return std::isnan(value) ? 0.0 : _clusters.elementLogp(cluster, T(value));
+}
+
+
+template<class DataType, typename T>
+double baxcat::Feature<DataType, T>::valueLogpGiven(double value, size_t cluster,
+                                                   const vector<double> &given) const
+{
+    if(std::isnan(value))
+        return 0.0;
+
+    if(given.empty())
+        return _clusters.elementLogp(cluster, T(value));
+
+    vector<T> given_values;
+    given_values.reserve(given.size());
+    for(auto x : given)
+        if(!std::isnan(x))
+            given_values.push_back(T(x));
+
+    return _clusters.elementLogpGiven(cluster, T(value), given_values);
 }
 
 
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::singletonValueLogp(double value) const
 {
-    return std::isnan(value) ? 0.0 : _clusters[0].singletonLogp(T(value));
+    return std::isnan(value) ? 0.0 : _clusters.singletonLogp(T(value));
 }
 
 
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::clusterLogp(size_t cluster) const
 {
-    return _clusters[cluster].logp();
+    return _clusters.logp(cluster);
 }
 
 
@@ -150,8 +180,8 @@ template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::logp() const
 {
     double logp = 0;
-    for(auto &cluster : _clusters)
-        logp += cluster.logp();
+    for(size_t k = 0; k < _clusters.size(); ++k)
+        logp += _clusters.logp(k);
 
     return logp;
 }
@@ -160,7 +190,7 @@ double baxcat::Feature<DataType, T>::logp() const
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::logScore() const
 {
-    double log_score = _clusters[0].hyperpriorLogp(_hyperprior_config) + this->logp();
+    double log_score = _clusters.hyperpriorLogp(_hyperprior_config) + this->logp();
     return log_score;
 }
 
@@ -170,7 +200,34 @@ double baxcat::Feature<DataType, T>::logScore() const
 template<class DataType, typename T>
 double baxcat::Feature<DataType, T>::drawFromCluster(size_t cluster_idx, baxcat::PRNG *rng)
 {
-    return double(_clusters[cluster_idx].draw(rng));
+    return _clusters.draw(cluster_idx, rng);
+}
+
+
+template<class DataType, typename T>
+double baxcat::Feature<DataType, T>::drawFromClusterGiven(size_t cluster_idx,
+                                                         const vector<double> &given,
+                                                         baxcat::PRNG *rng) const
+{
+    if(given.empty())
+        return _clusters.draw(cluster_idx, rng);
+
+    vector<T> given_values;
+    given_values.reserve(given.size());
+    for(auto x : given)
+        if(!std::isnan(x))
+            given_values.push_back(T(x));
+
+    return _clusters.drawGiven(cluster_idx, given_values, rng);
+}
+
+
+template<class DataType, typename T>
+double baxcat::Feature<DataType, T>::drawFromSingleton(baxcat::PRNG *rng) const
+{
+    DataType model(_distargs);
+    model.setHypers(_hypers);
+    return double(model.draw(rng));
 }
 
 
@@ -189,7 +246,7 @@ void baxcat::Feature<DataType, T>::destroySingletonCluster(size_t row, size_t to
                                                            size_t move_to)
 {
     this->insertElement(row, move_to);
-    _clusters.erase(_clusters.begin() + to_destroy);
+    _clusters.erase(to_destroy);
 }
 
 
@@ -197,30 +254,50 @@ template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::createSingletonCluster(size_t row, size_t current)
 {
     this->removeElement(row, current);
-    _clusters.emplace_back(_distargs);
-    _clusters.back().setHypers(_hypers);
+    _clusters.pushBack(_distargs, _hypers);
     this->insertElement(row, _clusters.size()-1);
 }
 
 
 template<class DataType, typename T>
-void baxcat::Feature<DataType, T>::reassign(std::vector<size_t> assignment)
+void baxcat::Feature<DataType, T>::eraseClusters(const std::vector<size_t> &clusters)
+{
+    _clusters.erase(clusters);
+}
+
+
+template<class DataType, typename T>
+void baxcat::Feature<DataType, T>::reassign(const std::vector<size_t> &assignment)
 {
     ASSERT_EQUAL(std::cout, _N, assignment.size());
 
     size_t K_new = utils::vector_max(assignment) + 1;
 
-    _clusters.resize(K_new, DataType(_distargs));
-    for(size_t k = 0; k < K_new; k++){
-        _clusters[k].setHypers(_hypers);
-        _clusters[k].clear(_distargs);
-        ASSERT_EQUAL(std::cout, _clusters[k].getSuffstatsMap()["n"], 0);
-    }
+    _clusters.reset(K_new, _distargs, _hypers);
 
     ASSERT_EQUAL(std::cout, _clusters.size(), K_new);
 
-    for(size_t i = 0; i < _N; ++i)
-        this->insertElement(i, assignment[i]);
+    _clusters.insertElements(_data, assignment);
+}
+
+
+template<class DataType, typename T>
+double baxcat::Feature<DataType, T>::assignmentLogp(const std::vector<size_t> &assignment,
+                                                    size_t num_clusters) const
+{
+    ASSERT_EQUAL(std::cout, _N, assignment.size());
+
+    // one scratch store per thread, reused across columns and views so that scoring a column
+    // under every view doesn't allocate a store per view
+    static thread_local ClusterStore<DataType> clusters;
+    clusters.reset(num_clusters, _distargs, _hypers);
+    clusters.insertElements(_data, assignment);
+
+    double logp = 0;
+    for(size_t k = 0; k < num_clusters; ++k)
+        logp += clusters.logp(k);
+
+    return logp;
 }
 
 
@@ -258,7 +335,7 @@ template<class DataType, typename T>
 map<string, double> baxcat::Feature<DataType, T>::getHypersMap() const
 {
     ASSERT(std::cout, _clusters.size() > 0);
-    return _clusters[0].getHypersMap();
+    return _clusters.getHypersMap(0);
 }
 
 
@@ -268,8 +345,8 @@ vector<map<string, double>> baxcat::Feature<DataType, T>::getModelHypers() const
     ASSERT(std::cout, _clusters.size() > 0);
 
     vector<map<string, double>> ret;
-    for(const DataType &cluster : _clusters)
-        ret.push_back(cluster.getHypersMap());
+    for(size_t k = 0; k < _clusters.size(); ++k)
+        ret.push_back(_clusters.getHypersMap(k));
 
     return ret;
 }
@@ -281,13 +358,18 @@ vector<map<string, double>> baxcat::Feature<DataType, T>::getModelSuffstats() co
     assert(_clusters.size() > 0);
 
     vector<map<string, double>> ret;
-    for(const DataType &cluster : _clusters)
-        ret.push_back(cluster.getSuffstatsMap());
+    for(size_t k = 0; k < _clusters.size(); ++k)
+        ret.push_back(_clusters.getSuffstatsMap(k));
 
     return ret;
 }
 
 
+template<class DataType, typename T>
+map<string, size_t> baxcat::Feature<DataType, T>::getCacheStats() const
+{
+    return _clusters.getCacheStats();
+}
 
 
 // TODO: implement so we can use variable return types
@@ -317,18 +399,16 @@ void baxcat::Feature<DataType, T>::clear()
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::setHypers(map<string, double> hypers_map)
 {
-    for(auto &cluster : _clusters)
-        cluster.setHypersByMap(hypers_map);
+    _clusters.setHypersByMap(hypers_map);
     // set feature hypers
-    _hypers = _clusters[0].getHypers();
+    _hypers = _clusters.getHypers();
 }
 
 
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::setHypers(vector<double> hypers_vec)
 {
-    for(auto &cluster : _clusters)
-        cluster.setHypers(hypers_vec);
+    _clusters.setHypers(hypers_vec);
     // set feature hypers
     _hypers = hypers_vec;
 }
@@ -341,6 +421,13 @@ void baxcat::Feature<DataType, T>::setHyperConfig(std::vector<double> hyperprior
 }
 
 
+template<class DataType, typename T>
+void baxcat::Feature<DataType, T>::setSIMD(bool use_simd)
+{
+    _clusters.setSIMD(use_simd);
+}
+
+
 template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::appendRow(double datum)
 {
@@ -349,8 +436,8 @@ void baxcat::Feature<DataType, T>::appendRow(double datum)
     }else{
         _data.cast_and_append(datum);
     }
-    _clusters.emplace_back(_distargs);
-    _clusters.back().setHypers(_hypers);
+    ++_N;
+    _clusters.pushBack(_distargs, _hypers);
     this->insertElement(_data.size()-1, _clusters.size()-1);
 }
 
@@ -359,13 +446,13 @@ template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::popRow(  size_t cluster_assignment )
 {
     --_N;
-    auto count = _clusters[cluster_assignment].getCount();
+    auto count = _clusters.getCount(cluster_assignment);
     if(count==1){
-        _clusters.erase(_clusters.begin()+cluster_assignment);
+        _clusters.erase(cluster_assignment);
     }else{
         if(_data.is_set(_N)){
             auto element = _data.at(_N);
-            _clusters[cluster_assignment].removeElement(element);
+            _clusters.removeElement(cluster_assignment, element);
         }
     }
     _data.pop_back();
@@ -382,11 +469,11 @@ void baxcat::Feature<DataType, T>::replaceValue(size_t which_row, size_t which_c
     // remove data at which_row if it exists
     if(_data.is_set(which_row)){
         T x = _data.at(which_row);
-        _clusters[which_cluster].removeElement(x);
+        _clusters.removeElement(which_cluster, x);
     }
 
     _data.cast_and_set(which_row, x);
-    _clusters[which_cluster].insertElement(_data.at(which_row));
+    _clusters.insertElement(which_cluster, _data.at(which_row));
 }
 
 // Testing
@@ -401,13 +488,13 @@ void baxcat::Feature<DataType, T>::__geweke_resampleRow(size_t which_row, size_t
     // remove data at which_row if it exists
     if(_data.is_set(which_row)){
         T x = _data.at(which_row);
-        _clusters[which_cluster].removeElement(x);
+        _clusters.removeElement(which_cluster, x);
     }
 
-    T y = _clusters[which_cluster].draw(rng);
+    T y = T(_clusters.draw(which_cluster, rng));
 
     _data.set(which_row, y);
-    _clusters[which_cluster].insertElement(y);
+    _clusters.insertElement(which_cluster, y);
 }
 
 
@@ -417,8 +504,7 @@ void baxcat::Feature<DataType, T>::__geweke_clear()
     for(size_t i = 0; i < _data.size(); ++i)
         _data.unset(i);
 
-    for(auto &cluster : _clusters)
-        cluster.clear(_distargs);
+    _clusters.clearSuffstats(_distargs);
 }
 
 
@@ -426,6 +512,5 @@ template<class DataType, typename T>
 void baxcat::Feature<DataType, T>::__geweke_initHypers()
 {
     _hypers = DataType::initHypers(_hyperprior_config, _rng);
-    for(auto &cluster : _clusters)
-        cluster.setHypers(_hypers);
+    _clusters.setHypers(_hypers);
 }
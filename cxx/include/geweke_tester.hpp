@@ -24,7 +24,7 @@ public:
                  std::vector<std::string> datatypes, unsigned int seed,
                  size_t m=1, bool do_hypers=true, bool do_row_alpha=true,
                  bool do_col_alpha=true, bool do_row_z=true,
-                 bool do_col_z=true, size_t ct_kernel=0);
+                 bool do_col_z=true, size_t ct_kernel=0, size_t rt_kernel=0);
 
     void run(size_t num_times, size_t num_posterior_chains, size_t lag);
 
@@ -64,6 +64,7 @@ private:
 
     size_t _m;
     size_t _ct_kernel;
+    size_t _rt_kernel;
 
     bool _do_hypers;
     bool _do_row_alpha;
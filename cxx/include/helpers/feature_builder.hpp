@@ -7,6 +7,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <cstdint>
 
 #include "container.hpp"
 #include "numerics.hpp"
@@ -26,8 +27,61 @@ namespace baxcat{
 namespace helpers{
 
 
+// construct a feature of DataType that takes ownership of data. In geweke mode the feature uses
+// the geweke default hyperprior config (and hypers if fix_hypers).
+template <class DataType, typename T>
+static std::shared_ptr<BaseFeature> genFeature(
+    size_t index, baxcat::DataContainer<T> data, const std::string &datatype,
+    const std::vector<double> &distargs, baxcat::PRNG *rng, bool geweke_mode, bool fix_hypers)
+{
+    if(geweke_mode){
+        auto hyperprior_config = baxcat::geweke_default_hyperprior_config[datatype];
+
+        std::vector<double> hypers;
+        if(fix_hypers)
+            hypers = baxcat::geweke_default_hypers[datatype];
+
+        return std::shared_ptr<BaseFeature>(
+            new Feature<DataType, T>(index, std::move(data), distargs, rng, hypers,
+                                     hyperprior_config));
+    }else{
+        return std::shared_ptr<BaseFeature>(
+            new Feature<DataType, T>(index, std::move(data), distargs, rng));
+    }
+}
+
+
+// construct a categorical feature over size values of data, stride doubles apart. The values are
+// stored in the narrowest unsigned type that holds every category index (distargs[0]
+// categories); the cluster models count in size_t regardless.
+static std::shared_ptr<BaseFeature> genCategoricalFeature(
+    size_t index, const double *data, size_t size, size_t stride, const std::string &datatype,
+    const std::vector<double> &distargs, baxcat::PRNG *rng, bool geweke_mode, bool fix_hypers)
+{
+    const double num_categories = distargs[0];
+    if(num_categories <= double(UINT8_MAX)+1){
+        return genFeature<Categorical, uint8_t>(
+            index, baxcat::DataContainer<uint8_t>(data, size, stride), datatype, distargs, rng,
+            geweke_mode, fix_hypers);
+    }else if(num_categories <= double(UINT16_MAX)+1){
+        return genFeature<Categorical, uint16_t>(
+            index, baxcat::DataContainer<uint16_t>(data, size, stride), datatype, distargs, rng,
+            geweke_mode, fix_hypers);
+    }else if(num_categories <= double(UINT32_MAX)+1){
+        return genFeature<Categorical, uint32_t>(
+            index, baxcat::DataContainer<uint32_t>(data, size, stride), datatype, distargs, rng,
+            geweke_mode, fix_hypers);
+    }else{
+        return genFeature<Categorical, size_t>(
+            index, baxcat::DataContainer<size_t>(data, size, stride), datatype, distargs, rng,
+            geweke_mode, fix_hypers);
+    }
+}
+
+
 // TODO: OPTIMIZATION: construct and store similar data type features in
 // vectors
+// data_in is consumed: continuous columns are moved into their features.
 static std::vector<std::shared_ptr<BaseFeature>> genFeatures(
     std::vector<std::vector<double>> data_in,
     std::vector<std::string> datatypes,
@@ -44,46 +98,46 @@ static std::vector<std::shared_ptr<BaseFeature>> genFeatures(
 
     for(size_t i = 0; i < datatypes.size(); ++i){
         if(converted_datatypes[i] == continuous){
-            baxcat::DataContainer<double> data(data_in[i]);
-            if(geweke_mode){
-                auto hyperprior_config = baxcat::geweke_default_hyperprior_config[datatypes[i]];
-
-                std::vector<double> hypers;
-                if(fix_hypers)
-                    hypers = baxcat::geweke_default_hypers[datatypes[i]];
-
-                std::shared_ptr<BaseFeature> ptr(
-                    new Feature<Continuous, double>(
-                        i, data, {0}, rng, hypers, hyperprior_config));
-                features_out.push_back(ptr);
-            }else{
-                std::shared_ptr<BaseFeature> ptr(
-                    new Feature<Continuous, double>(i, data, {0}, rng));
-                features_out.push_back(ptr);
-            }
-
+            baxcat::DataContainer<double> data(std::move(data_in[i]));
+            features_out.push_back(genFeature<Continuous, double>(
+                i, std::move(data), datatypes[i], {0}, rng, geweke_mode, fix_hypers));
         }else if(converted_datatypes[i] == categorical){
-            // TODO: choose container var type based on counts to reduce RAM
-            // requirements
-            baxcat::DataContainer<size_t> data(data_in[i]);
-            if(geweke_mode){
-                auto hyperprior_config = baxcat::geweke_default_hyperprior_config[datatypes[i]];
-
-                std::vector<double> hypers; 
-                if(fix_hypers)
-                    hypers = baxcat::geweke_default_hypers[datatypes[i]];
-
-                std::shared_ptr<BaseFeature> ptr(
-                    new Feature<Categorical, size_t>(
-                        i, data, distargs[i], rng, hypers, hyperprior_config));
-                features_out.push_back(ptr);
-            }else{
-                std::shared_ptr<BaseFeature> ptr(
-                    new Feature<Categorical, size_t>(i, data, distargs[i],
-                                                     rng));
-                features_out.push_back(ptr);
-            }
+            features_out.push_back(genCategoricalFeature(
+                i, data_in[i].data(), data_in[i].size(), 1, datatypes[i], distargs[i], rng,
+                geweke_mode, fix_hypers));
+        }else{
+            // FIXME: add properr exception
+            throw 1;
+        }
+        std::vector<double>().swap(data_in[i]);
+    }
+
+    return features_out;
+}
 
+
+// Build features over a caller-owned buffer of doubles. Element (r, f) is at
+// data[r*row_stride + f*column_stride]. Continuous features read the buffer in place, so it must
+// outlive them; categorical features cast their column into their own (narrow) storage.
+static std::vector<std::shared_ptr<BaseFeature>> genFeatures(
+    const double *data_in, size_t num_rows, size_t row_stride, size_t column_stride,
+    std::vector<std::string> datatypes,
+    std::vector<std::vector<double>> distargs, baxcat::PRNG *rng)
+{
+    ASSERT_EQUAL(std::cout, datatypes.size(), distargs.size());
+
+    std::vector<std::shared_ptr<BaseFeature>> features_out;
+    auto converted_datatypes = getDatatypes(datatypes);
+
+    for(size_t i = 0; i < datatypes.size(); ++i){
+        const double *column = data_in + i*column_stride;
+        if(converted_datatypes[i] == continuous){
+            baxcat::DataContainer<double> data(column, num_rows, row_stride);
+            features_out.push_back(genFeature<Continuous, double>(
+                i, std::move(data), datatypes[i], {0}, rng, false, false));
+        }else if(converted_datatypes[i] == categorical){
+            features_out.push_back(genCategoricalFeature(
+                i, column, num_rows, row_stride, datatypes[i], distargs[i], rng, false, false));
         }else{
             // FIXME: add properr exception
             throw 1;
@@ -61,19 +61,23 @@ namespace models{
             double K = static_cast<double>(counts.size());
             double A = K*alpha;
             double sum_lgamma = 0;
-            for( auto w : counts)
-                sum_lgamma += lgamma( static_cast<double>(w)+alpha );
-            return lgamma(A) - lgamma(A+n) + sum_lgamma - K*lgamma(alpha);
+            double K_occupied = 0;
+            // empty categories contribute lgamma(alpha) - lgamma(alpha) = 0
+            for( auto w : counts){
+                if(w > 0){
+                    sum_lgamma += lgamma( static_cast<double>(w)+alpha );
+                    ++K_occupied;
+                }
+            }
+            return lgamma(A) - lgamma(A+n) + sum_lgamma - K_occupied*lgamma(alpha);
         }
 
-        // todo: cache logZ
+        // log_z is logZ(n, counts, alpha)
         static double logPredictiveProbability(T x, const std::vector<T> &counts, double alpha,
                                                double log_z)
         {
             double counts_w = static_cast<double>(counts[x]);
-            double K = static_cast<double>(counts.size());
-            // return log( alpha + counts_w ) - log_z;
-            return log( alpha + counts_w ) - log(baxcat::utils::sum(counts)+alpha*K);
+            return log( alpha + counts_w ) - log_z;
         }
 
         static double logSingletonProbability(T x, size_t K, double alpha){
@@ -12,6 +12,7 @@
 #include "distributions/gamma.hpp"
 #include "distributions/gaussian.hpp"
 #include "distributions/students_t.hpp"
+#include "models/nng_simd.hpp"
 
 
 namespace baxcat{
@@ -20,8 +21,8 @@ namespace models{
 struct NormalNormalGamma{
 
     // NOTE: ZN, the marginal probability normalizing constant needs only be updated when the
-    // sufficient statistics are updated. We could cache ZN and use it to calculate predictive
-    // probability more quickly (but we're not currently taking advantage of it)
+    // sufficient statistics are updated. ClusterStore<Continuous> caches it along with the
+    // Student-t form of the predictive (see predictiveConstants).
 
     // Add/remove data
     //`````````````````````````````````````````````````````````````````````````````````````````
@@ -131,6 +132,52 @@ struct NormalNormalGamma{
         return  logPredictiveProbability(x, n, sum_x, sum_x_sq, m, r, s, nu, log_ZN);
     }
 
+    // batched over K clusters with cached log_ZN. Writes the logp of x under cluster k to
+    // logps[k]. Uses the scalar path unless a SIMD level is given. The SIMD kernels are faster
+    // but their results depend on the CPU (see nng_simd), so they are opt-in.
+    static void logPredictiveProbabilities(double x, size_t K, const double *n,
+        const double *sum_x, const double *sum_x_sq, const double *log_ZN, double m, double r,
+        double s, double nu, double *logps, nng_simd::kernel_level level=nng_simd::scalar)
+    {
+        size_t k = nng_simd::logPredictiveProbability(level, x, K, n, sum_x, sum_x_sq, log_ZN,
+                                                      m, r, s, nu, logps);
+        for(; k < K; ++k)
+            logps[k] = logPredictiveProbability(x, n[k], sum_x[k], sum_x_sq[k], m, r, s, nu,
+                                                log_ZN[k]);
+    }
+
+    // Student-t form of the posterior predictive. Everything that does not depend on x is folded
+    // into loc, prec, shape and log_const; see logPredictiveProbabilityCached.
+    static void predictiveConstants(double n, double sum_x, double sum_x_sq, double m, double r,
+        double s, double nu, double &loc, double &prec, double &shape, double &log_const)
+    {
+        posteriorParameters(n, sum_x, sum_x_sq, m, r, s, nu);
+
+        loc = m;
+        prec = r/((r+1)*s);
+        shape = (nu+1)/2;
+        log_const = lgamma(shape) - lgamma(nu/2) - .5*(LOG_PI + log(s*(r+1)/r));
+    }
+
+    // with cached predictive constants. equal to the uncached predictive up to rounding.
+    static double logPredictiveProbabilityCached(double x, double loc, double prec, double shape,
+        double log_const)
+    {
+        double d = x-loc;
+        return log_const - shape*log1p(prec*d*d);
+    }
+
+    // batched over K clusters with cached predictive constants (scalar unless level is given)
+    static void logPredictiveProbabilitiesCached(double x, size_t K, const double *loc,
+        const double *prec, const double *shape, const double *log_const, double *logps,
+        nng_simd::kernel_level level=nng_simd::scalar)
+    {
+        size_t k = nng_simd::logPredictiveProbabilityCached(level, x, K, loc, prec, shape,
+                                                            log_const, logps);
+        for(; k < K; ++k)
+            logps[k] = logPredictiveProbabilityCached(x, loc[k], prec[k], shape[k], log_const[k]);
+    }
+
     // Sampling
     //`````````````````````````````````````````````````````````````````````````````````````````
     static double predictiveSample(double n, double sum_x, double sum_x_sq, double m, double r,
@@ -0,0 +1,335 @@
+
+#ifndef baxcat_cxx_datamodels_nng_simd
+#define baxcat_cxx_datamodels_nng_simd
+
+#include <cmath>
+#include <cstddef>
+
+#include "numerics.hpp"
+
+// Define BAXCAT_NO_SIMD to compile only the scalar path.
+#if !defined(BAXCAT_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define BAXCAT_NNG_SIMD
+    #include <immintrin.h>
+#endif
+
+
+namespace baxcat{
+namespace models{
+namespace nng_simd{
+
+// AVX2 and AVX-512 kernels for the Normal-Normal-Gamma posterior predictive of one x under many
+// clusters. They are compiled with function-level target attributes and picked at runtime, so the
+// rest of the library needs no special flags. log and lgamma are evaluated with the polynomial
+// approximations below; results agree with the scalar path to about 1e-12, not bit-for-bit.
+//
+// Which kernel runs (and whether the compiler fused its multiply-adds) changes the low bits of
+// each logp, and those bits can flip a Gibbs draw. A chain sampled with SIMD on one machine is
+// therefore not reproducible on a machine with a different level, so samplers use the scalar
+// level unless asked otherwise (see State::setSIMD).
+
+enum kernel_level{
+    scalar,
+    avx2,
+    avx512
+};
+
+
+// fdlibm log polynomial coefficients
+const double LG1 = 6.666666666666735130e-01;
+const double LG2 = 3.999999999940941908e-01;
+const double LG3 = 2.857142874366239149e-01;
+const double LG4 = 2.222219843214978396e-01;
+const double LG5 = 1.818357216161805012e-01;
+const double LG6 = 1.531383769920937332e-01;
+const double LG7 = 1.479819860511658591e-01;
+const double LN2_HI = 6.93147180369123816490e-01;
+const double LN2_LO = 1.90821492927058770002e-10;
+// 2^52 + 1023. Subtracting from the exponent bits or'd into 2^52 gives the unbiased exponent.
+const double EXP_MAGIC = 4503599627370496.0 + 1023.0;
+
+
+#ifdef BAXCAT_NNG_SIMD
+
+// AVX2
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+// log for positive, finite, normal x
+__attribute__((target("avx2")))
+static inline __m256d __log_avx2(__m256d x)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d half = _mm256_set1_pd(.5);
+
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256i exp_bits = _mm256_or_si256(_mm256_srli_epi64(bits, 52),
+                                       _mm256_set1_epi64x(0x4330000000000000LL));
+    __m256d e = _mm256_castsi256_pd(exp_bits) - _mm256_set1_pd(EXP_MAGIC);
+
+    __m256i mant_bits = _mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+        _mm256_set1_epi64x(0x3ff0000000000000LL));
+    __m256d mant = _mm256_castsi256_pd(mant_bits);
+
+    // reduce the mantissa to [sqrt(2)/2, sqrt(2)]
+    __m256d big = _mm256_cmp_pd(mant, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+    mant = _mm256_blendv_pd(mant, mant*half, big);
+    e = e + _mm256_and_pd(big, one);
+
+    __m256d f = mant - one;
+    __m256d s = f/(_mm256_set1_pd(2.0) + f);
+    __m256d z = s*s;
+    __m256d w = z*z;
+    __m256d t1 = w*(_mm256_set1_pd(LG2) + w*(_mm256_set1_pd(LG4) + w*_mm256_set1_pd(LG6)));
+    __m256d t2 = z*(_mm256_set1_pd(LG1) + w*(_mm256_set1_pd(LG3) +
+                 w*(_mm256_set1_pd(LG5) + w*_mm256_set1_pd(LG7))));
+    __m256d R = t1 + t2;
+    __m256d hfsq = half*f*f;
+
+    return e*_mm256_set1_pd(LN2_HI) - ((hfsq - (s*(hfsq + R) + e*_mm256_set1_pd(LN2_LO))) - f);
+}
+
+
+// lgamma for z > 0. Shifts to z+8, where Stirling's series is accurate, and corrects with the log
+// of the product z(z+1)...(z+7).
+__attribute__((target("avx2")))
+static inline __m256d __lgamma_avx2(__m256d z)
+{
+    __m256d p = z;
+    for(int i = 1; i < 8; ++i)
+        p = p*(z + _mm256_set1_pd(double(i)));
+
+    __m256d w = z + _mm256_set1_pd(8.0);
+    __m256d iw = _mm256_set1_pd(1.0)/w;
+    __m256d iw2 = iw*iw;
+    __m256d series = iw*(_mm256_set1_pd(1./12) - iw2*(_mm256_set1_pd(1./360) -
+                     iw2*(_mm256_set1_pd(1./1260) - iw2*(_mm256_set1_pd(1./1680) -
+                     iw2*_mm256_set1_pd(1./1188)))));
+
+    return (w - _mm256_set1_pd(.5))*__log_avx2(w) - w + _mm256_set1_pd(.5*LOG_2PI) + series
+           - __log_avx2(p);
+}
+
+
+// fills logps[0, k) for the largest k <= K divisible by 4 and returns k
+__attribute__((target("avx2")))
+static size_t __logPredictiveProbabilityAVX2(double x, size_t K, const double *n,
+    const double *sum_x, const double *sum_x_sq, const double *log_ZN, double m, double r,
+    double s, double nu, double *logps)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d half = _mm256_set1_pd(.5);
+    const __m256d x_v = _mm256_set1_pd(x);
+    const __m256d x_sq_v = _mm256_set1_pd(x*x);
+    const __m256d r_v = _mm256_set1_pd(r);
+    const __m256d s_v = _mm256_set1_pd(s);
+    const __m256d nu_v = _mm256_set1_pd(nu);
+    const __m256d rm_v = _mm256_set1_pd(r*m);
+    const __m256d rmm_v = _mm256_set1_pd(r*(m*m));
+    const __m256d log_const = _mm256_set1_pd(.5*LOG_PI - .5*LOG_2PI);
+
+    size_t k = 0;
+    for(; k+4 <= K; k += 4){
+        // posterior parameters with x added
+        __m256d n_m = _mm256_loadu_pd(n+k) + one;
+        __m256d r_m = r_v + n_m;
+        __m256d nu_m = nu_v + n_m;
+        __m256d m_m = (rm_v + (_mm256_loadu_pd(sum_x+k) + x_v))/r_m;
+        __m256d s_m = s_v + (_mm256_loadu_pd(sum_x_sq+k) + x_sq_v) + rmm_v - r_m*(m_m*m_m);
+
+        // log_ZM - log_ZN - .5*log(2*pi)
+        __m256d log_zm = half*(nu_m + one)*_mm256_set1_pd(LOG_2) - half*__log_avx2(r_m)
+                         - half*nu_m*__log_avx2(s_m) + __lgamma_avx2(half*nu_m);
+
+        _mm256_storeu_pd(logps+k, log_const + log_zm - _mm256_loadu_pd(log_ZN+k));
+    }
+    return k;
+}
+
+
+// fills logps[0, k) from cached Student-t constants for the largest k <= K divisible by 4
+__attribute__((target("avx2")))
+static size_t __logPredictiveProbabilityCachedAVX2(double x, size_t K, const double *loc,
+    const double *prec, const double *shape, const double *log_const, double *logps)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d x_v = _mm256_set1_pd(x);
+
+    size_t k = 0;
+    for(; k+4 <= K; k += 4){
+        __m256d d = x_v - _mm256_loadu_pd(loc+k);
+        __m256d y = one + _mm256_loadu_pd(prec+k)*(d*d);
+        _mm256_storeu_pd(logps+k, _mm256_loadu_pd(log_const+k)
+                                  - _mm256_loadu_pd(shape+k)*__log_avx2(y));
+    }
+    return k;
+}
+
+
+// AVX-512
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+__attribute__((target("avx512f")))
+static inline __m512d __log_avx512(__m512d x)
+{
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d half = _mm512_set1_pd(.5);
+
+    __m512i bits = _mm512_castpd_si512(x);
+    __m512i exp_bits = _mm512_or_si512(_mm512_srli_epi64(bits, 52),
+                                       _mm512_set1_epi64(0x4330000000000000LL));
+    __m512d e = _mm512_castsi512_pd(exp_bits) - _mm512_set1_pd(EXP_MAGIC);
+
+    __m512i mant_bits = _mm512_or_si512(
+        _mm512_and_si512(bits, _mm512_set1_epi64(0x000fffffffffffffLL)),
+        _mm512_set1_epi64(0x3ff0000000000000LL));
+    __m512d mant = _mm512_castsi512_pd(mant_bits);
+
+    // reduce the mantissa to [sqrt(2)/2, sqrt(2)]
+    __mmask8 big = _mm512_cmp_pd_mask(mant, _mm512_set1_pd(M_SQRT2), _CMP_GT_OQ);
+    mant = _mm512_mask_mul_pd(mant, big, mant, half);
+    e = _mm512_mask_add_pd(e, big, e, one);
+
+    __m512d f = mant - one;
+    __m512d s = f/(_mm512_set1_pd(2.0) + f);
+    __m512d z = s*s;
+    __m512d w = z*z;
+    __m512d t1 = w*(_mm512_set1_pd(LG2) + w*(_mm512_set1_pd(LG4) + w*_mm512_set1_pd(LG6)));
+    __m512d t2 = z*(_mm512_set1_pd(LG1) + w*(_mm512_set1_pd(LG3) +
+                 w*(_mm512_set1_pd(LG5) + w*_mm512_set1_pd(LG7))));
+    __m512d R = t1 + t2;
+    __m512d hfsq = half*f*f;
+
+    return e*_mm512_set1_pd(LN2_HI) - ((hfsq - (s*(hfsq + R) + e*_mm512_set1_pd(LN2_LO))) - f);
+}
+
+
+__attribute__((target("avx512f")))
+static inline __m512d __lgamma_avx512(__m512d z)
+{
+    __m512d p = z;
+    for(int i = 1; i < 8; ++i)
+        p = p*(z + _mm512_set1_pd(double(i)));
+
+    __m512d w = z + _mm512_set1_pd(8.0);
+    __m512d iw = _mm512_set1_pd(1.0)/w;
+    __m512d iw2 = iw*iw;
+    __m512d series = iw*(_mm512_set1_pd(1./12) - iw2*(_mm512_set1_pd(1./360) -
+                     iw2*(_mm512_set1_pd(1./1260) - iw2*(_mm512_set1_pd(1./1680) -
+                     iw2*_mm512_set1_pd(1./1188)))));
+
+    return (w - _mm512_set1_pd(.5))*__log_avx512(w) - w + _mm512_set1_pd(.5*LOG_2PI) + series
+           - __log_avx512(p);
+}
+
+
+// fills logps[0, k) for the largest k <= K divisible by 8 and returns k
+__attribute__((target("avx512f")))
+static size_t __logPredictiveProbabilityAVX512(double x, size_t K, const double *n,
+    const double *sum_x, const double *sum_x_sq, const double *log_ZN, double m, double r,
+    double s, double nu, double *logps)
+{
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d half = _mm512_set1_pd(.5);
+    const __m512d x_v = _mm512_set1_pd(x);
+    const __m512d x_sq_v = _mm512_set1_pd(x*x);
+    const __m512d r_v = _mm512_set1_pd(r);
+    const __m512d s_v = _mm512_set1_pd(s);
+    const __m512d nu_v = _mm512_set1_pd(nu);
+    const __m512d rm_v = _mm512_set1_pd(r*m);
+    const __m512d rmm_v = _mm512_set1_pd(r*(m*m));
+    const __m512d log_const = _mm512_set1_pd(.5*LOG_PI - .5*LOG_2PI);
+
+    size_t k = 0;
+    for(; k+8 <= K; k += 8){
+        __m512d n_m = _mm512_loadu_pd(n+k) + one;
+        __m512d r_m = r_v + n_m;
+        __m512d nu_m = nu_v + n_m;
+        __m512d m_m = (rm_v + (_mm512_loadu_pd(sum_x+k) + x_v))/r_m;
+        __m512d s_m = s_v + (_mm512_loadu_pd(sum_x_sq+k) + x_sq_v) + rmm_v - r_m*(m_m*m_m);
+
+        __m512d log_zm = half*(nu_m + one)*_mm512_set1_pd(LOG_2) - half*__log_avx512(r_m)
+                         - half*nu_m*__log_avx512(s_m) + __lgamma_avx512(half*nu_m);
+
+        _mm512_storeu_pd(logps+k, log_const + log_zm - _mm512_loadu_pd(log_ZN+k));
+    }
+    return k;
+}
+
+
+__attribute__((target("avx512f")))
+static size_t __logPredictiveProbabilityCachedAVX512(double x, size_t K, const double *loc,
+    const double *prec, const double *shape, const double *log_const, double *logps)
+{
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d x_v = _mm512_set1_pd(x);
+
+    size_t k = 0;
+    for(; k+8 <= K; k += 8){
+        __m512d d = x_v - _mm512_loadu_pd(loc+k);
+        __m512d y = one + _mm512_loadu_pd(prec+k)*(d*d);
+        _mm512_storeu_pd(logps+k, _mm512_loadu_pd(log_const+k)
+                                  - _mm512_loadu_pd(shape+k)*__log_avx512(y));
+    }
+    return k;
+}
+
+#endif
+
+
+// Dispatch
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+static kernel_level __detectLevel()
+{
+#ifdef BAXCAT_NNG_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return avx512;
+    if(__builtin_cpu_supports("avx2"))
+        return avx2;
+#endif
+    return scalar;
+}
+
+
+// the best kernel this CPU supports (detected once)
+static kernel_level detectedLevel()
+{
+    static const kernel_level level = __detectLevel();
+    return level;
+}
+
+
+// Runs the level kernel over the leading clusters and returns how many it filled. The caller
+// scores the remaining clusters with the scalar function. level must not exceed detectedLevel().
+static size_t logPredictiveProbability(kernel_level level, double x, size_t K, const double *n,
+    const double *sum_x, const double *sum_x_sq, const double *log_ZN, double m, double r,
+    double s, double nu, double *logps)
+{
+#ifdef BAXCAT_NNG_SIMD
+    if(level == avx512)
+        return __logPredictiveProbabilityAVX512(x, K, n, sum_x, sum_x_sq, log_ZN, m, r, s, nu,
+                                                logps);
+    if(level == avx2)
+        return __logPredictiveProbabilityAVX2(x, K, n, sum_x, sum_x_sq, log_ZN, m, r, s, nu,
+                                              logps);
+#endif
+    return 0;
+}
+
+
+// as above, from cached Student-t predictive constants
+static size_t logPredictiveProbabilityCached(kernel_level level, double x, size_t K,
+    const double *loc, const double *prec, const double *shape, const double *log_const,
+    double *logps)
+{
+#ifdef BAXCAT_NNG_SIMD
+    if(level == avx512)
+        return __logPredictiveProbabilityCachedAVX512(x, K, loc, prec, shape, log_const, logps);
+    if(level == avx2)
+        return __logPredictiveProbabilityCachedAVX2(x, K, loc, prec, shape, log_const, logps);
+#endif
+    return 0;
+}
+
+}}} // end namespaces
+
+#endif
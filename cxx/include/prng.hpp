@@ -6,8 +6,11 @@
 #define NoMatchFound
 
 
+#include <array>
 #include <random>
 #include <cmath>
+#include <cstdint>
+#include <initializer_list>
 #include <stdexcept>
 #include <vector>
 #include <iostream>
@@ -58,37 +61,190 @@ private:
 };
 
 
+// Philox4x32-10 counter-based engine (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3", SC11). Output block i of stream s under seed k is a pure function of (k, s, i), so a stream
+// costs nothing to create and any number of them can be used side by side. Satisfies the
+// UniformRandomBitGenerator requirements, so it works with the <random> distributions.
+class Philox4x32{
+public:
+    typedef uint32_t result_type;
+
+    static constexpr result_type min(){ return 0; }
+    static constexpr result_type max(){ return 0xFFFFFFFF; }
+
+    Philox4x32(uint64_t seed=0, uint64_t stream=0)
+    {
+        this->seed(seed, stream);
+    }
+
+    // restart at the first block of stream under seed
+    void seed(uint64_t seed, uint64_t stream=0)
+    {
+        _key = {{uint32_t(seed), uint32_t(seed >> 32)}};
+        _counter = {{0, 0, uint32_t(stream), uint32_t(stream >> 32)}};
+        _index = 4;
+    }
+
+    result_type operator()()
+    {
+        if(_index == 4){
+            _block = block(_counter, _key);
+            // the low 64 bits of the counter index the block within the stream
+            if(++_counter[0] == 0) ++_counter[1];
+            _index = 0;
+        }
+        return _block[_index++];
+    }
+
+    void discard(unsigned long long z)
+    {
+        for(; z > 0; --z)
+            (*this)();
+    }
+
+    // the ten-round Philox bijection of counter under key
+    static std::array<uint32_t, 4> block(std::array<uint32_t, 4> counter,
+                                         std::array<uint32_t, 2> key)
+    {
+        for(size_t round = 0; round < 10; ++round){
+            if(round > 0){
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+            uint64_t p0 = uint64_t(0xD2511F53)*counter[0];
+            uint64_t p1 = uint64_t(0xCD9E8D57)*counter[2];
+            counter = {{uint32_t(p1 >> 32)^counter[1]^key[0], uint32_t(p1),
+                        uint32_t(p0 >> 32)^counter[3]^key[1], uint32_t(p0)}};
+        }
+        return counter;
+    }
+
+    bool operator==(const Philox4x32 &other) const
+    {
+        return _key == other._key and _counter == other._counter and _index == other._index;
+    }
+
+private:
+    std::array<uint32_t, 2> _key;
+    std::array<uint32_t, 4> _counter;
+    std::array<uint32_t, 4> _block;
+    size_t _index;
+};
+
+
+// Tables for the 128-layer ziggurat normal sampler (Marsaglia and Tsang, "The ziggurat method for
+// generating random variables", 2000). Built once, on first use.
+struct ZigguratTables{
+    // start of the tail and area of each layer
+    static constexpr double r = 3.442619855899;
+    static constexpr double v = 9.91256303526217e-3;
+
+    uint32_t kn[128];
+    double wn[128];
+    double fn[128];
+
+    static const ZigguratTables &get()
+    {
+        static const ZigguratTables tables;
+        return tables;
+    }
+
+private:
+    ZigguratTables()
+    {
+        const double m1 = 2147483648.0;
+        double dn = r;
+        double tn = dn;
+        double q = v/exp(-.5*dn*dn);
+
+        kn[0] = uint32_t((dn/q)*m1);
+        kn[1] = 0;
+        wn[0] = q/m1;
+        wn[127] = dn/m1;
+        fn[0] = 1.;
+        fn[127] = exp(-.5*dn*dn);
+
+        for(size_t i = 126; i >= 1; --i){
+            dn = sqrt(-2.*log(v/dn + exp(-.5*dn*dn)));
+            kn[i+1] = uint32_t((dn/tn)*m1);
+            tn = dn;
+            fn[i] = exp(-.5*dn*dn);
+            wn[i] = dn/m1;
+        }
+    }
+};
+
+
 class PRNG{
 
     private:
         unsigned int num_threads;
-        std::vector<std::mt19937> rngs;
+        uint64_t _seed;
+        std::vector<Philox4x32> rngs;
+
+        // the keyed streams live on the stack of the threads that opened them
+        struct Scope{
+            const PRNG *owner;
+            Philox4x32 engine;
+            Scope *previous;
+        };
 
-    public:
-        PRNG(unsigned int seed=0)
+        static Scope *&__currentScope()
         {
+            static thread_local Scope *scope = nullptr;
+            return scope;
+        }
 
-            if(seed == 0){
-                std::random_device rd;
-                seed = rd();
+        // streams 0..num_threads-1 belong to the thread slots; keyed streams have the top bit set
+        static uint64_t __streamOfKey(std::initializer_list<uint64_t> key)
+        {
+            uint64_t h = 0x243F6A8885A308D3ULL;
+            for(auto k : key){
+                // splitmix64 finalizer
+                h += k + 0x9E3779B97F4A7C15ULL;
+                h = (h ^ (h >> 30))*0xBF58476D1CE4E5B9ULL;
+                h = (h ^ (h >> 27))*0x94D049BB133111EBULL;
+                h ^= h >> 31;
             }
+            return h | (uint64_t(1) << 63);
+        }
 
-            unsigned int n_threads = omp_get_max_threads();
-            // std::cout << "prng " << this << ": " << n_threads << " threads." << std::endl;
+    public:
+        typedef Philox4x32 engine_type;
+
+        // While a ScopedStream is alive, every draw the opening thread makes from rng comes from
+        // the stream keyed by key (and the seed of rng), no matter which thread or how many
+        // threads run the task. Tasks in a parallel loop open one keyed by their index to make
+        // the loop reproducible under any thread count. Scopes nest and must be closed by the
+        // thread that opened them.
+        class ScopedStream{
+        public:
+            ScopedStream(PRNG &rng, std::initializer_list<uint64_t> key)
+            {
+                _scope.owner = &rng;
+                _scope.engine.seed(rng._seed, __streamOfKey(key));
+                _scope.previous = __currentScope();
+                __currentScope() = &_scope;
+            }
 
-            // creata a PrallelRNG object with n_threads thread starting with
-            // seed.
-            num_threads = n_threads;
+            ~ScopedStream()
+            {
+                __currentScope() = _scope.previous;
+            }
 
-            // create an RNG to seed the RNGs in the vector
-            std::mt19937 seeder(seed);
-            std::uniform_int_distribution<unsigned int> urnd;
+            ScopedStream(const ScopedStream&) = delete;
+            ScopedStream& operator=(const ScopedStream&) = delete;
 
-            // fill the vector with unique_ptrs to the RNGs
-            for(unsigned int i = 0; i < n_threads; i++){
-                unsigned int this_seed = urnd(seeder);
-                rngs.emplace_back(this_seed);
-            }
+        private:
+            Scope _scope;
+        };
+
+        PRNG(unsigned int seed=0)
+        {
+            // creata a PrallelRNG object with one stream per thread
+            num_threads = omp_get_max_threads();
+            rngs.resize(num_threads);
+            this->seed(seed);
         };
 
         static void throwError(){
@@ -102,26 +258,31 @@ class PRNG{
                 new_seed = rd();
             }
 
-            // create an RNG to seed the RNGs in the vector
-            std::mt19937 seeder(new_seed);
-            std::uniform_int_distribution<unsigned int> urnd;
+            _seed = new_seed;
 
-            // fill the vector with unique_ptrs to the RNGs
-            for(unsigned int i = 0; i < num_threads; i++){
-                unsigned int this_seed = urnd(seeder);
-                rngs[i].seed(this_seed);
-            }
+            // thread slot i draws from stream i
+            for(unsigned int i = 0; i < num_threads; i++)
+                rngs[i].seed(_seed, i);
         }
 
-        // get one of the rngs to use in some distribution
-        std::mt19937& getRNG()
+        // get the engine of the innermost keyed stream this thread has open on this PRNG. With
+        // none open, thread 0 of the current team (the master, or any thread outside OpenMP)
+        // gets the master stream, slot 0; only one such thread may use a PRNG at a time. Other
+        // threads must open a ScopedStream first: without one their draws would depend on
+        // scheduling, so this throws std::logic_error.
+        Philox4x32& getRNG()
         {
-            int idx = omp_get_thread_num();
-            return rngs[idx];
+            for(Scope *scope = __currentScope(); scope != nullptr; scope = scope->previous)
+                if(scope->owner == this)
+                    return scope->engine;
+
+            if(omp_get_thread_num() != 0)
+                throw std::logic_error("PRNG: draw on a worker thread without a ScopedStream");
+            return rngs[0];
         }
 
         // get one of the rngs to use in some distribution
-        std::mt19937& getRNGByIndex(unsigned int index)
+        Philox4x32& getRNGByIndex(unsigned int index)
         {
             if( index > num_threads-1 ){
                 std::cout << "getRNGByIndex: index out of bounds" << std::endl;
@@ -130,6 +291,15 @@ class PRNG{
             return rngs[index];
         }
 
+        // a fresh 64-bit key drawn from the calling thread's stream. Used to key the tasks of
+        // a parallel loop so that each loop gets new streams.
+        uint64_t drawKey()
+        {
+            auto &engine = getRNG();
+            uint64_t hi = engine();
+            return (hi << 32) | engine();
+        }
+
         // return uniform random integer in [a,b)
         int randint(int a, int b)
         {
@@ -198,22 +368,66 @@ class PRNG{
             throw InvalidMultinomialProbabilities(P);
         }
 
-        // multinomial draw from a vector of log probabilities
-        size_t lpflip(std::vector<double> P)
+        // multinomial draw from a vector of log probabilities. The exponentials are taken once,
+        // into a per-thread scratch buffer, and the draw is a scan of their running sum.
+        size_t lpflip(const std::vector<double> &P)
         {
-            // normalize
-            double Z = baxcat::numerics::logsumexp(P);
-            double r = rand();
-            double cumsum = 0;
+            if(P.empty())
+                throw InvalidMultinomialProbabilities(P);
+
+            double max_p = P[0];
+            for(auto p : P)
+                max_p = (p > max_p) ? p : max_p;
+
+            static thread_local std::vector<double> scratch;
+            scratch.resize(P.size());
+
+            double sum = 0;
             for(size_t i = 0; i < P.size(); i++){
-                cumsum += exp(P[i]-Z);
-                if( r < cumsum)
+                sum += exp(P[i]-max_p);
+                scratch[i] = sum;
+            }
+
+            // catches all -inf, +inf, and NaN entries
+            if(not (sum > 0 and sum < INFINITY))
+                throw InvalidMultinomialProbabilities(P);
+
+            double r = rand()*sum;
+            for(size_t i = 0; i < P.size(); i++){
+                if(r < scratch[i])
                     return i;
             }
 
+            // r rounded up to sum; take the last entry with nonzero mass
+            for(size_t i = P.size(); i > 0; --i)
+                if(P[i-1] > -INFINITY)
+                    return i-1;
+
             throw InvalidMultinomialProbabilities(P);
         }
 
+        // multinomial draw from a vector of log probabilities by the Gumbel-max trick:
+        // argmax_i P[i] + G_i with G_i standard Gumbel. One pass, no normalization.
+        size_t lpflipGumbel(const std::vector<double> &P)
+        {
+            size_t argmax = P.size();
+            double max_value = -INFINITY;
+            for(size_t i = 0; i < P.size(); i++){
+                if(P[i] == -INFINITY)
+                    continue;
+                double value = P[i] - log(-log(__openUniform()));
+                if(value > max_value or argmax == P.size()){
+                    max_value = value;
+                    argmax = i;
+                }
+            }
+
+            if(argmax == P.size() or std::isnan(max_value))
+                throw InvalidMultinomialProbabilities(P);
+
+            return argmax;
+        }
+
         // constructs a parition, Z, with K categories, and counts, Nk, from CRP(alpha)
         void crpGen(double alpha, size_t N, std::vector<size_t> &Z, size_t &K,
                     std::vector<size_t> &Nk)
@@ -265,24 +479,40 @@ class PRNG{
 
         // random distributions
         //`````````````````````````````````````````````````````````````````````````````````````````
-        // gamma
+        // gamma (Marsaglia and Tsang, 2000)
         double gamrand(double shape, double scale)
         {
             ASSERT(std::cout, shape > 0);
             ASSERT(std::cout, scale > 0);
 
-            std::gamma_distribution<double> dist(shape, scale);
-            return dist(getRNG());
+            // for shape < 1, use G(shape) = G(shape+1)*U^(1/shape)
+            double boost = 1;
+            if(shape < 1){
+                boost = pow(__openUniform(), 1./shape);
+                shape += 1;
+            }
+
+            const double d = shape - 1./3.;
+            const double c = 1./sqrt(9.*d);
+            while(true){
+                double x, v;
+                do{
+                    x = __zigguratNormal();
+                    v = 1. + c*x;
+                }while(v <= 0);
+                v = v*v*v;
+
+                double u = __openUniform();
+                double x_sq = x*x;
+                if(u < 1. - .0331*x_sq*x_sq or log(u) < .5*x_sq + d*(1. - v + log(v)))
+                    return d*v*boost*scale;
+            }
         }
 
         // inverse-gamma
         double invgamrand(double shape, double scale)
         {
-            ASSERT(std::cout, shape > 0);
-            ASSERT(std::cout, scale > 0);
-
-            std::gamma_distribution<double> dist(shape, scale);
-            return 1./dist(getRNG());
+            return 1./gamrand(shape, scale);
         }
 
         // beta
@@ -303,17 +533,16 @@ class PRNG{
         {
             ASSERT(std::cout, sigma > 0);
 
-            std::normal_distribution<double> dist(mu, sigma);
-            return dist(getRNG());
+            return mu + sigma*__zigguratNormal();
         }
 
-        // student's t
+        // student's t: Z/sqrt(V/nu) with V ~ chi-squared(nu) = gamma(nu/2, 2)
         double trand(double nu)
         {
             ASSERT(std::cout, nu > 0);
 
-            std::student_t_distribution<double> dist(nu);
-            return dist(getRNG());
+            double z = __zigguratNormal();
+            return z/sqrt(gamrand(nu/2., 2.)/nu);
         }
 
         // lognormal
@@ -411,6 +640,113 @@ class PRNG{
             }
         }
 
+    private:
+        // uniform on the open interval (0,1) with 53 bits of resolution, so logs are finite
+        double __openUniform()
+        {
+            auto &engine = getRNG();
+            uint64_t a = engine() >> 5;
+            uint64_t b = engine() >> 6;
+            return (double((a << 26) | b) + .5)/9007199254740992.0;
+        }
+
+        // standard normal by the 128-layer ziggurat (Marsaglia and Tsang, 2000)
+        double __zigguratNormal()
+        {
+            const ZigguratTables &zig = ZigguratTables::get();
+            auto &engine = getRNG();
+
+            int32_t hz = int32_t(engine());
+            uint32_t iz = hz & 127;
+            while(true){
+                // inside the layer's rectangle; the common case
+                uint32_t abs_hz = (hz < 0) ? uint32_t(-int64_t(hz)) : uint32_t(hz);
+                if(abs_hz < zig.kn[iz])
+                    return hz*zig.wn[iz];
+
+                double x = hz*zig.wn[iz];
+                if(iz == 0){
+                    // the tail beyond r
+                    double y;
+                    do{
+                        x = -log(__openUniform())/ZigguratTables::r;
+                        y = -log(__openUniform());
+                    }while(y+y < x*x);
+                    return (hz > 0) ? ZigguratTables::r + x : -ZigguratTables::r - x;
+                }
+
+                // the wedge between the rectangle and the curve
+                double f_x = zig.fn[iz] + __openUniform()*(zig.fn[iz-1]-zig.fn[iz]);
+                if(f_x < exp(-.5*x*x))
+                    return x;
+
+                hz = int32_t(engine());
+                iz = hz & 127;
+            }
+        }
+};
+
+
+// Walker's alias table for repeated draws from a fixed discrete distribution: O(n) to build,
+// O(1) per draw.
+class AliasTable{
+public:
+    // p is a vector of (unnormalized) probabilities
+    AliasTable(const std::vector<double> &p) : _prob(p.size()), _alias(p.size(), 0)
+    {
+        const size_t n = p.size();
+        double sum = 0;
+        for(auto x : p)
+            sum += x;
+
+        if(n == 0 or not (sum > 0 and sum < INFINITY))
+            throw InvalidMultinomialProbabilities(p);
+
+        std::vector<double> scaled(n);
+        std::vector<size_t> small, large;
+        for(size_t i = 0; i < n; ++i){
+            scaled[i] = p[i]*n/sum;
+            if(scaled[i] < 1){
+                small.push_back(i);
+            }else{
+                large.push_back(i);
+            }
+        }
+
+        while(not small.empty() and not large.empty()){
+            size_t s = small.back();
+            size_t l = large.back();
+            small.pop_back();
+            _prob[s] = scaled[s];
+            _alias[s] = l;
+            scaled[l] -= 1. - scaled[s];
+            if(scaled[l] < 1){
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        // whatever is left is 1 up to rounding
+        for(auto i : large)
+            _prob[i] = 1;
+        for(auto i : small)
+            _prob[i] = 1;
+    }
+
+    size_t draw(PRNG *rng) const
+    {
+        size_t i = rng->randuint(_prob.size());
+        return (rng->rand() < _prob[i]) ? i : _alias[i];
+    }
+
+    size_t size() const
+    {
+        return _prob.size();
+    }
+
+private:
+    std::vector<double> _prob;
+    std::vector<size_t> _alias;
 };
 
 } // end namespace baxcat
@@ -0,0 +1,106 @@
+
+#ifndef baxcat_cxx_row_similarity_guard
+#define baxcat_cxx_row_similarity_guard
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace baxcat{
+
+// the rows most similar to a query row, most similar first; ties go to the lower row index
+struct SimilarRows
+{
+    std::vector<size_t> rows;
+    std::vector<double> similarity;
+};
+
+
+// Row similarity
+// ````````````````````````````````````````````````````````````````````````````
+// In one model, the similarity of rows a and b is the fraction of views (or of the views that
+// hold the columns in wrt) in which a and b share a cluster. Their similarity is the mean over
+// the models that hold both rows.
+//
+// RowSimilarity keeps, for every (model, view, cluster), the list of rows in the cluster. The
+// rows similar to a query are exactly the rows in the query's clusters, so topK touches only
+// those lists and never the rest of the table.
+class RowSimilarity
+{
+public:
+    // col_assignments[m] and row_assignments[m] are the column and row assignments of model m
+    // (as in State). If the models hold subsets of the rows, model_rows[m][i] is the row of the
+    // full table that is row i of model m; leave model_rows empty if every model holds every row.
+    // throws std::invalid_argument if the assignments don't fit together
+    RowSimilarity(size_t num_rows,
+                  const std::vector<std::vector<size_t>> &col_assignments,
+                  const std::vector<std::vector<std::vector<size_t>>> &row_assignments,
+                  const std::vector<std::vector<size_t>> &model_rows={});
+
+    // similarity of rows a and b with respect to the columns in wrt (all columns if empty). NaN
+    // if no model holds both rows.
+    double similarity(size_t row_a, size_t row_b, const std::vector<size_t> &wrt={}) const;
+
+    // the (at most) k rows other than row with the highest non-zero similarity to it
+    SimilarRows topK(size_t row, size_t k, const std::vector<size_t> &wrt={}) const;
+
+    // topK of each row in rows, over OpenMP threads
+    std::vector<SimilarRows> topKBatch(const std::vector<size_t> &rows, size_t k,
+                                       const std::vector<size_t> &wrt={}) const;
+
+    size_t numRows() const {return _num_rows;};
+    size_t numModels() const {return _models.size();};
+
+private:
+    static const size_t NOT_IN_MODEL = static_cast<size_t>(-1);
+
+    struct Model
+    {
+        std::vector<size_t> col_assignment;
+        // row_assignment[v][i] is the cluster of the model's row i in view v
+        std::vector<std::vector<size_t>> row_assignment;
+        // the model's index of each row of the table, or NOT_IN_MODEL. Empty if the model holds
+        // every row.
+        std::vector<size_t> local_index;
+        // the rows (of the table) in cluster k of view v are
+        // members[v][offsets[v][k]], ..., members[v][offsets[v][k+1]-1], in increasing order
+        std::vector<std::vector<size_t>> offsets;
+        std::vector<std::vector<size_t>> members;
+    };
+
+    size_t __localIndex(const Model &model, size_t row) const;
+
+    // the sorted views of model that hold the columns in wrt (every view if wrt is empty)
+    std::vector<size_t> __relevantViews(const Model &model, const std::vector<size_t> &wrt) const;
+
+    // a score accumulator (_num_rows long, all zero) and an empty list of the rows it touched
+    struct Scratch
+    {
+        std::vector<double> score;
+        std::vector<size_t> touched;
+    };
+
+    // throws std::invalid_argument if wrt holds a column past the number of columns
+    void __checkWrt(const std::vector<size_t> &wrt) const;
+
+    // take a scratch from the pool (or make one) and give it back clean. The pool is shared by
+    // every thread that queries the index, so a query does not allocate a _num_rows score.
+    std::unique_ptr<Scratch> __acquireScratch() const;
+    void __releaseScratch(std::unique_ptr<Scratch> scratch) const;
+
+    // topK using score and touched (see Scratch) as scratch. Both are left as they were found.
+    SimilarRows __topK(size_t row, size_t k, const std::vector<size_t> &wrt,
+                       std::vector<double> &score, std::vector<size_t> &touched) const;
+
+    size_t _num_rows;
+    size_t _num_columns;
+    std::vector<Model> _models;
+
+    mutable std::mutex _scratch_mutex;
+    mutable std::vector<std::unique_ptr<Scratch>> _scratch_pool;
+};
+
+} // end namespace baxcat
+
+#endif
@@ -3,7 +3,9 @@
 #define baxcat_cxx_state_guard
 
 #include <map>
+#include <cmath>
 #include <string>
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <typeinfo>
@@ -12,6 +14,7 @@
 
 #include "prng.hpp"
 #include "view.hpp"
+#include "column_file.hpp"
 #include "feature.hpp"
 #include "helpers/feature_builder.hpp"
 #include "helpers/state_helper.hpp"
@@ -62,10 +65,56 @@ public:
           std::vector<double> view_alphas,
           std::vector<std::map<std::string, double>> hyper_maps);
 
+    // init from a caller-owned buffer without copying it. Element (r, f) of the table is at
+    // X[r*row_stride + f*column_stride], so a C-ordered rows-by-columns array has
+    // row_stride = num_columns and column_stride = 1. Continuous columns read X in place, so X
+    // must outlive the State; categorical columns are cast into owned storage.
+    State(const double *X, size_t num_rows, size_t num_columns, size_t row_stride,
+          size_t column_stride,
+          std::vector<std::string> datatypes,
+          std::vector<std::vector<double>> distargs,
+          unsigned int rng_seed);
+
+    // init from a caller-owned buffer with a set partition (see above)
+    State(const double *X, size_t num_rows, size_t num_columns, size_t row_stride,
+          size_t column_stride,
+          std::vector<std::string> datatypes,
+          std::vector<std::vector<double>> distargs,
+          unsigned int rng_seed,
+          std::vector<size_t> Zv,
+          std::vector<std::vector<size_t>> Zrcv,
+          double state_alpha,
+          std::vector<double> view_alphas,
+          std::vector<std::map<std::string, double>> hyper_maps);
+
+    // init from a memory-mapped column file. The State keeps file alive and its continuous
+    // features read their columns from the map. Row sweeps visit rows in file order (systematic
+    // scan) rather than a random order so that each column streams through the page cache.
+    State(std::shared_ptr<ColumnFile> file,
+          std::vector<std::string> datatypes,
+          std::vector<std::vector<double>> distargs,
+          unsigned int rng_seed);
+
+    // init from a memory-mapped column file with a set partition (see above)
+    State(std::shared_ptr<ColumnFile> file,
+          std::vector<std::string> datatypes,
+          std::vector<std::vector<double>> distargs,
+          unsigned int rng_seed,
+          std::vector<size_t> Zv,
+          std::vector<std::vector<size_t>> Zrcv,
+          double state_alpha,
+          std::vector<double> view_alphas,
+          std::vector<std::map<std::string, double>> hyper_maps);
+
     // do transitions.
+    // which_kernel is the column kernel (0: Gibbs, 1: Gibbs with bootstrapped singletons,
+    // 2: enumeration). which_row_kernel is the row kernel (see View::transitionRows). Row kernel 0
+    // sweeps the views in parallel, one thread per view. Row kernel 1 sweeps the views one after
+    // another, each with every thread, which is faster when one view holds most of the columns.
+    // Row kernel 2 adds split-merge proposals to kernel 0.
     void transition(std::vector<std::string> which_transitions,
         std::vector<size_t> which_rows, std::vector<size_t> which_cols,
-        size_t which_kernel, int N, size_t m=1);
+        size_t which_kernel, int N, size_t m=1, size_t which_row_kernel=0);
 
     // getters
     std::vector<std::vector<double>> getDataTable() const;
@@ -78,6 +127,14 @@ public:
     size_t getNumViews() const;
     std::vector<std::vector<std::map<std::string, double>>> getSuffstats() const;
     std::vector<std::vector<size_t>> getViewCounts() const;
+    // hits and misses of the cluster predictive caches summed over features
+    std::map<std::string, size_t> getCacheStats() const;
+    // split/merge proposals and acceptances made by row kernel 2 since construction
+    std::map<std::string, size_t> getSplitMergeStats() const;
+    // singleton proposals of column kernel 1 built and reused since construction
+    std::map<std::string, size_t> getBootstrapStats() const;
+    // the random number generator the state draws from
+    baxcat::PRNG *getPRNG() const {return _rng.get();};
     double logScore();
 
     std::vector<double> getViewLogps();
@@ -91,16 +148,35 @@ public:
     void setHypers(size_t column_index,
                    std::map<std::string, double> hypers_map);
     void setHypers(size_t column_index, std::vector<double> hypers_vec);
+    // score rows with the widest SIMD kernels the CPU supports. Off by default: the SIMD
+    // logps differ from the scalar ones in the last bits, and by CPU, which is enough to change
+    // Gibbs draws. With it off, a seed gives the same chain on every machine; with it on, row
+    // transitions over continuous columns are faster but only reproducible on the same hardware.
+    void setSIMD(bool use_simd);
 
     // predictive_logp
     // returns the logp of the values in query_values being in corresponding
     // indices in query_indices given that the values in constraint_values are
-    // in constraint_indices
+    // in constraint_indices. Constraints are applied to a private copy of the
+    // clusters they touch, so the state is not changed and queries run in
+    // parallel. Row indices past the last row are new rows: constraints in
+    // a new row weight its clusters as in predictiveDraw. Throws
+    // std::invalid_argument if an index is not a (row, column) pair with a
+    // column in range or the values don't match the indices.
     std::vector<double> predictiveLogp(
-        std::vector<std::vector<size_t>> query_indices,
-        std::vector<double> query_values,
-        std::vector<std::vector<size_t>> constraint_indices,
-        std::vector<double> constraint_values);
+        const std::vector<std::vector<size_t>> &query_indices,
+        const std::vector<double> &query_values,
+        const std::vector<std::vector<size_t>> &constraint_indices,
+        const std::vector<double> &constraint_values) const;
+
+    // as predictiveLogp but query q has its own constraints,
+    // constraint_indices[q] and constraint_values[q]. Pass empty constraint
+    // vectors for no constraints.
+    std::vector<double> predictiveLogpBatch(
+        const std::vector<std::vector<size_t>> &query_indices,
+        const std::vector<double> &query_values,
+        const std::vector<std::vector<std::vector<size_t>>> &constraint_indices,
+        const std::vector<std::vector<double>> &constraint_values) const;
 
     // append data to last row. assign_to_p_max_row specifies whether the row 
     // is assigned to the category with the max probability or is assigned
@@ -114,12 +190,17 @@ public:
 
     // predictive_draw
     // does N draws from query indices given constraint_values returns an N by
-    // query_indices.size() vector of vectors
+    // query_indices.size() vector of vectors. Row indices past the last row
+    // are new rows: the queries in each new row are drawn jointly (one
+    // cluster per view per draw) given the constraints in that row. Views
+    // are drawn in parallel. As in predictiveLogp, constraints on observed
+    // rows are overlaid on private copies of their clusters, so the state is
+    // not changed, and bad indices throw std::invalid_argument.
     std::vector<std::vector<double>> predictiveDraw(
-        std::vector<std::vector<size_t>> query_indices,
-        std::vector<std::vector<size_t>> constraint_indices,
-        std::vector<double> constraint_values,
-        size_t N);
+        const std::vector<std::vector<size_t>> &query_indices,
+        const std::vector<std::vector<size_t>> &constraint_indices,
+        const std::vector<double> &constraint_values,
+        size_t N) const;
 
     // for geweke
     // clear suffstats and data
@@ -134,17 +215,30 @@ public:
     // for debugging
     int checkPartitions();
 
+    // for testing
+    // with precompute false, column moves score every view as they go rather than reading the
+    // logps precomputed at the start of the transition. The chain must be the same either way.
+    void __setPrecomputeColumnLogps(bool precompute){_precompute_column_logps = precompute;};
+
     // TODO: implement these features
     // void setColumnHypers(std::map<string, double> hypers, size_t which_col);
     // void appendFeature(std::vector<double> data_column, std::string datatype);
 
 private:
+    // build the views over _features, drawing the partition from the prior
+    void __initFromPrior();
+    // build the views over _features from a given partition
+    void __initFromPartition(std::vector<size_t> Zv,
+                             const std::vector<std::vector<size_t>> &Zrcv,
+                             double state_alpha, const std::vector<double> &view_alphas,
+                             const std::vector<std::map<std::string, double>> &hypers_maps);
+
 
     // METHODS
     void __doTransition(baxcat::transition_type t,
                         std::vector<size_t> which_rows,
                         std::vector<size_t> which_cols, size_t which_kernel, 
-                        size_t m=1);
+                        size_t m=1, size_t which_row_kernel=0);
 
     // Transition methods
     // transition state alpha --- alpha over columns
@@ -161,7 +255,7 @@ private:
     // transition the assignment of rows in views to categories
     // if which_rows is empty, all rows, in shuffled order are transistioned
     // shuffling is handled by the view
-    void __transitionRowAssignments(std::vector<size_t> which_rows);
+    void __transitionRowAssignments(std::vector<size_t> which_rows, size_t which_row_kernel=0);
 
     // Column transition kernels
     // Gibbs method. Calculates probability under each view
@@ -169,12 +263,62 @@ private:
     void __transitionColumnAssignmentGibbsBootstrap(size_t which_column,
                                                     size_t m=1);
     void __transitionColumnAssignmentEnumeration(size_t which_column);
+    // build the singleton view proposals of the bootstrap kernel for the columns in which_cols
+    // that do not have a current one, in parallel
+    void __precomputeBootstrapProposals(const std::vector<size_t> &which_cols, size_t m);
+    void __buildBootstrapProposal(size_t col, size_t m);
+    // true if col has a proposal built with its current data and hypers
+    bool __hasBootstrapProposal(size_t col) const;
+    // drop every proposal. Must be called whenever data change.
+    void __clearBootstrapProposals();
+    // fill _column_view_logps for the columns in which_cols
+    void __precomputeColumnLogps(const std::vector<size_t> &which_cols);
+    // logps[v] is the logp of column col under the row partition of view v plus log_crps[v]
+    std::vector<double> __columnLogpsUnderViews(size_t col,
+                                                const std::vector<double> &log_crps) const;
 
     // probability and sample helpers
-    double __doPredictiveLogpObserved(size_t row, size_t column, double value);
-    double __doPredictiveLogpUnobserved(size_t column, double value);
-    double __doPredictiveDrawObserved(size_t row, size_t col);
-    double __doPredictiveDrawUnobserved(size_t col); // FIXME: implement!
+    // (cluster, value) pairs of the constraints in one column
+    typedef std::vector<std::pair<size_t, double>> ColumnConstraints;
+    // the constraints on observed rows, by column
+    typedef std::map<size_t, ColumnConstraints> ObservedConstraints;
+    // (column, value) pairs of the constraints in one new row
+    typedef std::vector<std::pair<size_t, double>> RowConstraints;
+    // throws std::invalid_argument unless every index is a (row, column) pair with a column in
+    // range and there is one constraint value per constraint index. Rows past the last are new
+    // rows.
+    void __checkPredictiveArgs(const std::vector<std::vector<size_t>> &query_indices,
+                               const std::vector<std::vector<size_t>> &constraint_indices,
+                               const std::vector<double> &constraint_values) const;
+    // sort the constraints into those on observed rows and those on each new row
+    void __splitConstraints(const std::vector<std::vector<size_t>> &constraint_indices,
+                            const std::vector<double> &constraint_values,
+                            ObservedConstraints &observed,
+                            std::map<size_t, RowConstraints> &new_row_constraints) const;
+    // fill given with the values in observed that fall in cluster of column col. Returns given.
+    const std::vector<double> &__gatherConstraints(const ObservedConstraints &observed,
+                                                   size_t col, size_t cluster,
+                                                   std::vector<double> &given) const;
+    // unnormalized log weights of the clusters of view (the last is a new cluster) for a new
+    // row: the CRP weight times the likelihood of the values in given that fall in view, with
+    // observed overlaid on the clusters
+    std::vector<double> __newRowLogWeights(size_t view, const RowConstraints &given,
+                                           const ObservedConstraints &observed) const;
+    // logp of value at (row, column) with observed overlaid on the clusters. Rows past the last
+    // are unobserved: value is scored under the CRP mixture of the column's view with the
+    // clusters weighted by the likelihood of given, the constraints in that new row.
+    double __predictiveLogp(size_t row, size_t column, double value,
+                            const ObservedConstraints &observed,
+                            const RowConstraints &given) const;
+    // for each of the N rows of samples, draw a cluster of view for a new row (weighted by the
+    // CRP and the likelihood of the (column, value) pairs in given) then draw samples[n][q] for
+    // each query q in queries from it, with observed overlaid on the clusters
+    void __doPredictiveDrawUnobserved(size_t view,
+                                      const std::vector<std::vector<size_t>> &query_indices,
+                                      const std::vector<size_t> &queries,
+                                      const RowConstraints &given,
+                                      const ObservedConstraints &observed,
+                                      std::vector<std::vector<double>> &samples) const;
 
     // Cleanup methods
     void __destroySingletonView(size_t feature_index, size_t to_destroy,
@@ -185,11 +329,8 @@ private:
                                View &proposal_view);
     void __moveFeatureToView(size_t feature_index, size_t move_from,
                              size_t move_to );
-
-    void __insertConstraints(std::vector<std::vector<size_t>> indices,
-                             std::vector<double> values);
-    void __removeConstraints(std::vector<std::vector<size_t>> indices, 
-                             std::vector<double> values);
+    // erase the free view slots and renumber the column assignment to 0..V-1
+    void __compactViews();
 
     // MEMEBERS
     // data table size
@@ -209,16 +350,24 @@ private:
     std::vector<double> _crp_alpha_config;
 
     // partition information
-    // number of views
+    // number of views. During a column transition this counts view slots,
+    // which includes the empty slots in _free_views.
     size_t _num_views;
     // Nv[v] is the number of features assigned to View v
     std::vector<size_t> _view_counts;
+    // slots of views destroyed during the current column transition. They
+    // have count zero, are reused by new singleton views, and are erased by
+    // __compactViews when the transition ends.
+    std::vector<size_t> _free_views;
     // Zv[f] is the feature to which Feature f is assigned
     std::vector<size_t> _column_assignment;
 
     // Parallel random number generator
     std::shared_ptr<baxcat::PRNG> _rng;
 
+    // the mapped file the features read from, if the State was built over one
+    std::shared_ptr<ColumnFile> _column_file;
+
     // holds the views
     std::vector<View> _views;
 
@@ -228,6 +377,35 @@ private:
 
     std::vector<datatype> _feature_types;
 
+    // _column_view_logps[f][v] is the logp of column f under the row partition of view v at the
+    // start of the current column transition, or empty if f is not being transitioned.
+    // _is_view_precomputed[v] is false once slot v holds a view created during the transition.
+    std::vector<std::vector<double>> _column_view_logps;
+    std::vector<bool> _is_view_precomputed;
+    bool _precompute_column_logps = true;
+
+    // a singleton view proposal of the bootstrap column kernel. The proposal view and its copy
+    // of the feature are dropped once built; the move only needs the view's row partition and
+    // CRP alpha and the column's logp under them. hypers are the column's hypers at build time.
+    // The cache lives as long as the state, so the partition is held in 32 bits per row: the
+    // cache costs 4*rows*columns bytes, half of a float64 table.
+    struct BootstrapProposal
+    {
+        bool is_built = false;
+        std::vector<uint32_t> row_assignment;
+        double crp_alpha = 0;
+        double logp = 0;
+        std::vector<double> hypers;
+    };
+
+    // _bootstrap_proposals[f] is column f's proposal, built with m=_bootstrap_m sweeps
+    std::vector<BootstrapProposal> _bootstrap_proposals;
+    size_t _bootstrap_m = 0;
+    // proposals built and reused since construction
+    std::map<std::string, size_t> _bootstrap_stats = {{"built", 0}, {"reused", 0}};
+
+    // split-merge statistics collected from the views after each row transition
+    std::map<std::string, size_t> _split_merge_stats;
 };
 
 
@@ -2,6 +2,9 @@
 #ifndef baxcat_cxx_view_guard
 #define baxcat_cxx_view_guard
 
+#include <map>
+#include <string>
+#include <algorithm>
 #include <vector>
 #include <cmath>
 #include <memory>
@@ -30,8 +33,17 @@ public:
          std::vector<size_t> row_assignment=std::vector<size_t>(), bool gibbs_init=false);
 
     // Transitions
-    // reassign all rows to categories
-    void transitionRows();
+    // reassign all rows to categories in random order using row kernel which_kernel:
+    //  0: sequential Gibbs
+    //  1: sequential Gibbs with the scoring of each row split across threads by feature. Visits
+    //     rows in the same order and targets the same posterior as kernel 0, and gives the same
+    //     chain for any number of threads. Must be called outside of a parallel region; falls
+    //     back to kernel 0 inside one.
+    //  2: one Jain-Neal split-merge proposal per cluster followed by a kernel 0 sweep
+    // throws std::invalid_argument for any other kernel
+    void transitionRows(size_t which_kernel=0);
+    // reassign the rows in rows, in order, using row kernel which_kernel
+    void transitionRows(const std::vector<size_t> &rows, size_t which_kernel);
     // reassign row
     void transitionRow(size_t row, bool assign_to_max_p_cluster=false);
     // resample CRP parameter
@@ -63,9 +75,12 @@ public:
     size_t getNumRows() const;
     size_t getNumCategories() const;
     double getCRPAlpha() const;
-    std::vector<size_t> getRowAssignments() const;
-    std::vector<size_t> getClusterCounts() const;
+    const std::vector<size_t> &getRowAssignments() const;
+    const std::vector<size_t> &getClusterCounts() const;
     std::vector<size_t> getFeatureIndices();
+    // split/merge proposals and acceptances made by row kernel 2
+    std::map<std::string, size_t> getSplitMergeStats() const;
+    void clearSplitMergeStats();
 
     // Debuggind function. Checks that the partitions and the features are not
     // damaged during row transitions
@@ -73,23 +88,51 @@ public:
 private:
     // Cleanup
     // destory the singleton cluster, to_destroy, and reassign row to cluster
-    // move_to
+    // move_to. The cluster is left empty and its slot goes on the free list.
     void __destroySingletonCluster( size_t row, size_t to_destroy, size_t move_to);
-    // move row from cluster current to a new singleton cluster
+    // move row from cluster current to a new singleton cluster, reusing a free
+    // slot if there is one
     void __createSingletonCluster( size_t row, size_t current);
+    // erase the free cluster slots and renumber the partition to 0..K-1
+    void __compactClusters();
+    // transitionRow without the compaction
+    void __transitionRow(size_t row, bool assign_to_max_p_cluster=false);
     // move row from cluster move_from to cluster move_to
     void __moveRowToCluster( size_t row, size_t move_from, size_t move_to);
     // init view using gibbs transition
     void __gibbsInit();
+    // add the CRP terms to the feature logps of row (see transitionRow), draw its new cluster
+    // and move it there
+    void __sampleRowAssignment(size_t row, std::vector<double> &logps,
+                               bool assign_to_max_p_cluster);
+    // row kernel 1
+    void __transitionRowsFeatureParallel(const std::vector<size_t> &rows);
+    // row kernel 1 scores each row over this many blocks of features (fewer if there are fewer
+    // features), whatever the number of threads
+    static const size_t FEATURE_BLOCKS = 64;
+    // row kernel 2
+    void __transitionRowsSplitMerge(const std::vector<size_t> &rows);
+    // Jain-Neal (2004) conjugate split-merge proposal between two random rows of rows. The launch
+    // state is built with num_launch_scans restricted Gibbs scans.
+    void __splitMerge(const std::vector<size_t> &rows, size_t num_launch_scans=5);
+    // restricted Gibbs step for row, which is in cluster a (is_in_a) or b of every feature.
+    // Returns the log probability of the chosen cluster. If force is true, row goes to cluster a
+    // if force_to_a, else b. n_a and n_b are the cluster sizes and are updated.
+    double __restrictedGibbsStep(size_t row, size_t a, size_t b, bool &is_in_a, double &n_a,
+                                 double &n_b, bool force=false, bool force_to_a=false);
 
     //
     baxcat::PRNG *_rng;
     // number of rows
     size_t _num_rows;
-    // the number of clusters/categoiries in the view
+    // the number of clusters/categoiries in the view. During a row sweep this counts cluster
+    // slots, which includes the empty slots in _free_clusters.
     size_t _num_clusters;
     // _num_categories[k] is the number of drows assigned to category k
     std::vector<size_t> _cluster_counts;
+    // slots of clusters destroyed during the current sweep. They have count zero, are reused by
+    // new singletons, and are erased by __compactClusters before the sweep returns.
+    std::vector<size_t> _free_clusters;
     // the CRP parameter for rows to cats
     double _crp_alpha;
     // pointers to feature objects
@@ -98,6 +141,11 @@ private:
     std::vector<size_t> _row_assignment;
     // the score of the view
     double _log_score;
+    // split-merge statistics
+    size_t _num_split_proposals = 0;
+    size_t _num_split_accepts = 0;
+    size_t _num_merge_proposals = 0;
+    size_t _num_merge_accepts = 0;
 };
 
 } // end namespace baxcat
@@ -13,6 +13,23 @@ using baxcat::datatypes::Categorical;
 // cleanup
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 void Categorical::insertElement(size_t x)
+{
+	++_n;
+	_csd.suffstatInsert(x, _counts);
+
+	double lgamma_x = lgamma(static_cast<double>(_counts[x]) + _dirichlet_alpha);
+	if(_counts[x] == 1){
+		++_num_occupied;
+		_sum_lgamma += lgamma_x;
+	}else{
+		_sum_lgamma += lgamma_x - _lgamma_counts[x];
+	}
+	_lgamma_counts[x] = lgamma_x;
+	_log_ZN = _csd.logZ(_n, _counts, _dirichlet_alpha);
+}
+
+
+void Categorical::insertElementDeferred(size_t x)
 {
 	++_n;
 	_csd.suffstatInsert(x, _counts);
@@ -23,6 +40,17 @@ void Categorical::removeElement(size_t x)
 {
 	--_n;
 	_csd.suffstatRemove(x, _counts);
+
+	if(_counts[x] == 0){
+		--_num_occupied;
+		_sum_lgamma -= _lgamma_counts[x];
+		_lgamma_counts[x] = _lgamma_alpha;
+	}else{
+		double lgamma_x = lgamma(static_cast<double>(_counts[x]) + _dirichlet_alpha);
+		_sum_lgamma += lgamma_x - _lgamma_counts[x];
+		_lgamma_counts[x] = lgamma_x;
+	}
+	_log_ZN = _csd.logZ(_n, _counts, _dirichlet_alpha);
 }
 
 
@@ -31,6 +59,7 @@ void Categorical::clear(const std::vector<double> &distargs)
 	_n = 0;
     // _counts.resize(static_cast<size_t>(distargs[0]+.5));
 	std::fill(_counts.begin(), _counts.end(), 0);
+	updateConstants();
 }
 
 
@@ -38,13 +67,15 @@ void Categorical::clear(const std::vector<double> &distargs)
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 double Categorical::logp() const
 {
-    return _csd.logMarginalLikelihood(_n, _counts, _dirichlet_alpha);
+    // _csd.logMarginalLikelihood(_n, _counts, _dirichlet_alpha) from the cached terms
+    double A = static_cast<double>(_counts.size())*_dirichlet_alpha;
+    return _lgamma_A - lgamma(A+_n) + _sum_lgamma - _num_occupied*_lgamma_alpha;
 }
 
 
 double Categorical::elementLogp(size_t x) const
 {
-    return _csd.logPredictiveProbability(x, _counts, _dirichlet_alpha, _log_Z0 );
+    return _csd.logPredictiveProbability(x, _counts, _dirichlet_alpha, _log_ZN);
 }
 
 
@@ -66,7 +97,7 @@ double Categorical::hyperpriorLogp(const std::vector<double> &hyperprior_config)
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 size_t Categorical::draw(baxcat::PRNG *rng) const
 {
-	return _csd.predictiveSample(_counts, _dirichlet_alpha, rng, _log_Z0);
+	return _csd.predictiveSample(_counts, _dirichlet_alpha, rng, _log_ZN);
 }
 
 
@@ -75,7 +106,8 @@ size_t Categorical::drawConstrained(vector<size_t> contraints, baxcat::PRNG *rng
 	auto counts_copy = _counts;
 	for( auto &c : contraints)
 		++counts_copy[c];
-	return _csd.predictiveSample(counts_copy, _dirichlet_alpha, rng, _log_Z0);
+	double log_z = _csd.logZ(_n + contraints.size(), counts_copy, _dirichlet_alpha);
+	return _csd.predictiveSample(counts_copy, _dirichlet_alpha, rng, log_z);
 }
 
 
@@ -162,7 +194,24 @@ function<double(double)> Categorical::constructDirichletAlphaConditional(
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 void Categorical::updateConstants()
 {
+    double K = static_cast<double>(_counts.size());
+
     _log_Z0 = 0;
+    _log_ZN = _csd.logZ(_n, _counts, _dirichlet_alpha);
+    _lgamma_alpha = lgamma(_dirichlet_alpha);
+    _lgamma_A = lgamma(K*_dirichlet_alpha);
+
+    // rebuild the table and resync the running sum, which drifts by rounding between calls
+    _lgamma_counts.assign(_counts.size(), _lgamma_alpha);
+    _sum_lgamma = 0;
+    _num_occupied = 0;
+    for(size_t k = 0; k < _counts.size(); ++k){
+        if(_counts[k] > 0){
+            _lgamma_counts[k] = lgamma(static_cast<double>(_counts[k]) + _dirichlet_alpha);
+            _sum_lgamma += _lgamma_counts[k];
+            ++_num_occupied;
+        }
+    }
 }
 
 
@@ -0,0 +1,134 @@
+#include "column_file.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::vector;
+using std::string;
+using std::runtime_error;
+
+
+namespace baxcat{
+
+namespace{
+
+const char MAGIC[8] = {'B', 'X', 'C', 'O', 'L', 'S', '\0', '\0'};
+
+// header layout; all fields little-endian, zero padded to ColumnFile::HEADER_BYTES
+struct Header{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_rows;
+    uint64_t num_columns;
+};
+
+bool isLittleEndian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t *>(&one) == 1;
+}
+
+} // end anonymous namespace
+
+
+const size_t ColumnFile::HEADER_BYTES;
+const uint32_t ColumnFile::VERSION;
+
+
+ColumnFile::ColumnFile(const string &path)
+    : _map(nullptr), _map_bytes(0), _num_rows(0), _num_columns(0), _data(nullptr)
+{
+    if(!isLittleEndian())
+        throw runtime_error("column files are little-endian; this host is not");
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("could not open column file " + path);
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 or static_cast<size_t>(info.st_size) < HEADER_BYTES){
+        close(fd);
+        throw runtime_error(path + " is too small to be a column file");
+    }
+    _map_bytes = static_cast<size_t>(info.st_size);
+
+    _map = mmap(nullptr, _map_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(_map == MAP_FAILED){
+        _map = nullptr;
+        throw runtime_error("could not map column file " + path);
+    }
+
+    Header header;
+    std::memcpy(&header, _map, sizeof(Header));
+
+    // the number of doubles the file holds after the header
+    const size_t num_values = (_map_bytes - HEADER_BYTES)/sizeof(double);
+
+    string error;
+    if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0){
+        error = path + " is not a column file";
+    }else if(header.version != VERSION){
+        error = path + " has an unsupported column file version";
+    }else if(header.num_columns > 0 and header.num_rows > num_values/header.num_columns){
+        error = path + " is shorter than its header says";
+    }
+
+    if(!error.empty()){
+        munmap(_map, _map_bytes);
+        _map = nullptr;
+        throw runtime_error(error);
+    }
+
+    _num_rows = header.num_rows;
+    _num_columns = header.num_columns;
+    _data = reinterpret_cast<const double *>(static_cast<const char *>(_map) + HEADER_BYTES);
+}
+
+
+ColumnFile::~ColumnFile()
+{
+    if(_map != nullptr)
+        munmap(_map, _map_bytes);
+}
+
+
+void ColumnFile::write(const string &path, const vector<vector<double>> &X)
+{
+    if(!isLittleEndian())
+        throw runtime_error("column files are little-endian; this host is not");
+
+    const size_t num_rows = X.empty() ? 0 : X[0].size();
+    for(auto &column : X){
+        if(column.size() != num_rows)
+            throw runtime_error("every column must have the same number of rows");
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out)
+        throw runtime_error("could not open " + path + " for writing");
+
+    char header_bytes[HEADER_BYTES] = {0};
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.flags = 0;
+    header.num_rows = num_rows;
+    header.num_columns = X.size();
+    std::memcpy(header_bytes, &header, sizeof(Header));
+
+    out.write(header_bytes, HEADER_BYTES);
+    for(auto &column : X)
+        out.write(reinterpret_cast<const char *>(column.data()), num_rows*sizeof(double));
+
+    if(!out)
+        throw runtime_error("could not write " + path);
+}
+
+} // end namespace baxcat
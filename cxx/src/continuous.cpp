@@ -436,3 +436,396 @@ void Continuous::setHypersByMap( map<string, double> hypers )
     _nu = hypers["nu"];
     updateConstants(); // update normalizing constants
 }
+
+
+// Structure-of-arrays cluster store
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+using ContinuousStore = baxcat::ClusterStore<Continuous>;
+using baxcat::models::NormalNormalGamma;
+
+
+ContinuousStore::ClusterStore() : _cache_hits(0), _cache_misses(0),
+    _kernel_level(baxcat::models::nng_simd::scalar), _m(0), _r(1), _s(1), _nu(1)
+{
+    _log_Z0 = NormalNormalGamma::logZ(_r, _s, _nu);
+}
+
+
+void ContinuousStore::pushBack(const vector<double> &distargs, const vector<double> &hypers)
+{
+    if(hypers != getHypers())
+        setHypers(hypers);
+
+    _n.push_back(0);
+    _sum_x.push_back(0);
+    _sum_x_sq.push_back(0);
+    _log_ZN.push_back(_log_Z0);
+    _version.push_back(0);
+    _cached_version.push_back(0);
+    _t_loc.push_back(0);
+    _t_prec.push_back(0);
+    _t_shape.push_back(0);
+    _t_log_const.push_back(0);
+
+    __updateConstants(_n.size()-1);
+}
+
+
+void ContinuousStore::erase(size_t k)
+{
+    _n.erase(_n.begin()+k);
+    _sum_x.erase(_sum_x.begin()+k);
+    _sum_x_sq.erase(_sum_x_sq.begin()+k);
+    _log_ZN.erase(_log_ZN.begin()+k);
+    _version.erase(_version.begin()+k);
+    _cached_version.erase(_cached_version.begin()+k);
+    _t_loc.erase(_t_loc.begin()+k);
+    _t_prec.erase(_t_prec.begin()+k);
+    _t_shape.erase(_t_shape.begin()+k);
+    _t_log_const.erase(_t_log_const.begin()+k);
+}
+
+
+// keeps the entries of v whose index is not in the sorted list ks
+template <typename T>
+static void eraseSorted(vector<T> &v, const vector<size_t> &ks)
+{
+    size_t j = 0;
+    size_t k_new = 0;
+    for(size_t k = 0; k < v.size(); ++k){
+        if(j < ks.size() and ks[j] == k){
+            ++j;
+            continue;
+        }
+        v[k_new] = v[k];
+        ++k_new;
+    }
+    v.resize(k_new);
+}
+
+
+void ContinuousStore::erase(const vector<size_t> &ks)
+{
+    eraseSorted(_n, ks);
+    eraseSorted(_sum_x, ks);
+    eraseSorted(_sum_x_sq, ks);
+    eraseSorted(_log_ZN, ks);
+    eraseSorted(_version, ks);
+    eraseSorted(_cached_version, ks);
+    eraseSorted(_t_loc, ks);
+    eraseSorted(_t_prec, ks);
+    eraseSorted(_t_shape, ks);
+    eraseSorted(_t_log_const, ks);
+}
+
+
+void ContinuousStore::reset(size_t num_clusters, const vector<double> &distargs,
+                            const vector<double> &hypers)
+{
+    clear();
+    for(size_t k = 0; k < num_clusters; ++k)
+        pushBack(distargs, hypers);
+}
+
+
+void ContinuousStore::clear()
+{
+    _n.clear();
+    _sum_x.clear();
+    _sum_x_sq.clear();
+    _log_ZN.clear();
+    _version.clear();
+    _cached_version.clear();
+    _t_loc.clear();
+    _t_prec.clear();
+    _t_shape.clear();
+    _t_log_const.clear();
+}
+
+
+void ContinuousStore::clearSuffstats(const vector<double> &distargs)
+{
+    for(size_t k = 0; k < _n.size(); ++k){
+        _n[k] = 0;
+        _sum_x[k] = 0;
+        _sum_x_sq[k] = 0;
+        __updateConstants(k);
+    }
+}
+
+
+// Mirrors Continuous::insertElement and Continuous::removeElement exactly
+void ContinuousStore::insertElement(size_t k, double x)
+{
+    ASSERT_IS_A_NUMBER(cout, x);
+
+    ++_n[k];
+    NormalNormalGamma::suffstatInsert(x, _sum_x[k], _sum_x_sq[k]);
+
+    __updateConstants(k);
+}
+
+
+void ContinuousStore::insertElements(const DataContainer<double> &data,
+                                     const vector<size_t> &assignment)
+{
+    ASSERT_EQUAL(cout, data.size(), assignment.size());
+    data.for_each_set([&](size_t i){
+        double x = data.at(i);
+        ASSERT_IS_A_NUMBER(cout, x);
+        size_t k = assignment[i];
+        ++_n[k];
+        NormalNormalGamma::suffstatInsert(x, _sum_x[k], _sum_x_sq[k]);
+    });
+
+    for(size_t k = 0; k < _n.size(); ++k)
+        __updateConstants(k);
+}
+
+
+void ContinuousStore::removeElement(size_t k, double x)
+{
+    ASSERT_IS_A_NUMBER(cout, x);
+
+    --_n[k];
+    // protect from floating point errors where _sum_x_sq == 0
+    if(_n[k] == 0){
+        _sum_x[k] = 0;
+        _sum_x_sq[k] = 0;
+    }else if(_n[k] == 1){
+        _sum_x[k] -= x;
+        _sum_x_sq[k] = _sum_x[k]*_sum_x[k];
+    }else{
+        NormalNormalGamma::suffstatRemove(x, _sum_x[k], _sum_x_sq[k]);
+    }
+
+    __updateConstants(k);
+}
+
+
+double ContinuousStore::elementLogp(size_t k, double x) const
+{
+    return NormalNormalGamma::logPredictiveProbability(x, _n[k], _sum_x[k], _sum_x_sq[k], _m, _r,
+                                                       _s, _nu, _log_ZN[k]);
+}
+
+
+// the suffstats of cluster k plus given, scored as insertElement would leave them
+double ContinuousStore::elementLogpGiven(size_t k, double x, const vector<double> &given) const
+{
+    double n = _n[k];
+    double sum_x = _sum_x[k];
+    double sum_x_sq = _sum_x_sq[k];
+    for(auto y : given){
+        ASSERT_IS_A_NUMBER(cout, y);
+        ++n;
+        NormalNormalGamma::suffstatInsert(y, sum_x, sum_x_sq);
+    }
+
+    double m_n = _m;
+    double r_n = _r;
+    double s_n = _s;
+    double nu_n = _nu;
+    NormalNormalGamma::posteriorParameters(n, sum_x, sum_x_sq, m_n, r_n, s_n, nu_n);
+    double log_ZN = NormalNormalGamma::logZ(r_n, s_n, nu_n);
+
+    return NormalNormalGamma::logPredictiveProbability(x, n, sum_x, sum_x_sq, _m, _r, _s, _nu,
+                                                       log_ZN);
+}
+
+
+void ContinuousStore::addElementLogps(double x, size_t current_cluster, vector<double> &logps)
+{
+    const size_t num_clusters = _n.size();
+
+    // Only clusters that changed since the last call pay for the lgammas. The current cluster is
+    // scored below without x, so it needs no constants.
+    __refreshPredictiveCache(current_cluster);
+
+    _logps_buffer.resize(num_clusters);
+    NormalNormalGamma::logPredictiveProbabilitiesCached(x, num_clusters, _t_loc.data(),
+        _t_prec.data(), _t_shape.data(), _t_log_const.data(), _logps_buffer.data(),
+        _kernel_level);
+
+    // score the current cluster with x taken out, without touching its suffstats (mirrors
+    // removeElement)
+    if(current_cluster < num_clusters){
+        size_t k = current_cluster;
+        double n = _n[k]-1;
+        double sum_x = _sum_x[k];
+        double sum_x_sq = _sum_x_sq[k];
+        if(n == 0){
+            sum_x = 0;
+            sum_x_sq = 0;
+        }else if(n == 1){
+            sum_x -= x;
+            sum_x_sq = sum_x*sum_x;
+        }else{
+            NormalNormalGamma::suffstatRemove(x, sum_x, sum_x_sq);
+        }
+        _logps_buffer[k] = NormalNormalGamma::logPredictiveProbability(x, n, sum_x, sum_x_sq, _m,
+                                                                       _r, _s, _nu);
+    }
+
+    for(size_t k = 0; k < num_clusters; ++k)
+        logps[k] += _logps_buffer[k];
+}
+
+
+double ContinuousStore::singletonLogp(double x) const
+{
+    return NormalNormalGamma::logPredictiveProbability(x, 0, 0, 0, _m, _r, _s, _nu, _log_Z0);
+}
+
+
+double ContinuousStore::logp(size_t k) const
+{
+    return NormalNormalGamma::logMarginalLikelihood(_n[k], _log_ZN[k], _log_Z0);
+}
+
+
+double ContinuousStore::hyperpriorLogp(const vector<double> &hyperprior_config) const
+{
+    return Continuous(0, 0, 0, _m, _r, _s, _nu).hyperpriorLogp(hyperprior_config);
+}
+
+
+double ContinuousStore::draw(size_t k, baxcat::PRNG *rng) const
+{
+    double sample = NormalNormalGamma::predictiveSample(_n[k], _sum_x[k], _sum_x_sq[k], _m, _r, _s,
+                                                        _nu, rng);
+    ASSERT_IS_A_NUMBER(cout, sample);
+    return sample;
+}
+
+
+double ContinuousStore::drawGiven(size_t k, const vector<double> &given, baxcat::PRNG *rng) const
+{
+    double n = _n[k];
+    double sum_x = _sum_x[k];
+    double sum_x_sq = _sum_x_sq[k];
+    for(auto y : given){
+        ASSERT_IS_A_NUMBER(cout, y);
+        ++n;
+        NormalNormalGamma::suffstatInsert(y, sum_x, sum_x_sq);
+    }
+
+    double sample = NormalNormalGamma::predictiveSample(n, sum_x, sum_x_sq, _m, _r, _s, _nu, rng);
+    ASSERT_IS_A_NUMBER(cout, sample);
+    return sample;
+}
+
+
+vector<double> ContinuousStore::resampleHypers(const vector<double> &hyperprior_config,
+                                               baxcat::PRNG *rng)
+{
+    // the hyperparameter conditionals are defined over Continuous models
+    vector<Continuous> models;
+    models.reserve(_n.size());
+    for(size_t k = 0; k < _n.size(); ++k)
+        models.emplace_back(_n[k], _sum_x[k], _sum_x_sq[k], _m, _r, _s, _nu);
+
+    auto hypers = Continuous::resampleHypers(models, hyperprior_config, rng);
+    setHypers(hypers);
+    return hypers;
+}
+
+
+void ContinuousStore::setHypers(const vector<double> &hypers)
+{
+    ASSERT_GREATER_THAN_ZERO(cout, hypers[1]);
+    ASSERT_GREATER_THAN_ZERO(cout, hypers[2]);
+    ASSERT_GREATER_THAN_ZERO(cout, hypers[3]);
+
+    _m = hypers[0];
+    _r = hypers[1];
+    _s = hypers[2];
+    _nu = hypers[3];
+
+    _log_Z0 = NormalNormalGamma::logZ(_r, _s, _nu);
+    for(size_t k = 0; k < _n.size(); ++k)
+        __updateConstants(k);
+}
+
+
+void ContinuousStore::setHypersByMap(map<string, double> hypers_map)
+{
+    setHypers({hypers_map["m"], hypers_map["r"], hypers_map["s"], hypers_map["nu"]});
+}
+
+
+size_t ContinuousStore::size() const
+{
+    return _n.size();
+}
+
+
+size_t ContinuousStore::getCount(size_t k) const
+{
+    return static_cast<size_t>(_n[k]+.5);
+}
+
+
+vector<double> ContinuousStore::getHypers() const
+{
+    return {_m, _r, _s, _nu};
+}
+
+
+map<string, double> ContinuousStore::getHypersMap(size_t k) const
+{
+    return {{"m", _m}, {"r", _r}, {"s", _s}, {"nu", _nu}};
+}
+
+
+map<string, double> ContinuousStore::getSuffstatsMap(size_t k) const
+{
+    return {{"n", _n[k]}, {"sum_x", _sum_x[k]}, {"sum_x_sq", _sum_x_sq[k]}};
+}
+
+
+map<string, size_t> ContinuousStore::getCacheStats() const
+{
+    return {{"hits", _cache_hits}, {"misses", _cache_misses}};
+}
+
+
+void ContinuousStore::setSIMD(bool use_simd)
+{
+    _kernel_level = use_simd ? baxcat::models::nng_simd::detectedLevel()
+                             : baxcat::models::nng_simd::scalar;
+}
+
+
+void ContinuousStore::__updateConstants(size_t k)
+{
+    double m_n = _m;
+    double r_n = _r;
+    double s_n = _s;
+    double nu_n = _nu;
+
+    NormalNormalGamma::posteriorParameters(_n[k], _sum_x[k], _sum_x_sq[k], m_n, r_n, s_n, nu_n);
+    _log_ZN[k] = NormalNormalGamma::logZ(r_n, s_n, nu_n);
+    ++_version[k];
+
+    ASSERT_IS_A_NUMBER(cout, _log_ZN[k]);
+}
+
+
+void ContinuousStore::__refreshPredictiveCache(size_t skip)
+{
+    for(size_t k = 0; k < _n.size(); ++k){
+        if(k == skip)
+            continue;
+
+        if(_cached_version[k] == _version[k]){
+            ++_cache_hits;
+        }else{
+            ++_cache_misses;
+            NormalNormalGamma::predictiveConstants(_n[k], _sum_x[k], _sum_x_sq[k], _m, _r, _s,
+                                                   _nu, _t_loc[k], _t_prec[k], _t_shape[k],
+                                                   _t_log_const[k]);
+            _cached_version[k] = _version[k];
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#include "dependence.hpp"
+
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+using std::vector;
+
+
+namespace baxcat{
+
+namespace{
+
+// columns per block. The labels of a block of rows and a block of columns stay in cache while
+// every pair between them is counted.
+const size_t BLOCK_COLUMNS = 64;
+
+// the column assignments transposed so that the labels of one column are contiguous:
+// labels[c*num_models + m] is the view of column c in model m
+struct Labels
+{
+    size_t num_models;
+    size_t num_columns;
+    vector<uint32_t> labels;
+};
+
+
+Labels transposeAssignments(const vector<vector<size_t>> &col_assignments)
+{
+    if(col_assignments.empty())
+        throw std::invalid_argument("dependence probability needs at least one model");
+
+    Labels t;
+    t.num_models = col_assignments.size();
+    t.num_columns = col_assignments[0].size();
+    for(auto &Zv : col_assignments){
+        if(Zv.size() != t.num_columns)
+            throw std::invalid_argument("every model must assign the same number of columns");
+    }
+
+    t.labels.resize(t.num_models*t.num_columns);
+    for(size_t m = 0; m < t.num_models; ++m){
+        for(size_t c = 0; c < t.num_columns; ++c)
+            t.labels[c*t.num_models + m] = static_cast<uint32_t>(col_assignments[m][c]);
+    }
+    return t;
+}
+
+
+// call f(i, j, count) for every pair of columns i < j, where count is the number of models that
+// put i and j in the same view. Each task owns one block of rows i and walks the blocks of
+// columns j >= i in order, so for a given i, f sees j in increasing order and always on the same
+// thread.
+template <class F>
+void forEachPair(const Labels &t, F f)
+{
+    const size_t M = t.num_models;
+    const size_t C = t.num_columns;
+    const size_t num_blocks = (C + BLOCK_COLUMNS - 1)/BLOCK_COLUMNS;
+
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t bi = 0; bi < num_blocks; ++bi){
+        const size_t i_begin = bi*BLOCK_COLUMNS;
+        const size_t i_end = std::min(C, i_begin + BLOCK_COLUMNS);
+        for(size_t bj = bi; bj < num_blocks; ++bj){
+            const size_t j_begin = bj*BLOCK_COLUMNS;
+            const size_t j_end = std::min(C, j_begin + BLOCK_COLUMNS);
+            for(size_t i = i_begin; i < i_end; ++i){
+                const uint32_t *a = &t.labels[i*M];
+                for(size_t j = std::max(j_begin, i+1); j < j_end; ++j){
+                    const uint32_t *b = &t.labels[j*M];
+                    uint32_t count = 0;
+                    for(size_t m = 0; m < M; ++m)
+                        count += (a[m] == b[m]);
+                    f(i, j, count);
+                }
+            }
+        }
+    }
+}
+
+} // end anonymous namespace
+
+
+void dependenceProbabilityMatrix(const vector<vector<size_t>> &col_assignments, double *out)
+{
+    const Labels t = transposeAssignments(col_assignments);
+    const size_t C = t.num_columns;
+    const double num_models = static_cast<double>(t.num_models);
+
+    for(size_t c = 0; c < C; ++c)
+        out[c*C + c] = 1;
+
+    // (i, j) and (j, i) both belong to the task that owns row block i, so no two threads write
+    // the same entry
+    forEachPair(t, [&](size_t i, size_t j, uint32_t count){
+        const double p = count/num_models;
+        out[i*C + j] = p;
+        out[j*C + i] = p;
+    });
+}
+
+
+vector<double> dependenceProbabilityMatrix(const vector<vector<size_t>> &col_assignments)
+{
+    const size_t C = col_assignments.empty() ? 0 : col_assignments[0].size();
+    vector<double> out(C*C);
+    dependenceProbabilityMatrix(col_assignments, out.data());
+    return out;
+}
+
+
+DependencePairs dependenceProbabilityPairs(const vector<vector<size_t>> &col_assignments,
+                                           double threshold)
+{
+    const Labels t = transposeAssignments(col_assignments);
+    const size_t C = t.num_columns;
+    const double num_models = static_cast<double>(t.num_models);
+
+    // the pairs found for each row, kept apart so that the rows can be joined in order
+    vector<vector<size_t>> partners(C);
+    vector<vector<double>> probabilities(C);
+    forEachPair(t, [&](size_t i, size_t j, uint32_t count){
+        const double p = count/num_models;
+        if(p >= threshold){
+            partners[i].push_back(j);
+            probabilities[i].push_back(p);
+        }
+    });
+
+    DependencePairs pairs;
+    size_t num_pairs = 0;
+    for(auto &row : partners)
+        num_pairs += row.size();
+    pairs.first.reserve(num_pairs);
+    pairs.second.reserve(num_pairs);
+    pairs.probability.reserve(num_pairs);
+
+    for(size_t i = 0; i < C; ++i){
+        pairs.first.insert(pairs.first.end(), partners[i].size(), i);
+        pairs.second.insert(pairs.second.end(), partners[i].begin(), partners[i].end());
+        pairs.probability.insert(pairs.probability.end(), probabilities[i].begin(),
+                                 probabilities[i].end());
+    }
+    return pairs;
+}
+
+} // end namespace baxcat
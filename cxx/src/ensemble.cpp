@@ -0,0 +1,150 @@
+#include "ensemble.hpp"
+
+#include <stdexcept>
+
+using std::map;
+using std::vector;
+using std::string;
+
+
+namespace baxcat{
+
+
+Ensemble::Ensemble(const vector<vector<double>> &X, vector<string> datatypes,
+                   vector<vector<double>> distargs)
+    : _num_rows(X.empty() ? 0 : X[0].size()), _num_columns(X.size()),
+      _row_stride(1), _column_stride(_num_rows), _datatypes(std::move(datatypes)),
+      _distargs(std::move(distargs))
+{
+    _table.reserve(_num_rows*_num_columns);
+    for(auto &column : X){
+        ASSERT_EQUAL(std::cout, column.size(), _num_rows);
+        _table.insert(_table.end(), column.begin(), column.end());
+    }
+    _X = _table.data();
+}
+
+
+Ensemble::Ensemble(const double *X, size_t num_rows, size_t num_columns, size_t row_stride,
+                   size_t column_stride, vector<string> datatypes,
+                   vector<vector<double>> distargs)
+    : _X(X), _num_rows(num_rows), _num_columns(num_columns), _row_stride(row_stride),
+      _column_stride(column_stride), _datatypes(std::move(datatypes)),
+      _distargs(std::move(distargs))
+{}
+
+
+Ensemble::Ensemble(std::shared_ptr<ColumnFile> file, vector<string> datatypes,
+                   vector<vector<double>> distargs)
+    : _column_file(file), _X(file->data()), _num_rows(file->numRows()),
+      _num_columns(file->numColumns()), _row_stride(1), _column_stride(file->numRows()),
+      _datatypes(std::move(datatypes)), _distargs(std::move(distargs))
+{}
+
+
+size_t Ensemble::addState(unsigned int rng_seed)
+{
+    if(_column_file){
+        _states.emplace_back(new State(_column_file, _datatypes, _distargs, rng_seed));
+    }else{
+        _states.emplace_back(new State(_X, _num_rows, _num_columns, _row_stride, _column_stride,
+                                       _datatypes, _distargs, rng_seed));
+    }
+    return _states.size()-1;
+}
+
+
+size_t Ensemble::addState(unsigned int rng_seed, vector<size_t> Zv,
+                          vector<vector<size_t>> Zrcv, double state_alpha,
+                          vector<double> view_alphas, vector<map<string, double>> hyper_maps)
+{
+    if(_column_file){
+        _states.emplace_back(new State(_column_file, _datatypes, _distargs, rng_seed,
+                                       std::move(Zv), std::move(Zrcv), state_alpha,
+                                       std::move(view_alphas), std::move(hyper_maps)));
+    }else{
+        _states.emplace_back(new State(_X, _num_rows, _num_columns, _row_stride, _column_stride,
+                                       _datatypes, _distargs, rng_seed, std::move(Zv),
+                                       std::move(Zrcv), state_alpha, std::move(view_alphas),
+                                       std::move(hyper_maps)));
+    }
+    return _states.size()-1;
+}
+
+
+void Ensemble::transition(vector<size_t> which_states, vector<string> which_transitions,
+                          vector<size_t> which_rows, vector<size_t> which_cols,
+                          size_t which_kernel, int N, size_t m, size_t which_row_kernel)
+{
+    if(which_states.empty()){
+        which_states.resize(_states.size());
+        for(size_t i = 0; i < _states.size(); ++i)
+            which_states[i] = i;
+    }
+
+    // two threads must never run one state
+    vector<bool> is_listed(_states.size(), false);
+    for(auto idx : which_states){
+        if(idx >= _states.size())
+            throw std::invalid_argument("which_states holds an index past the number of states");
+        if(is_listed[idx])
+            throw std::invalid_argument("which_states lists a state more than once");
+        is_listed[idx] = true;
+    }
+
+    // key each state's run from its own generator before any thread touches it
+    vector<uint64_t> keys(which_states.size());
+    for(size_t i = 0; i < which_states.size(); ++i)
+        keys[i] = _states[which_states[i]]->getPRNG()->drawKey();
+
+    // a lone state keeps the threads for its own parallel loops
+    #pragma omp parallel for schedule(dynamic) if(which_states.size() > 1)
+    for(size_t i = 0; i < which_states.size(); ++i){
+        State &state = *_states[which_states[i]];
+        PRNG::ScopedStream stream(*state.getPRNG(), {keys[i]});
+        state.transition(which_transitions, which_rows, which_cols, which_kernel, N, m,
+                         which_row_kernel);
+    }
+}
+
+
+size_t Ensemble::size() const
+{
+    return _states.size();
+}
+
+
+size_t Ensemble::getNumRows() const
+{
+    return _num_rows;
+}
+
+
+size_t Ensemble::getNumColumns() const
+{
+    return _num_columns;
+}
+
+
+State &Ensemble::getState(size_t index)
+{
+    return *_states[index];
+}
+
+
+const State &Ensemble::getState(size_t index) const
+{
+    return *_states[index];
+}
+
+
+vector<double> Ensemble::logScores()
+{
+    vector<double> scores(_states.size());
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t i = 0; i < _states.size(); ++i)
+        scores[i] = _states[i]->logScore();
+    return scores;
+}
+
+} // end namespace baxcat
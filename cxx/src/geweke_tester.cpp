@@ -12,9 +12,9 @@ namespace baxcat {
 GewekeTester::GewekeTester(size_t num_rows, size_t num_cols, vector<string> datatypes, 
                            unsigned int seed, size_t m, bool do_hypers, 
                            bool do_row_alpha, bool do_col_alpha,
-                           bool do_row_z, bool do_col_z, size_t ct_kernel)
+                           bool do_row_z, bool do_col_z, size_t ct_kernel, size_t rt_kernel)
     : _m(m), _num_cols(num_cols), _num_rows(num_rows), _datatypes(datatypes),
-      _do_hypers(do_hypers), _ct_kernel(ct_kernel),
+      _do_hypers(do_hypers), _ct_kernel(ct_kernel), _rt_kernel(rt_kernel),
       _do_row_alpha(do_row_alpha), _do_col_alpha(do_col_alpha), 
       _do_col_z(do_col_z), _do_row_z(do_row_z)
 {
@@ -92,7 +92,7 @@ void GewekeTester::posteriorSample(size_t num_times, bool do_init, size_t lag)
 
         for( size_t j = 0; j < lag; ++j ){
             _state.transition(_transition_list, vector<size_t>(), vector<size_t>(),
-                              _ct_kernel, 1, _m);
+                              _ct_kernel, 1, _m, _rt_kernel);
             _state.__geweke_clear();
             _state.__geweke_resampleRows();
         }
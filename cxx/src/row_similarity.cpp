@@ -0,0 +1,282 @@
+#include "row_similarity.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+using std::vector;
+
+
+namespace baxcat{
+
+const size_t RowSimilarity::NOT_IN_MODEL;
+
+
+RowSimilarity::RowSimilarity(size_t num_rows, const vector<vector<size_t>> &col_assignments,
+                             const vector<vector<vector<size_t>>> &row_assignments,
+                             const vector<vector<size_t>> &model_rows)
+    : _num_rows(num_rows), _num_columns(0)
+{
+    if(col_assignments.size() != row_assignments.size())
+        throw std::invalid_argument("need a column and a row assignment for each model");
+    if(!model_rows.empty() and model_rows.size() != row_assignments.size())
+        throw std::invalid_argument("need the rows of each model, or of none");
+    if(!col_assignments.empty())
+        _num_columns = col_assignments[0].size();
+
+    _models.resize(col_assignments.size());
+    for(size_t m = 0; m < _models.size(); ++m){
+        Model &model = _models[m];
+        model.col_assignment = col_assignments[m];
+        model.row_assignment = row_assignments[m];
+
+        if(model.col_assignment.size() != _num_columns)
+            throw std::invalid_argument("every model must assign the same number of columns");
+        for(auto v : model.col_assignment){
+            if(v >= model.row_assignment.size())
+                throw std::invalid_argument("a column is assigned to a view with no rows");
+        }
+
+        // the row of the table that is each of the model's rows
+        const size_t num_model_rows = model.row_assignment.empty() ? 0 :
+                                      model.row_assignment[0].size();
+        vector<size_t> rows;
+        if(model_rows.empty()){
+            if(num_model_rows != _num_rows)
+                throw std::invalid_argument("a model without model_rows must hold every row");
+            rows.resize(_num_rows);
+            for(size_t i = 0; i < _num_rows; ++i)
+                rows[i] = i;
+        }else{
+            rows = model_rows[m];
+            if(rows.size() != num_model_rows)
+                throw std::invalid_argument("model_rows does not match the row assignment");
+            model.local_index.assign(_num_rows, NOT_IN_MODEL);
+            for(size_t i = 0; i < rows.size(); ++i){
+                if(rows[i] >= _num_rows)
+                    throw std::invalid_argument("model_rows holds a row past num_rows");
+                model.local_index[rows[i]] = i;
+            }
+        }
+
+        // bucket the rows of each view by cluster (a counting sort, so each bucket stays in
+        // the model's row order)
+        const size_t num_views = model.row_assignment.size();
+        model.offsets.resize(num_views);
+        model.members.resize(num_views);
+        for(size_t v = 0; v < num_views; ++v){
+            const vector<size_t> &Z = model.row_assignment[v];
+            if(Z.size() != num_model_rows)
+                throw std::invalid_argument("every view must assign every row of its model");
+
+            const size_t num_clusters = Z.empty() ? 0 : *std::max_element(Z.begin(), Z.end())+1;
+            vector<size_t> &offsets = model.offsets[v];
+            offsets.assign(num_clusters+1, 0);
+            for(auto k : Z)
+                ++offsets[k+1];
+            for(size_t k = 0; k < num_clusters; ++k)
+                offsets[k+1] += offsets[k];
+
+            vector<size_t> next(offsets.begin(), offsets.end()-1);
+            vector<size_t> &members = model.members[v];
+            members.resize(num_model_rows);
+            for(size_t i = 0; i < num_model_rows; ++i)
+                members[next[Z[i]]++] = rows[i];
+        }
+    }
+}
+
+
+size_t RowSimilarity::__localIndex(const Model &model, size_t row) const
+{
+    return model.local_index.empty() ? row : model.local_index[row];
+}
+
+
+vector<size_t> RowSimilarity::__relevantViews(const Model &model, const vector<size_t> &wrt) const
+{
+    vector<size_t> views;
+    if(wrt.empty()){
+        views.resize(model.row_assignment.size());
+        for(size_t v = 0; v < views.size(); ++v)
+            views[v] = v;
+    }else{
+        for(auto col : wrt){
+            if(col >= _num_columns)
+                throw std::invalid_argument("wrt holds a column past the number of columns");
+            views.push_back(model.col_assignment[col]);
+        }
+        std::sort(views.begin(), views.end());
+        views.erase(std::unique(views.begin(), views.end()), views.end());
+    }
+    return views;
+}
+
+
+void RowSimilarity::__checkWrt(const vector<size_t> &wrt) const
+{
+    for(auto col : wrt){
+        if(col >= _num_columns)
+            throw std::invalid_argument("wrt holds a column past the number of columns");
+    }
+}
+
+
+std::unique_ptr<RowSimilarity::Scratch> RowSimilarity::__acquireScratch() const
+{
+    {
+        std::lock_guard<std::mutex> lock(_scratch_mutex);
+        if(!_scratch_pool.empty()){
+            std::unique_ptr<Scratch> scratch = std::move(_scratch_pool.back());
+            _scratch_pool.pop_back();
+            return scratch;
+        }
+    }
+    std::unique_ptr<Scratch> scratch(new Scratch);
+    scratch->score.assign(_num_rows, 0);
+    return scratch;
+}
+
+
+void RowSimilarity::__releaseScratch(std::unique_ptr<Scratch> scratch) const
+{
+    std::lock_guard<std::mutex> lock(_scratch_mutex);
+    _scratch_pool.push_back(std::move(scratch));
+}
+
+
+double RowSimilarity::similarity(size_t row_a, size_t row_b, const vector<size_t> &wrt) const
+{
+    if(row_a >= _num_rows or row_b >= _num_rows)
+        throw std::invalid_argument("row past the number of rows");
+    if(row_a == row_b)
+        return 1;
+
+    // summed in the same order as __topK so that the two agree exactly
+    double score = 0;
+    size_t num_models = 0;
+    for(auto &model : _models){
+        const size_t a = __localIndex(model, row_a);
+        const size_t b = __localIndex(model, row_b);
+        if(a == NOT_IN_MODEL or b == NOT_IN_MODEL)
+            continue;
+
+        ++num_models;
+        auto views = __relevantViews(model, wrt);
+        const double weight = 1.0/views.size();
+        for(auto v : views){
+            if(model.row_assignment[v][a] == model.row_assignment[v][b])
+                score += weight;
+        }
+    }
+
+    if(num_models == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+    return score/num_models;
+}
+
+
+SimilarRows RowSimilarity::__topK(size_t row, size_t k, const vector<size_t> &wrt,
+                                  vector<double> &score, vector<size_t> &touched) const
+{
+    // models that hold the query row
+    vector<size_t> query_models;
+    bool all_rows = true;
+    for(size_t m = 0; m < _models.size(); ++m){
+        const Model &model = _models[m];
+        const size_t i = __localIndex(model, row);
+        if(i == NOT_IN_MODEL)
+            continue;
+
+        query_models.push_back(m);
+        all_rows = all_rows and model.local_index.empty();
+
+        auto views = __relevantViews(model, wrt);
+        const double weight = 1.0/views.size();
+        for(auto v : views){
+            const size_t cluster = model.row_assignment[v][i];
+            const size_t *begin = model.members[v].data() + model.offsets[v][cluster];
+            const size_t *end = model.members[v].data() + model.offsets[v][cluster+1];
+            for(const size_t *r = begin; r != end; ++r){
+                if(score[*r] == 0)
+                    touched.push_back(*r);
+                score[*r] += weight;
+            }
+        }
+    }
+
+    // each candidate is averaged over the query's models that also hold the candidate
+    vector<std::pair<double, size_t>> candidates;
+    candidates.reserve(touched.size());
+    for(auto r : touched){
+        if(r != row){
+            size_t num_models = query_models.size();
+            if(!all_rows){
+                num_models = 0;
+                for(auto m : query_models)
+                    num_models += (__localIndex(_models[m], r) != NOT_IN_MODEL);
+            }
+            candidates.emplace_back(score[r]/num_models, r);
+        }
+        score[r] = 0;
+    }
+    touched.clear();
+
+    const size_t num_out = std::min(k, candidates.size());
+    auto more_similar = [](const std::pair<double, size_t> &a,
+                           const std::pair<double, size_t> &b){
+        return a.first > b.first or (a.first == b.first and a.second < b.second);
+    };
+    std::partial_sort(candidates.begin(), candidates.begin()+num_out, candidates.end(),
+                      more_similar);
+
+    SimilarRows similar;
+    similar.rows.resize(num_out);
+    similar.similarity.resize(num_out);
+    for(size_t j = 0; j < num_out; ++j){
+        similar.similarity[j] = candidates[j].first;
+        similar.rows[j] = candidates[j].second;
+    }
+    return similar;
+}
+
+
+SimilarRows RowSimilarity::topK(size_t row, size_t k, const vector<size_t> &wrt) const
+{
+    if(row >= _num_rows)
+        throw std::invalid_argument("row past the number of rows");
+    // check wrt here; __topK must not throw with a half-filled scratch
+    __checkWrt(wrt);
+
+    auto scratch = __acquireScratch();
+    auto similar = __topK(row, k, wrt, scratch->score, scratch->touched);
+    __releaseScratch(std::move(scratch));
+    return similar;
+}
+
+
+vector<SimilarRows> RowSimilarity::topKBatch(const vector<size_t> &rows, size_t k,
+                                             const vector<size_t> &wrt) const
+{
+    for(auto row : rows){
+        if(row >= _num_rows)
+            throw std::invalid_argument("row past the number of rows");
+    }
+    // check wrt here; an exception must not escape the parallel region
+    __checkWrt(wrt);
+
+    vector<SimilarRows> similar(rows.size());
+    #pragma omp parallel
+    {
+        // one scratch per thread, cleared by __topK after each query
+        auto scratch = __acquireScratch();
+        #pragma omp for schedule(dynamic)
+        for(size_t q = 0; q < rows.size(); ++q)
+            similar[q] = __topK(rows[q], k, wrt, scratch->score, scratch->touched);
+        __releaseScratch(std::move(scratch));
+    }
+    return similar;
+}
+
+} // end namespace baxcat
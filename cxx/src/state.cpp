@@ -1,6 +1,9 @@
 
 #include "state.hpp"
 
+#include <limits>
+#include <stdexcept>
+
 using std::vector;
 using std::string;
 using std::function;
@@ -19,8 +22,87 @@ State::State(vector<vector<double>> X, vector<string> datatypes,
     _num_columns = X.size();
     _num_rows = X[0].size();
     _feature_types = helpers::getDatatypes(datatypes);
-    _features = helpers::genFeatures(X, datatypes, distargs, _rng.get());
+    _features = helpers::genFeatures(std::move(X), datatypes, distargs, _rng.get());
+
+    __initFromPrior();
+}
+
+
+State::State(vector<vector<double>> X, vector<string> datatypes,
+             vector<vector<double>> distargs, unsigned int rng_seed,
+             vector<size_t> Zv, vector<vector<size_t>> Zrcv,
+             double state_alpha, vector<double> view_alphas,
+             vector<map<string, double>> hypers_maps)
+    : _rng(shared_ptr<PRNG>(new PRNG(rng_seed))),
+      _crp_alpha_config(vector<double>()), _view_alpha_marker(-1)
+{
+    _num_columns = X.size();
+    _num_rows = X[0].size();
+
+    _feature_types = helpers::getDatatypes(datatypes);
+    _features = helpers::genFeatures(std::move(X), datatypes, distargs, _rng.get());
+
+    __initFromPartition(std::move(Zv), Zrcv, state_alpha, view_alphas, hypers_maps);
+}
+
+
+State::State(const double *X, size_t num_rows, size_t num_columns, size_t row_stride,
+             size_t column_stride, vector<string> datatypes, vector<vector<double>> distargs,
+             unsigned int rng_seed)
+    : _num_rows(num_rows), _num_columns(num_columns),
+      _rng(shared_ptr<PRNG>(new PRNG(rng_seed))),
+      _crp_alpha_config(vector<double>()), _view_alpha_marker(-1)
+{
+    ASSERT_EQUAL(std::cout, datatypes.size(), num_columns);
+    _feature_types = helpers::getDatatypes(datatypes);
+    _features = helpers::genFeatures(X, num_rows, row_stride, column_stride, datatypes,
+                                     distargs, _rng.get());
+
+    __initFromPrior();
+}
+
+
+State::State(const double *X, size_t num_rows, size_t num_columns, size_t row_stride,
+             size_t column_stride, vector<string> datatypes, vector<vector<double>> distargs,
+             unsigned int rng_seed, vector<size_t> Zv, vector<vector<size_t>> Zrcv,
+             double state_alpha, vector<double> view_alphas,
+             vector<map<string, double>> hypers_maps)
+    : _num_rows(num_rows), _num_columns(num_columns),
+      _rng(shared_ptr<PRNG>(new PRNG(rng_seed))),
+      _crp_alpha_config(vector<double>()), _view_alpha_marker(-1)
+{
+    ASSERT_EQUAL(std::cout, datatypes.size(), num_columns);
+    _feature_types = helpers::getDatatypes(datatypes);
+    _features = helpers::genFeatures(X, num_rows, row_stride, column_stride, datatypes,
+                                     distargs, _rng.get());
 
+    __initFromPartition(std::move(Zv), Zrcv, state_alpha, view_alphas, hypers_maps);
+}
+
+
+State::State(shared_ptr<ColumnFile> file, vector<string> datatypes,
+             vector<vector<double>> distargs, unsigned int rng_seed)
+    : State(file->data(), file->numRows(), file->numColumns(), 1, file->numRows(),
+            datatypes, distargs, rng_seed)
+{
+    _column_file = file;
+}
+
+
+State::State(shared_ptr<ColumnFile> file, vector<string> datatypes,
+             vector<vector<double>> distargs, unsigned int rng_seed, vector<size_t> Zv,
+             vector<vector<size_t>> Zrcv, double state_alpha, vector<double> view_alphas,
+             vector<map<string, double>> hypers_maps)
+    : State(file->data(), file->numRows(), file->numColumns(), 1, file->numRows(),
+            datatypes, distargs, rng_seed, std::move(Zv), std::move(Zrcv), state_alpha,
+            std::move(view_alphas), std::move(hypers_maps))
+{
+    _column_file = file;
+}
+
+
+void State::__initFromPrior()
+{
     if (_crp_alpha_config.empty()){
         _crp_alpha_config.resize(2);
         _crp_alpha_config[0] = 1;
@@ -46,19 +128,11 @@ State::State(vector<vector<double>> X, vector<string> datatypes,
 }
 
 
-State::State(vector<vector<double>> X, vector<string> datatypes,
-             vector<vector<double>> distargs, unsigned int rng_seed,
-             vector<size_t> Zv, vector<vector<size_t>> Zrcv,
-             double state_alpha, vector<double> view_alphas,
-             vector<map<string, double>> hypers_maps)
-    : _column_assignment(Zv), _rng(shared_ptr<PRNG>(new PRNG(rng_seed))),
-      _crp_alpha_config(vector<double>()), _view_alpha_marker(-1)
+void State::__initFromPartition(vector<size_t> Zv, const vector<vector<size_t>> &Zrcv,
+                                double state_alpha, const vector<double> &view_alphas,
+                                const vector<map<string, double>> &hypers_maps)
 {
-    _num_columns = X.size();
-    _num_rows = X[0].size();
-
-    _feature_types = helpers::getDatatypes(datatypes);
-    _features = helpers::genFeatures(X, datatypes, distargs, _rng.get());
+    _column_assignment = std::move(Zv);
 
     if (_crp_alpha_config.empty()){
         _crp_alpha_config.resize(2);
@@ -153,150 +227,276 @@ State::State(size_t num_rows, vector<string> datatypes, vector<vector<double>> d
 // probability
 //`````````````````````````````````````````````````````````````````````````````````````````````````
 // TODO: dependent queries
-vector<double> State::predictiveLogp(vector<vector<size_t>> query_indices,
-                                     vector<double> query_values,
-                                     vector<vector<size_t>> constraint_indices,
-                                     vector<double> constraint_values)
+vector<double> State::predictiveLogp(const vector<vector<size_t>> &query_indices,
+                                     const vector<double> &query_values,
+                                     const vector<vector<size_t>> &constraint_indices,
+                                     const vector<double> &constraint_values) const
 {
-    size_t n_queries = query_indices.size();
+    const size_t n_queries = query_indices.size();
 
-    // insert all the constraint values
-    if(not constraint_indices.empty())
-        __insertConstraints(constraint_indices, constraint_values);
+    if(query_values.size() != n_queries)
+        throw std::invalid_argument("need one value for each query");
+    __checkPredictiveArgs(query_indices, constraint_indices, constraint_values);
 
-    // do probabilities
+    ObservedConstraints observed;
+    map<size_t, RowConstraints> new_row_constraints;
+    __splitConstraints(constraint_indices, constraint_values, observed, new_row_constraints);
+
+    const RowConstraints no_constraints;
     vector<double> logps(n_queries, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
     for(size_t q = 0; q < n_queries; ++q){
         auto row = query_indices[q][0];
         auto col = query_indices[q][1];
-        auto val = query_values[q];
-        double logp;
+        auto it = new_row_constraints.find(row);
+        const auto &given = (it == new_row_constraints.end()) ? no_constraints : it->second;
+        logps[q] = __predictiveLogp(row, col, query_values[q], observed, given);
+    }
+
+    return logps;
+}
+
+
+vector<double> State::predictiveLogpBatch(
+    const vector<vector<size_t>> &query_indices, const vector<double> &query_values,
+    const vector<vector<vector<size_t>>> &constraint_indices,
+    const vector<vector<double>> &constraint_values) const
+{
+    const size_t n_queries = query_indices.size();
+    const bool has_constraints = not constraint_values.empty() or not constraint_indices.empty();
+
+    if(query_values.size() != n_queries)
+        throw std::invalid_argument("need one value for each query");
+    if(has_constraints){
+        if(constraint_indices.size() != n_queries or constraint_values.size() != n_queries)
+            throw std::invalid_argument("need a list of constraints for each query");
+        for(size_t q = 0; q < n_queries; ++q)
+            __checkPredictiveArgs({}, constraint_indices[q], constraint_values[q]);
+    }
+    __checkPredictiveArgs(query_indices, {}, {});
+
+    vector<double> logps(n_queries, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for(size_t q = 0; q < n_queries; ++q){
+        auto row = query_indices[q][0];
+        auto col = query_indices[q][1];
+        ObservedConstraints observed;
+        map<size_t, RowConstraints> new_row_constraints;
+        if(has_constraints)
+            __splitConstraints(constraint_indices[q], constraint_values[q], observed,
+                               new_row_constraints);
+        logps[q] = __predictiveLogp(row, col, query_values[q], observed,
+                                    new_row_constraints[row]);
+    }
+
+    return logps;
+}
+
+
+void State::__checkPredictiveArgs(const vector<vector<size_t>> &query_indices,
+                                  const vector<vector<size_t>> &constraint_indices,
+                                  const vector<double> &constraint_values) const
+{
+    if(constraint_values.size() != constraint_indices.size())
+        throw std::invalid_argument("need one value for each constraint");
+
+    auto check = [this](const vector<size_t> &index){
+        if(index.size() != 2)
+            throw std::invalid_argument("each index must be a (row, column) pair");
+        if(index[1] >= _num_columns)
+            throw std::invalid_argument("column past the number of columns");
+    };
+    for(auto &index : query_indices)
+        check(index);
+    for(auto &index : constraint_indices)
+        check(index);
+}
+
+
+// A constraint on an observed row is overlaid on its row's cluster in its column. The
+// constraints on a new row weight the clusters that row is drawn or scored from.
+void State::__splitConstraints(const vector<vector<size_t>> &constraint_indices,
+                               const vector<double> &constraint_values,
+                               ObservedConstraints &observed,
+                               map<size_t, RowConstraints> &new_row_constraints) const
+{
+    for(size_t i = 0; i < constraint_values.size(); ++i){
+        auto row = constraint_indices[i][0];
+        auto col = constraint_indices[i][1];
         if(row < _num_rows){
-            logp = __doPredictiveLogpObserved(row, col, val);
+            auto view = _column_assignment[col];
+            observed[col].emplace_back(_views[view].getAssignmentOfRow(row),
+                                       constraint_values[i]);
         }else{
-            logp = __doPredictiveLogpUnobserved(col, val);
+            new_row_constraints[row].emplace_back(col, constraint_values[i]);
         }
-        logps[q] = logp;
     }
+}
 
-    // clean up
-    if(not constraint_indices.empty())
-        __removeConstraints(constraint_indices, constraint_values);
 
-    return logps;
+const vector<double> &State::__gatherConstraints(const ObservedConstraints &observed,
+                                                 size_t col, size_t cluster,
+                                                 vector<double> &given) const
+{
+    given.clear();
+    auto it = observed.find(col);
+    if(it != observed.end())
+        for(auto &constraint : it->second)
+            if(constraint.first == cluster)
+                given.push_back(constraint.second);
+    return given;
 }
 
 
-double State::__doPredictiveLogpObserved(size_t row, size_t col, double val)
+vector<double> State::__newRowLogWeights(size_t view, const RowConstraints &given,
+                                         const ObservedConstraints &observed) const
 {
-    auto type = _feature_types[col];
-    auto view = _column_assignment[col];
-    auto cluster_idx = _views[view].getAssignmentOfRow(row);
-    if(helpers::is_discrete(type)){
-        size_t casted_value = size_t(val);
-        return _features[col].get()->valueLogp(casted_value, cluster_idx);
-    }else{
-        return _features[col].get()->valueLogp(val, cluster_idx);
+    const size_t num_clusters = _views[view].getNumCategories();
+    const auto &counts = _views[view].getClusterCounts();
+
+    vector<double> log_weights(num_clusters+1, 0);
+    for(size_t k = 0; k < num_clusters; ++k)
+        log_weights[k] = log(double(counts[k]));
+    log_weights[num_clusters] = log(_views[view].getCRPAlpha());
+
+    vector<double> cluster_given;
+    for(auto &constraint : given){
+        auto col = constraint.first;
+        if(_column_assignment[col] != view)
+            continue;
+        auto feature = _features[col].get();
+        for(size_t k = 0; k < num_clusters; ++k)
+            log_weights[k] += feature->valueLogpGiven(
+                constraint.second, k, __gatherConstraints(observed, col, k, cluster_given));
+        log_weights[num_clusters] += feature->singletonValueLogp(constraint.second);
     }
+
+    return log_weights;
 }
 
 
-double State::__doPredictiveLogpUnobserved(size_t col, double val)
+double State::__predictiveLogp(size_t row, size_t col, double val,
+                               const ObservedConstraints &observed,
+                               const RowConstraints &given_row) const
 {
-    auto type = _feature_types[col];
+    auto feature = _features[col].get();
     auto view = _column_assignment[col];
-    auto crp_alpha = _views[view].getCRPAlpha();
-    auto num_categories = _views[view].getNumCategories();
-    auto category_counts = _views[view].getClusterCounts();
-
-    vector<double> logps(num_categories+1, 0);
-
-    double crp_denom = double(_num_rows+1) + crp_alpha;
-    double log_weight;
-    // iterate through clusters
-    for(size_t k = 0; k < num_categories; ++k){
-        log_weight = log(double(category_counts[k])/crp_denom);
-        if(helpers::is_discrete(type)){
-            size_t casted_value = size_t(val);
-            logps[k] = _features[col].get()->valueLogp(casted_value, k)+log_weight;
-        }else{
-            logps[k] = _features[col].get()->valueLogp(val, k)+log_weight;
-        }
+
+    vector<double> given;
+    if(row < _num_rows){
+        auto cluster_idx = _views[view].getAssignmentOfRow(row);
+        return feature->valueLogpGiven(val, cluster_idx,
+                                       __gatherConstraints(observed, col, cluster_idx, given));
     }
 
-    log_weight = log(crp_alpha/crp_denom);
+    // score val under the clusters of the new row, weighted as in __doPredictiveDrawUnobserved
+    auto log_weights = __newRowLogWeights(view, given_row, observed);
+    const size_t num_clusters = log_weights.size()-1;
 
-    if(helpers::is_discrete(type)){
-        // FIXME: variable casting
-        size_t casted_value = size_t(val);
-        logps[num_categories] = _features[col].get()->singletonValueLogp(casted_value)+log_weight;
-    }else{
-        logps[num_categories] = _features[col].get()->singletonValueLogp(val)+log_weight;
+    vector<double> logps(num_clusters+1, 0);
+    for(size_t k = 0; k < num_clusters; ++k){
+        logps[k] = feature->valueLogpGiven(val, k, __gatherConstraints(observed, col, k, given))
+                   + log_weights[k];
     }
+    logps[num_clusters] = feature->singletonValueLogp(val)+log_weights[num_clusters];
 
-    return numerics::logsumexp(logps);
+    return numerics::logsumexp(logps)-numerics::logsumexp(log_weights);
 }
 
 
-// sample (NOT REFACTORED)
+// sample
 //`````````````````````````````````````````````````````````````````````````````````````````````````
-vector<vector<double>> State::predictiveDraw(vector<vector<size_t>> query_indices,
-                                             vector<vector<size_t>> constraint_indices,
-                                             vector<double> constraint_values, size_t N)
+vector<vector<double>> State::predictiveDraw(const vector<vector<size_t>> &query_indices,
+                                             const vector<vector<size_t>> &constraint_indices,
+                                             const vector<double> &constraint_values,
+                                             size_t N) const
 {
     size_t n_queries = query_indices.size();
 
+    __checkPredictiveArgs(query_indices, constraint_indices, constraint_values);
+
     // allocate the output vector
     vector<vector<double>> samples(N, vector<double>(n_queries, 0));
 
-    // insert all the constraint values
-    if(constraint_indices.size() > 0)
-        __insertConstraints(constraint_indices, constraint_values);
+    // Constraints on observed rows are overlaid on their clusters. Constraints on new rows
+    // condition the joint draw of that row.
+    ObservedConstraints observed;
+    map<size_t, RowConstraints> new_row_constraints;
+    __splitConstraints(constraint_indices, constraint_values, observed, new_row_constraints);
 
+    // observed queries draw from their row's cluster. Unobserved queries are grouped by new row
+    // and view; each group shares one cluster draw per sample.
+    map<std::pair<size_t, size_t>, vector<size_t>> groups;
+    vector<double> given;
     for(size_t q = 0; q < n_queries; ++q){
         auto row = query_indices[q][0];
         auto col = query_indices[q][1];
-        bool is_observed = (row < _num_rows);
-        for(size_t n = 0; n < N; ++n){
-            double sample;
-            if(is_observed){
-                sample = __doPredictiveDrawObserved(row, col);
-            }else{
-                // we have to do this relative to the other queries
-                sample = __doPredictiveDrawUnobserved(col);
-            }
-            samples[n][q] = sample;
+        if(row < _num_rows){
+            auto cluster_idx = _views[_column_assignment[col]].getAssignmentOfRow(row);
+            __gatherConstraints(observed, col, cluster_idx, given);
+            auto feature = _features[col].get();
+            for(size_t n = 0; n < N; ++n)
+                samples[n][q] = feature->drawFromClusterGiven(cluster_idx, given, _rng.get());
+        }else{
+            groups[{row, _column_assignment[col]}].push_back(q);
         }
     }
 
-    // clean up
-    if(constraint_indices.size() > 0)
-        __removeConstraints(constraint_indices, constraint_values);
+    vector<std::pair<std::pair<size_t, size_t>, vector<size_t>>> group_list(groups.begin(),
+                                                                            groups.end());
+    const RowConstraints no_constraints;
+    const uint64_t key = _rng.get()->drawKey();
+
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t g = 0; g < group_list.size(); ++g){
+        PRNG::ScopedStream stream(*_rng.get(), {key, g});
+        auto row = group_list[g].first.first;
+        auto view = group_list[g].first.second;
+        auto it = new_row_constraints.find(row);
+        const auto &row_given = (it == new_row_constraints.end()) ? no_constraints : it->second;
+        __doPredictiveDrawUnobserved(view, query_indices, group_list[g].second, row_given,
+                                     observed, samples);
+    }
 
     return samples;
 }
 
 
-double  State::__doPredictiveDrawObserved(size_t row, size_t col)
+void State::__doPredictiveDrawUnobserved(size_t view,
+                                         const vector<vector<size_t>> &query_indices,
+                                         const vector<size_t> &queries,
+                                         const RowConstraints &given,
+                                         const ObservedConstraints &observed,
+                                         vector<vector<double>> &samples) const
 {
-    auto view = _column_assignment[col];
-    auto cluster_idx = _views[view].getAssignmentOfRow(row);
-    double draw = _features[col].get()->drawFromCluster(cluster_idx, _rng.get());
-    return draw;
-}
+    // the CRP weight of each cluster (the last is a new cluster) times the likelihood of the
+    // given values in this view
+    auto log_weights = __newRowLogWeights(view, given, observed);
+    const size_t num_clusters = log_weights.size()-1;
 
-
-// FIXME: implement
-double  State::__doPredictiveDrawUnobserved(size_t col)
-{
-    return -1.*double(col+.5);
+    auto rng = _rng.get();
+    vector<double> cluster_given;
+    for(size_t n = 0; n < samples.size(); ++n){
+        size_t k = rng->lpflip(log_weights);
+        for(auto q : queries){
+            auto col = query_indices[q][1];
+            auto feature = _features[col].get();
+            if(k < num_clusters){
+                __gatherConstraints(observed, col, k, cluster_given);
+                samples[n][q] = feature->drawFromClusterGiven(k, cluster_given, rng);
+            }else{
+                samples[n][q] = feature->drawFromSingleton(rng);
+            }
+        }
+    }
 }
 
 
 // Transition helpers
 //`````````````````````````````````````````````````````````````````````````````````````````````````
 void State::transition(vector< string > which_transitions, vector<size_t> which_rows,
-                       vector<size_t> which_cols, size_t which_kernel, int N, size_t m)
+                       vector<size_t> which_cols, size_t which_kernel, int N, size_t m,
+                       size_t which_row_kernel)
 {
     // conver strings to transitions
     vector<transition_type> t_list;
@@ -313,18 +513,19 @@ void State::transition(vector< string > which_transitions, vector<size_t> which_
             t_list = _rng.get()->shuffle(t_list);
 
         for( auto transition: t_list)
-            __doTransition(transition, which_rows, which_cols, which_kernel, m);
+            __doTransition(transition, which_rows, which_cols, which_kernel, m,
+                           which_row_kernel);
     }
 }
 
 
 void State::__doTransition(transition_type t, vector<size_t> which_rows, vector<size_t> which_cols,
-                           size_t which_kernel, size_t m)
+                           size_t which_kernel, size_t m, size_t which_row_kernel)
 {
     switch(t){
         case transition_type::row_assignment:
             // std::cout << "Doing row_z" << std::endl;
-            __transitionRowAssignments(which_rows);
+            __transitionRowAssignments(which_rows, which_row_kernel);
             break;
         case transition_type::column_assignment:
             // std::cout << "Doing col_z" << std::endl;
@@ -385,32 +586,68 @@ void State::__transitionViewCRPAlphas()
 }
 
 
+// The parallel loops below give each task its own keyed stream (see PRNG::ScopedStream), so the
+// draws do not depend on the number of threads.
 void State::__transitionColumnHypers(vector<size_t> which_cols)
 {
+    const uint64_t key = _rng.get()->drawKey();
     if(which_cols.empty()){
         #pragma omp parallel for schedule(static)
-        for(size_t i = 0; i < _num_columns; i++)
+        for(size_t i = 0; i < _num_columns; i++){
+            PRNG::ScopedStream stream(*_rng.get(), {key, i});
             _features[i].get()->updateHypers();
+        }
     }else{
         #pragma omp parallel for schedule(static)
         for(size_t i = 0; i < which_cols.size(); ++i){
             auto col = which_cols[i];
+            PRNG::ScopedStream stream(*_rng.get(), {key, col});
             _features[col].get()->updateHypers();
         }
     }
 }
 
 
-void State::__transitionRowAssignments(vector<size_t> which_rows)
+void State::__transitionRowAssignments(vector<size_t> which_rows, size_t which_row_kernel)
 {
-    #pragma omp parallel for schedule(static)
-    for(size_t v = 0; v < _num_views; ++v){
-        if( which_rows.empty() ){
-            _views[v].transitionRows();
-        }else{
-            for(auto r : which_rows)
-                _views[v].transitionRow(r);
+    // sweep mapped data in file order
+    if(which_rows.empty() and _column_file){
+        which_rows.resize(_num_rows);
+        for(size_t r = 0; r < _num_rows; ++r)
+            which_rows[r] = r;
+    }
+
+    if(which_row_kernel == 0 or which_row_kernel == 2){
+        const uint64_t key = _rng.get()->drawKey();
+        #pragma omp parallel for schedule(static)
+        for(size_t v = 0; v < _num_views; ++v){
+            PRNG::ScopedStream stream(*_rng.get(), {key, v});
+            if( which_rows.empty() ){
+                _views[v].transitionRows(which_row_kernel);
+            }else{
+                _views[v].transitionRows(which_rows, which_row_kernel);
+            }
+        }
+
+        // collect the stats before column transitions can destroy views
+        if(which_row_kernel == 2){
+            for(auto &view : _views){
+                for(auto &stat : view.getSplitMergeStats())
+                    _split_merge_stats[stat.first] += stat.second;
+                view.clearSplitMergeStats();
+            }
+        }
+    }else if(which_row_kernel == 1){
+        // the view parallelizes internally
+        for(size_t v = 0; v < _num_views; ++v){
+            if( which_rows.empty() ){
+                _views[v].transitionRows(which_row_kernel);
+            }else{
+                _views[v].transitionRows(which_rows, which_row_kernel);
+            }
         }
+    }else{
+        throw std::invalid_argument("which_row_kernel must be 0, 1, or 2");
     }
 }
 
@@ -428,24 +665,96 @@ void State::__transitionColumnAssignment(vector<size_t> which_cols, size_t which
         which_cols = _rng.get()->shuffle(which_cols);
     }
 
+    if(which_kernel > 2)
+        throw std::invalid_argument("which_kernel must be 0, 1, or 2");
+
+    if(_precompute_column_logps)
+        __precomputeColumnLogps(which_cols);
+
     if(which_kernel == 0){
         for(auto col : which_cols)
             __transitionColumnAssignmentGibbs(col, m);
     }else if(which_kernel == 1){
+        __precomputeBootstrapProposals(which_cols, m);
         for(auto col : which_cols)
             __transitionColumnAssignmentGibbsBootstrap(col, m);
     }else if(which_kernel == 2){
         for(auto col : which_cols)
             __transitionColumnAssignmentEnumeration(col);
-    }else{
-        // FIXME: proper exception
-        throw 1;
+    }
+
+    _column_view_logps.clear();
+    _is_view_precomputed.clear();
+
+    __compactViews();
+}
+
+
+// Column moves never change a view's row partition, so the logp of a column under a view that
+// exists at the start of the transition is the same whenever the column visits it. Those are all
+// computed here at once, in parallel over (column, view) pairs. The sequential moves that follow
+// then only score views created during the transition, so the chain is unchanged.
+void State::__precomputeColumnLogps(const vector<size_t> &which_cols)
+{
+    const size_t num_cols = which_cols.size();
+    const size_t num_views = _num_views;
+
+    _column_view_logps.assign(_num_columns, vector<double>());
+    for(auto col : which_cols)
+        _column_view_logps[col].assign(num_views, -INFINITY);
+
+    _is_view_precomputed.assign(num_views, true);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t p = 0; p < num_cols*num_views; ++p){
+        size_t col = which_cols[p/num_views];
+        size_t v = p % num_views;
+        if(_view_counts[v] == 0)
+            continue;
+        const View &view = _views[v];
+        _column_view_logps[col][v] = _features[col].get()->assignmentLogp(
+            view.getRowAssignments(), view.getNumCategories());
     }
 }
 
 
 // column transition kernels
 // ````````````````````````````````````````````````````````````````````````````````````````````````
+// Scores the column under each view's row partition without reassigning it, so the views can be
+// scored in parallel and the feature keeps its current clusters.
+vector<double> State::__columnLogpsUnderViews(size_t col, const vector<double> &log_crps) const
+{
+    auto feature = _features[col].get();
+
+    vector<double> logps(_num_views, -INFINITY);
+
+    const bool has_precomputed = col < _column_view_logps.size() and
+                                 not _column_view_logps[col].empty();
+
+    vector<size_t> to_score;
+    for(size_t v = 0; v < _num_views; ++v){
+        // empty view slots are never drawn
+        if(_view_counts[v] == 0)
+            continue;
+        if(has_precomputed and v < _is_view_precomputed.size() and _is_view_precomputed[v]){
+            logps[v] = _column_view_logps[col][v] + log_crps[v];
+        }else{
+            to_score.push_back(v);
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic) if(to_score.size() > 1)
+    for(size_t i = 0; i < to_score.size(); ++i){
+        const View &view = _views[to_score[i]];
+        logps[to_score[i]] = feature->assignmentLogp(view.getRowAssignments(),
+                                                     view.getNumCategories());
+        logps[to_score[i]] += log_crps[to_score[i]];
+    }
+
+    return logps;
+}
+
+
 void State::__transitionColumnAssignmentGibbs(size_t col, size_t m)
 {
     // double log_crp_denom = log(double(_num_columns-1) + _crp_alpha);
@@ -465,17 +774,10 @@ void State::__transitionColumnAssignmentGibbs(size_t col, size_t m)
 
     // if (not is_singleton) log_crps.push_back(log(_crp_alpha));
 
-    // TODO: optimization: preallocate
-    vector<double> logps;
+    vector<double> logps = __columnLogpsUnderViews(col, log_crps);
 
     auto feature = _features[col];
 
-    for(size_t v = 0; v < _num_views; ++v){
-        feature.get()->reassign(_views[v].getRowAssignments());
-        double logp = feature.get()->logp()+log_crps[v];
-        logps.push_back(logp);
-    }
-
     // if this is not already a singleton view, we must propose a singleton
     if(!is_singleton){
         vector<shared_ptr<BaseFeature>> fvec = {feature};
@@ -502,11 +804,8 @@ void State::__transitionColumnAssignmentGibbs(size_t col, size_t m)
         }
     }else{
         auto view_index_new = _rng.get()->lpflip(logps);
-        if (view_index_new != view_index_current){
+        if (view_index_new != view_index_current)
             __destroySingletonView(col, view_index_current, view_index_new);
-        }else{
-            feature.get()->reassign(_views[view_index_current].getRowAssignments());
-        }
     }
 }
 
@@ -529,50 +828,111 @@ void State::__transitionColumnAssignmentGibbsBootstrap(size_t col, size_t m)
         }
     }
 
-    // TODO: optimization: preallocate
-    vector<double> logps;
-
-    auto feature = _features[col];
-
-    for(size_t v = 0; v < _num_views; ++v){
-        feature.get()->reassign(_views[v].getRowAssignments());
-        double logp = feature.get()->logp()+log_crps[v];
-        logps.push_back(logp);
-    }
+    vector<double> logps = __columnLogpsUnderViews(col, log_crps);
 
     // if this is not already a singleton view, we must propose a singleton
     if(!is_singleton){
-        // TODO: optimization: do this (cache) for each column in parallel
-        vector<shared_ptr<BaseFeature>> fvec = {feature};
-        View proposal_view(fvec, _rng.get(), _view_alpha_marker, vector<size_t>(), true);
-        for(size_t i = 0; i < m; ++i){
-            proposal_view.transitionRows();
-            if(_view_alpha_marker <= 0) proposal_view.transitionCRPAlpha();
+        // the proposal is built on a copy of the feature, so the feature itself is untouched
+        if(not __hasBootstrapProposal(col)){
+            __buildBootstrapProposal(col, m);
+            ++_bootstrap_stats["built"];
         }
-        double logp = feature.get()->logp() + log(_crp_alpha);
+
+        BootstrapProposal &proposal = _bootstrap_proposals[col];
+        double logp = proposal.logp + log(_crp_alpha);
         logps.push_back(logp);
 
         auto view_index_new = _rng.get()->lpflip(logps);
 
         if (view_index_new != view_index_current){
             if (view_index_new == _num_views){
+                // a proposal that becomes part of the state is not reused
+                vector<shared_ptr<BaseFeature>> fvec = {_features[col]};
+                vector<size_t> row_assignment(proposal.row_assignment.begin(),
+                                              proposal.row_assignment.end());
+                View proposal_view(fvec, _rng.get(), proposal.crp_alpha, row_assignment, false);
+                proposal = BootstrapProposal();
                 __createSingletonView(col, view_index_current, proposal_view);
             }else{
                 __moveFeatureToView(col, view_index_current, view_index_new);
             }
-        }else{
-            feature.get()->reassign(_views[view_index_current].getRowAssignments());
         }
     }else{
         auto view_index_new = _rng.get()->lpflip(logps);
-        if (view_index_new != view_index_current){
+        if (view_index_new != view_index_current)
             __destroySingletonView(col, view_index_current, view_index_new);
-        }else{
-            feature.get()->reassign(_views[view_index_current].getRowAssignments());
-        }
     }
 }
 
+// Singleton proposals for the bootstrap kernel depend only on the column's data and hypers, so
+// they are built for every column up front, in parallel, and kept until either changes.
+void State::__precomputeBootstrapProposals(const vector<size_t> &which_cols, size_t m)
+{
+    if(m != _bootstrap_m or _bootstrap_proposals.size() != _num_columns){
+        __clearBootstrapProposals();
+        _bootstrap_m = m;
+    }
+
+    // a column listed twice must be built once: two iterations writing the same proposal race
+    vector<size_t> cols(which_cols);
+    std::sort(cols.begin(), cols.end());
+    cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+
+    vector<size_t> stale;
+    for(auto col : cols)
+        if(not __hasBootstrapProposal(col))
+            stale.push_back(col);
+
+    _bootstrap_stats["built"] += stale.size();
+    _bootstrap_stats["reused"] += cols.size()-stale.size();
+
+    const uint64_t key = _rng.get()->drawKey();
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t i = 0; i < stale.size(); ++i){
+        PRNG::ScopedStream stream(*_rng.get(), {key, stale[i]});
+        __buildBootstrapProposal(stale[i], m);
+    }
+}
+
+
+// The proposal is swept on a copy of the feature, so the feature itself is untouched. The copy
+// and the view are freed on return.
+void State::__buildBootstrapProposal(size_t col, size_t m)
+{
+    vector<shared_ptr<BaseFeature>> fvec = {_features[col].get()->clone()};
+    View proposal_view(fvec, _rng.get(), _view_alpha_marker, vector<size_t>(), true);
+    for(size_t i = 0; i < m; ++i){
+        proposal_view.transitionRows();
+        if(_view_alpha_marker <= 0) proposal_view.transitionCRPAlpha();
+    }
+
+    // cluster labels are below the number of rows
+    ASSERT(std::cout, _num_rows <= std::numeric_limits<uint32_t>::max());
+    auto row_assignment = proposal_view.getRowAssignments();
+
+    BootstrapProposal &proposal = _bootstrap_proposals[col];
+    proposal.is_built = true;
+    proposal.row_assignment.assign(row_assignment.begin(), row_assignment.end());
+    proposal.crp_alpha = proposal_view.getCRPAlpha();
+    proposal.logp = fvec[0].get()->logp();
+    proposal.hypers = fvec[0].get()->getHypers();
+}
+
+
+bool State::__hasBootstrapProposal(size_t col) const
+{
+    if(_bootstrap_proposals.size() != _num_columns or not _bootstrap_proposals[col].is_built)
+        return false;
+
+    return _bootstrap_proposals[col].hypers == _features[col].get()->getHypers();
+}
+
+
+void State::__clearBootstrapProposals()
+{
+    _bootstrap_proposals.assign(_num_columns, BootstrapProposal());
+}
+
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 void State::__transitionColumnAssignmentEnumeration(size_t col)
 {
@@ -590,17 +950,10 @@ void State::__transitionColumnAssignmentEnumeration(size_t col)
         }
     }
 
-    // TODO: optimization: preallocate
-    vector<double> logps;
+    vector<double> logps = __columnLogpsUnderViews(col, log_crps);
 
     auto feature = _features[col];
 
-    for(size_t v = 0; v < _num_views; ++v){
-        feature.get()->reassign(_views[v].getRowAssignments());
-        double logp = feature.get()->logp()+log_crps[v];
-        logps.push_back(logp);
-    }
-
     // if this is not already a singleton view, we must propose a singleton
     if(!is_singleton){
         auto n = _num_rows;
@@ -649,17 +1002,16 @@ void State::__transitionColumnAssignmentEnumeration(size_t col)
         }
     }else{
         auto view_index_new = _rng.get()->lpflip(logps);
-        if (view_index_new != view_index_current){
+        if (view_index_new != view_index_current)
             __destroySingletonView(col, view_index_current, view_index_new);
-        }else{
-            feature.get()->reassign(_views[view_index_current].getRowAssignments());
-        }
     }
 }
 
 
 // Cleanup
 //`````````````````````````````````````````````````````````````````````````````````````````````````
+// Destroyed views stay in _views as empty slots until __compactViews, so destroying and creating
+// singleton views does not relabel the columns or shift the other views.
 void State::__destroySingletonView(size_t feat_idx, size_t to_destroy, size_t move_to)
 {
     ASSERT(std::cout, to_destroy < _num_views);
@@ -668,17 +1020,12 @@ void State::__destroySingletonView(size_t feat_idx, size_t to_destroy, size_t mo
     _column_assignment[feat_idx] = move_to;
     _views[to_destroy].releaseFeature(feat_idx);
 
-    for(size_t i = 0; i < _num_columns; ++i)
-        _column_assignment[i] -= (_column_assignment[i] > to_destroy) ? 1 : 0;
-
     _views[move_to].assimilateFeature(_features[feat_idx]);
 
     ++_view_counts[move_to];
 
-    _view_counts.erase(_view_counts.begin()+to_destroy);
-    _views.erase(_views.begin()+to_destroy);
-
-    --_num_views;
+    _view_counts[to_destroy] = 0;
+    _free_views.push_back(to_destroy);
 
     ASSERT_EQUAL(std::cout, _views.size(), _num_views);
 }
@@ -695,23 +1042,68 @@ void State::__createSingletonView(size_t feat_idx, size_t current_view_index, Vi
 {
     ASSERT(std::cout, current_view_index < _num_views);
 
-    _column_assignment[feat_idx] = _num_views;
     _features[feat_idx].get()->reassign(proposal_view.getRowAssignments());
     _views[current_view_index].releaseFeature(feat_idx);
 
     --_view_counts[current_view_index];
 
-    _view_counts.push_back(1);
-    _views.push_back(proposal_view);
-
-    ++_num_views;
+    if(_free_views.empty()){
+        _column_assignment[feat_idx] = _num_views;
+        _view_counts.push_back(1);
+        _views.push_back(proposal_view);
+        ++_num_views;
+    }else{
+        size_t slot = _free_views.back();
+        _free_views.pop_back();
+        _column_assignment[feat_idx] = slot;
+        _view_counts[slot] = 1;
+        _views[slot] = proposal_view;
+        // the precomputed logps are for the view that used to be in this slot
+        if(slot < _is_view_precomputed.size())
+            _is_view_precomputed[slot] = false;
+    }
 
     ASSERT_EQUAL(std::cout, _views.size(), _num_views);
-    ASSERT_EQUAL(std::cout, _view_counts.back(), 1);
     ASSERT_EQUAL(std::cout, proposal_view.getNumFeatures(), 1);
 }
 
 
+void State::__compactViews()
+{
+    if(_free_views.empty())
+        return;
+
+    std::sort(_free_views.begin(), _free_views.end());
+
+    // new_label[v] is the dense label of slot v; the live views keep their order
+    vector<size_t> new_label(_num_views, 0);
+    size_t j = 0;
+    size_t v_new = 0;
+    for(size_t v = 0; v < _num_views; ++v){
+        if(j < _free_views.size() and _free_views[j] == v){
+            ++j;
+            continue;
+        }
+        new_label[v] = v_new;
+        if(v_new != v){
+            _views[v_new] = std::move(_views[v]);
+            _view_counts[v_new] = _view_counts[v];
+        }
+        ++v_new;
+    }
+    _num_views = v_new;
+    _views.erase(_views.begin()+_num_views, _views.end());
+    _view_counts.resize(_num_views);
+
+    for(auto &z : _column_assignment)
+        z = new_label[z];
+
+    _free_views.clear();
+
+    ASSERT_EQUAL(std::cout, _views.size(), _num_views);
+}
+
+
 void State::__moveFeatureToView(size_t feat_idx, size_t move_from, size_t move_to)
 {
     ASSERT(std::cout, move_from < _num_views);
@@ -731,54 +1123,11 @@ void State::__moveFeatureToView(size_t feat_idx, size_t move_from, size_t move_t
 }
 
 
-// add/remove constraint_values
-//`````````````````````````````````````````````````````````````````````````````````````````````````
-void State::__insertConstraints(vector<vector<size_t>> indices, vector<double> values)
-{
-    size_t n_constraints = values.size();
-    for(size_t i = 0; i < n_constraints; ++i){
-        auto row = indices[i][0];
-        auto col = indices[i][1];
-        auto view = _column_assignment[col];
-        auto cluster_idx = _views[view].getAssignmentOfRow(row);
-        auto type = _feature_types[col];
-        // do cast and insert
-        if(helpers::is_discrete(type)){
-            // FIXME: add casting to different types
-            size_t casted_value = size_t(values[i]);
-            _features[col].get()->insertValue(casted_value, cluster_idx);
-        }else{
-            _features[col].get()->insertValue(values[i], cluster_idx);
-        }
-    }
-}
-
-
-void State::__removeConstraints(vector<vector<size_t>> indices, vector<double> values)
-{
-    size_t n_constraints = values.size();
-    for(size_t i = 0; i < n_constraints; ++i){
-        auto row = indices[i][0];
-        auto col = indices[i][1];
-        auto view = _column_assignment[col];
-        auto cluster_idx = _views[view].getAssignmentOfRow(row);
-        auto type = _feature_types[col];
-        // do cast and remove
-        if(helpers::is_discrete(type)){
-            // FIXME: add casting to different types
-            size_t casted_value = size_t(values[i]);
-            _features[col].get()->removeValue(casted_value, cluster_idx);
-        }else{
-            _features[col].get()->removeValue(values[i], cluster_idx);
-        }
-    }
-}
-
-
 //append
 //`````````````````````````````````````````````````````````````````````````````````````````````````
 void State::appendRow(std::vector<double> data_row, bool assign_to_max_p_cluster)
 {
+    __clearBootstrapProposals();
     for(auto &view : _views){
         auto feature_indices = view.getFeatureIndices();
         vector<double> data;
@@ -789,13 +1138,16 @@ void State::appendRow(std::vector<double> data_row, bool assign_to_max_p_cluster
         }
         view.appendRow(data, indices, assign_to_max_p_cluster);
     }
+    ++_num_rows;
 }
 
 
 void State::popRow()
 {
+    __clearBootstrapProposals();
     for(auto &view : _views)
         view.popRow();
+    --_num_rows;
 }
 
 
@@ -885,6 +1237,34 @@ vector<vector<size_t>> State::getViewCounts() const
     return counts;
 }
 
+
+map<string, size_t> State::getCacheStats() const
+{
+    map<string, size_t> stats = {{"hits", 0}, {"misses", 0}};
+    for(auto &feature : _features){
+        auto feature_stats = feature.get()->getCacheStats();
+        stats["hits"] += feature_stats["hits"];
+        stats["misses"] += feature_stats["misses"];
+    }
+
+    return stats;
+}
+
+map<string, size_t> State::getSplitMergeStats() const
+{
+    map<string, size_t> stats = {{"split_proposals", 0}, {"split_accepts", 0},
+                                 {"merge_proposals", 0}, {"merge_accepts", 0}};
+    for(auto &stat : _split_merge_stats)
+        stats[stat.first] += stat.second;
+
+    return stats;
+}
+
+map<string, size_t> State::getBootstrapStats() const
+{
+    return _bootstrap_stats;
+}
+
 double State::logScore()
 {
     double alpha_shape = _crp_alpha_config[0];
@@ -969,12 +1349,23 @@ void State::setHypers(size_t column_index, std::vector<double> hypers_vec)
     _features[column_index].get()->setHypers(hypers_vec);
 }
 
+
+void State::setSIMD(bool use_simd)
+{
+    // the cached bootstrap proposals were swept with the old kernels
+    __clearBootstrapProposals();
+    for(auto &feature : _features)
+        feature.get()->setSIMD(use_simd);
+}
+
 void State::replaceSliceData(std::vector<size_t> row_range, std::vector<size_t> col_range,
                              std::vector<std::vector<double>> new_data)
 {
     ASSERT(std::cout, row_range[1] >= row_range[0]);
     ASSERT(std::cout, col_range[1] >= col_range[0]);
 
+    __clearBootstrapProposals();
+
     for(size_t c = 0; c < col_range[1]-col_range[0]; ++c){
         size_t column_index = col_range[c];
         for(size_t r = 0; r < row_range[1]-row_range[0]; ++r){
@@ -989,6 +1380,7 @@ void State::replaceSliceData(std::vector<size_t> row_range, std::vector<size_t>
 
 void State::replaceRowData(size_t row_index, std::vector<double> new_row_data)
 {
+    __clearBootstrapProposals();
     size_t column_index = 0;
     for(auto &f : _features){
         auto view_index = _column_assignment[column_index];
@@ -1003,6 +1395,7 @@ void State::replaceRowData(size_t row_index, std::vector<double> new_row_data)
 //`````````````````````````````````````````````````````````````````````````````````````````````````
 void State::__geweke_clear()
 {
+    __clearBootstrapProposals();
     for(size_t f = 0; f < _num_columns; ++f)
         _features[f].get()->__geweke_clear();
 }
@@ -1019,6 +1412,7 @@ vector<double> State::__geweke_pullDataColumn(size_t column_index) const
 
 void State::__geweke_resampleRow(size_t which_row)
 {
+    __clearBootstrapProposals();
     for(size_t f = 0; f < _num_columns; ++f){
         size_t view_index = _column_assignment[f];
         size_t category_index = _views[view_index].getAssignmentOfRow(which_row);
@@ -1,12 +1,16 @@
 
 #include "view.hpp"
 
+#include <stdexcept>
+
 using std::vector;
 using std::function;
 using std::shared_ptr;
 
 namespace baxcat{
 
+const size_t View::FEATURE_BLOCKS;
+
 
 View::View(vector< shared_ptr<BaseFeature> > &feature_vec, PRNG *rng)
     : _rng(rng)
@@ -93,10 +97,14 @@ void View::__gibbsInit()
     double log_alpha = log(_crp_alpha);
 
     for(size_t i = 1; i < _num_rows; ++i){
-        vector<double> logps(_num_clusters+1);
+        vector<double> logps(_num_clusters+1, 0);
         size_t row = rows[i];
+        // row is not in any cluster yet, so no cluster is scored with it removed
+        for(auto &f : _features)
+            f.get()->addElementLogps(row, _num_clusters, logps);
+
         for(size_t k = 0; k < _num_clusters; ++k)
-            logps[k] = rowLogp(row, k, true)+log(static_cast<double>(_cluster_counts[k]));
+            logps[k] += log(static_cast<double>(_cluster_counts[k]));
         
         logps.back() = rowSingletonLogp(row) + log_alpha;
 
@@ -142,17 +150,32 @@ void View::transitionCRPAlpha()
 
 // row transitions
 // ````````````````````````````````````````````````````````````````````````````````````````````````
-void View::transitionRows()
+void View::transitionRows(size_t which_kernel)
 {
-    // TODO: Parallel split-merge sampling
     vector<size_t> rows(_num_rows, 0);
     for(size_t r = 0; r < _num_rows; r++)
         rows[r] = r;
 
     rows = _rng->shuffle(rows);
 
-    for(auto row: rows)
-        transitionRow(row);
+    transitionRows(rows, which_kernel);
+}
+
+
+void View::transitionRows(const vector<size_t> &rows, size_t which_kernel)
+{
+    if(which_kernel == 0){
+        for(auto row: rows)
+            __transitionRow(row);
+    }else if(which_kernel == 1){
+        __transitionRowsFeatureParallel(rows);
+    }else if(which_kernel == 2){
+        __transitionRowsSplitMerge(rows);
+    }else{
+        throw std::invalid_argument("which_kernel must be 0, 1, or 2");
+    }
+
+    __compactClusters();
 
     ASSERT(std::cout, checkPartitions()==1);
 }
@@ -160,9 +183,15 @@ void View::transitionRows()
 
 void View::transitionRow(size_t row, bool assign_to_max_p_cluster)
 {
-    // double log_crp_denom = log(double(_num_rows-1) + _crp_alpha);
-    double log_alpha = log(_crp_alpha);
+    __transitionRow(row, assign_to_max_p_cluster);
+    __compactClusters();
+}
 
+
+// Clusters destroyed here leave empty slots (count zero) behind, so logps may have entries for
+// them. Their CRP term is log(0) and they are never drawn.
+void View::__transitionRow(size_t row, bool assign_to_max_p_cluster)
+{
     size_t assign_start = _row_assignment[row];
     bool is_singleton = (_cluster_counts[assign_start] == 1);
 
@@ -175,9 +204,31 @@ void View::transitionRow(size_t row, bool assign_to_max_p_cluster)
     }
 
     // TODO: add m argument for extra auxiliary  parameters
-    // get the probability of this row under each category
+    // get the probability of this row under each category. Each feature scores every cluster in
+    // one call, which is equivalent to calling rowLogp for each k up to rounding. The scores are
+    // not bit-identical with rowLogp (continuous clusters use cached Student-t constants), but
+    // at the default scalar level they are a deterministic function of the state, so a seed
+    // reproduces the chain on any machine. State::setSIMD gives that up for speed.
+    for(auto &f: _features)
+        f.get()->addElementLogps(row, assign_start, logps);
+
+    // if it's not already in a singleton, we need to propose one
+    if(!is_singleton)
+        logps.back() = rowSingletonLogp(row);
+
+    __sampleRowAssignment(row, logps, assign_to_max_p_cluster);
+}
+
+
+void View::__sampleRowAssignment(size_t row, vector<double> &logps, bool assign_to_max_p_cluster)
+{
+    // double log_crp_denom = log(double(_num_rows-1) + _crp_alpha);
+    double log_alpha = log(_crp_alpha);
+
+    size_t assign_start = _row_assignment[row];
+    bool is_singleton = (_cluster_counts[assign_start] == 1);
+
     for(size_t k = 0; k < _num_clusters; k++){
-        double lp = rowLogp(row, k);
         double log_crp_numer;
         if(k == assign_start){
             log_crp_numer = is_singleton ? log_alpha : log(double(_cluster_counts[k])-1.0);
@@ -185,14 +236,10 @@ void View::transitionRow(size_t row, bool assign_to_max_p_cluster)
             log_crp_numer = log(double(_cluster_counts[k]));
         }
 
-        lp += log_crp_numer;
-        logps[k] = lp;
-    }
-    // if it's not already in a singleton, we need to propose one
-    if(!is_singleton){
-        double lp = rowSingletonLogp(row) + log_alpha;
-        logps.back() = lp;
+        logps[k] += log_crp_numer;
     }
+    if(!is_singleton)
+        logps.back() += log_alpha;
 
     // get the new index
     size_t assign_new;
@@ -217,6 +264,285 @@ void View::transitionRow(size_t row, bool assign_to_max_p_cluster)
 }
 
 
+// The per-row work of Gibbs is dominated by scoring the row under every cluster of every feature.
+// Here the features are split into a fixed number of blocks and the threads score the row over
+// the blocks, each into its own buffer. The master sums the buffers in block order, draws, and
+// moves the row in every feature while the others wait. Moving is O(1) per feature, so only the
+// O(features*clusters) part is split. The blocks do not depend on the number of threads, so
+// neither do the logps nor the chain, which is the sequential Gibbs chain up to the order of
+// floating point sums.
+void View::__transitionRowsFeatureParallel(const vector<size_t> &rows)
+{
+    // the draws must come from the master's rng stream, which is only ours at the top level
+    if(omp_in_parallel()){
+        for(auto row: rows)
+            __transitionRow(row);
+        return;
+    }
+
+    vector<shared_ptr<BaseFeature>> features(_features.begin(), _features.end());
+    const size_t num_features = features.size();
+    const size_t num_blocks = std::min(FEATURE_BLOCKS, num_features);
+    const int num_threads = static_cast<int>(std::min<size_t>(omp_get_max_threads(),
+                                                              num_blocks));
+
+    vector<vector<double>> partial_logps(num_blocks);
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        for(auto row: rows){
+            // only the master writes the view between the barriers below
+            size_t assign_start = _row_assignment[row];
+            size_t num_clusters = _num_clusters;
+
+            // the last entry of each block holds the singleton logp. The implied barrier at the
+            // end of the loop keeps the master from summing before every block is scored.
+            #pragma omp for schedule(static)
+            for(size_t b = 0; b < num_blocks; ++b){
+                vector<double> &lp = partial_logps[b];
+                lp.assign(num_clusters+1, 0);
+                const size_t f_begin = (num_features*b)/num_blocks;
+                const size_t f_end = (num_features*(b+1))/num_blocks;
+                for(size_t i = f_begin; i < f_end; ++i){
+                    features[i].get()->addElementLogps(row, assign_start, lp);
+                    lp.back() += features[i].get()->singletonLogp(row);
+                }
+            }
+
+            #pragma omp master
+            {
+                bool is_singleton = (_cluster_counts[assign_start] == 1);
+                vector<double> logps(is_singleton ? num_clusters : num_clusters+1, 0);
+                for(size_t b = 0; b < num_blocks; ++b){
+                    for(size_t k = 0; k < num_clusters; ++k)
+                        logps[k] += partial_logps[b][k];
+                    if(!is_singleton)
+                        logps.back() += partial_logps[b].back();
+                }
+
+                __sampleRowAssignment(row, logps, false);
+            }
+            #pragma omp barrier
+        }
+    }
+}
+
+
+void View::__transitionRowsSplitMerge(const vector<size_t> &rows)
+{
+    if(rows.size() > 1){
+        size_t num_proposals = _num_clusters;
+        for(size_t i = 0; i < num_proposals; ++i)
+            __splitMerge(rows);
+    }
+
+    for(auto row: rows)
+        __transitionRow(row);
+}
+
+
+// The proposal works on the features' clusters in place and only writes the view's assignment
+// and counts once it is accepted. Rejected proposals put every row back where it was.
+void View::__splitMerge(const vector<size_t> &rows, size_t num_launch_scans)
+{
+    size_t row_i = rows[_rng->randuint(rows.size())];
+    size_t row_j = row_i;
+    while(row_j == row_i)
+        row_j = rows[_rng->randuint(rows.size())];
+
+    const size_t cluster_i = _row_assignment[row_i];
+    const size_t cluster_j = _row_assignment[row_j];
+    const bool is_split = (cluster_i == cluster_j);
+
+    // the other rows in either cluster
+    vector<size_t> S;
+    for(size_t r = 0; r < _num_rows; ++r){
+        if(r != row_i and r != row_j and
+           (_row_assignment[r] == cluster_i or _row_assignment[r] == cluster_j))
+            S.push_back(r);
+    }
+
+    // row_i is always in cluster a and row_j in cluster b. For a split, a is a new cluster.
+    double log_l_start = 0;
+    for(auto &f: _features){
+        log_l_start += f.get()->clusterLogp(cluster_i);
+        if(not is_split)
+            log_l_start += f.get()->clusterLogp(cluster_j);
+    }
+
+    // a split takes a free slot if there is one; otherwise it appends a cluster
+    const bool is_new_slot = _free_clusters.empty();
+    const size_t a = not is_split ? cluster_i : (is_new_slot ? _num_clusters : _free_clusters.back());
+    const size_t b = cluster_j;
+    if(is_split){
+        for(auto &f: _features){
+            if(is_new_slot){
+                f.get()->createSingletonCluster(row_i, cluster_i);
+            }else{
+                f.get()->moveToCluster(row_i, cluster_i, a);
+            }
+        }
+    }
+
+    // in_a[s] is true if S[s] is in cluster a. start from a uniform random launch assignment
+    vector<bool> in_a(S.size());
+    vector<bool> in_a_start(S.size());
+    double n_a = 1;
+    double n_b = 1;
+    for(size_t s = 0; s < S.size(); ++s){
+        in_a_start[s] = (_row_assignment[S[s]] == a);
+        in_a[s] = _rng->urand(0, 1) < .5;
+        if(in_a[s] and not in_a_start[s]){
+            for(auto &f: _features)
+                f.get()->moveToCluster(S[s], b, a);
+        }else if(in_a_start[s] and not in_a[s]){
+            for(auto &f: _features)
+                f.get()->moveToCluster(S[s], a, b);
+        }
+        n_a += in_a[s] ? 1 : 0;
+        n_b += in_a[s] ? 0 : 1;
+    }
+
+    for(size_t scan = 0; scan < num_launch_scans; ++scan){
+        for(size_t s = 0; s < S.size(); ++s){
+            bool is_in_a = in_a[s];
+            __restrictedGibbsStep(S[s], a, b, is_in_a, n_a, n_b);
+            in_a[s] = is_in_a;
+        }
+    }
+
+    // one more scan from the launch state. For a split it draws the proposal; for a merge it is
+    // forced back to the current split to get the reverse proposal probability.
+    double log_q = 0;
+    for(size_t s = 0; s < S.size(); ++s){
+        bool is_in_a = in_a[s];
+        log_q += __restrictedGibbsStep(S[s], a, b, is_in_a, n_a, n_b, not is_split,
+                                       in_a_start[s]);
+        in_a[s] = is_in_a;
+    }
+
+    double log_alpha = log(_crp_alpha);
+
+    if(is_split){
+        double log_l_split = 0;
+        for(auto &f: _features)
+            log_l_split += f.get()->clusterLogp(a) + f.get()->clusterLogp(b);
+
+        double log_crp = log_alpha + lgamma(n_a) + lgamma(n_b) - lgamma(n_a+n_b);
+        double log_accept = log_crp + log_l_split - log_l_start - log_q;
+
+        ++_num_split_proposals;
+        if(log(_rng->urand(0, 1)) < log_accept){
+            ++_num_split_accepts;
+            _row_assignment[row_i] = a;
+            for(size_t s = 0; s < S.size(); ++s)
+                if(in_a[s])
+                    _row_assignment[S[s]] = a;
+            _cluster_counts[b] = static_cast<size_t>(n_b+.5);
+            if(is_new_slot){
+                _cluster_counts.push_back(static_cast<size_t>(n_a+.5));
+                ++_num_clusters;
+            }else{
+                _free_clusters.pop_back();
+                _cluster_counts[a] = static_cast<size_t>(n_a+.5);
+            }
+        }else{
+            for(size_t s = 0; s < S.size(); ++s){
+                if(in_a[s]){
+                    for(auto &f: _features)
+                        f.get()->moveToCluster(S[s], a, b);
+                }
+            }
+            for(auto &f: _features){
+                if(is_new_slot){
+                    f.get()->destroySingletonCluster(row_i, a, b);
+                }else{
+                    f.get()->moveToCluster(row_i, a, b);
+                }
+            }
+        }
+    }else{
+        // the features are back in the current state. Score the merge with everything in a.
+        for(size_t s = 0; s < S.size(); ++s){
+            if(not in_a[s]){
+                for(auto &f: _features)
+                    f.get()->moveToCluster(S[s], b, a);
+            }
+        }
+
+        double log_l_merge = 0;
+        for(auto &f: _features){
+            f.get()->moveToCluster(row_j, b, a);
+            log_l_merge += f.get()->clusterLogp(a);
+            f.get()->moveToCluster(row_j, a, b);
+        }
+
+        double log_crp = lgamma(n_a+n_b) - log_alpha - lgamma(n_a) - lgamma(n_b);
+        double log_accept = log_crp + log_l_merge - log_l_start + log_q;
+
+        ++_num_merge_proposals;
+        if(log(_rng->urand(0, 1)) < log_accept){
+            ++_num_merge_accepts;
+            // the features already hold the rest of b in a; mirror that in the view and destroy
+            // the singleton left in b
+            for(size_t s = 0; s < S.size(); ++s){
+                if(not in_a[s]){
+                    _row_assignment[S[s]] = a;
+                    --_cluster_counts[b];
+                    ++_cluster_counts[a];
+                }
+            }
+            __destroySingletonCluster(row_j, b, a);
+        }else{
+            for(size_t s = 0; s < S.size(); ++s){
+                if(not in_a[s]){
+                    for(auto &f: _features)
+                        f.get()->moveToCluster(S[s], a, b);
+                }
+            }
+        }
+    }
+
+    ASSERT(std::cout, checkPartitions()==1);
+}
+
+
+double View::__restrictedGibbsStep(size_t row, size_t a, size_t b, bool &is_in_a, double &n_a,
+                                   double &n_b, bool force, bool force_to_a)
+{
+    size_t from = is_in_a ? a : b;
+    if(is_in_a){
+        --n_a;
+    }else{
+        --n_b;
+    }
+
+    double logp_a = log(n_a);
+    double logp_b = log(n_b);
+    for(auto &f: _features){
+        f.get()->removeElement(row, from);
+        logp_a += f.get()->elementLogp(row, a);
+        logp_b += f.get()->elementLogp(row, b);
+    }
+
+    double log_norm = numerics::logsumexp({logp_a, logp_b});
+    bool to_a = force ? force_to_a : (log(_rng->urand(0, 1)) < logp_a-log_norm);
+
+    size_t to = to_a ? a : b;
+    for(auto &f: _features)
+        f.get()->insertElement(row, to);
+
+    if(to_a){
+        ++n_a;
+    }else{
+        ++n_b;
+    }
+    is_in_a = to_a;
+
+    return to_a ? logp_a-log_norm : logp_b-log_norm;
+}
+
+
 // probabilities
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 double View::rowLogp(size_t row, size_t query_cluster, bool is_init)
@@ -264,29 +590,69 @@ double View::logScore()
 
 // cleanup
 // ````````````````````````````````````````````````````````````````````````````````````````````````
+// Destroying and creating singletons is O(features). The labels are only made dense again by
+// __compactClusters, once per sweep.
 void View::__destroySingletonCluster(size_t row, size_t to_destroy, size_t move_to)
 {
     _row_assignment[row] = move_to;
-    for(size_t i = 0; i < _num_rows; ++i)
-        if( _row_assignment[i] > to_destroy) // maintain partition order
-            _row_assignment[i]--;
-
     for(auto &f: _features)
-        f.get()->destroySingletonCluster(row, to_destroy, move_to);
+        f.get()->moveToCluster(row, to_destroy, move_to);
 
     _cluster_counts[move_to]++;
-    _cluster_counts.erase(_cluster_counts.begin()+to_destroy);
-    _num_clusters--;
+    _cluster_counts[to_destroy] = 0;
+    _free_clusters.push_back(to_destroy);
 }
 
 void View::__createSingletonCluster(size_t row, size_t current)
 {
-    _row_assignment[row] = _num_clusters;
-    _num_clusters++;
     _cluster_counts[current]--;
-    _cluster_counts.push_back(1);
+    if(_free_clusters.empty()){
+        _row_assignment[row] = _num_clusters;
+        _num_clusters++;
+        _cluster_counts.push_back(1);
+        for(auto &f: _features)
+            f.get()->createSingletonCluster(row, current);
+    }else{
+        size_t slot = _free_clusters.back();
+        _free_clusters.pop_back();
+        _row_assignment[row] = slot;
+        _cluster_counts[slot] = 1;
+        for(auto &f: _features)
+            f.get()->moveToCluster(row, current, slot);
+    }
+}
+
+
+void View::__compactClusters()
+{
+    if(_free_clusters.empty())
+        return;
+
+    std::sort(_free_clusters.begin(), _free_clusters.end());
+
+    // new_label[k] is the dense label of slot k; free slots keep their place in the order
+    vector<size_t> new_label(_num_clusters, 0);
+    size_t j = 0;
+    size_t k_new = 0;
+    for(size_t k = 0; k < _num_clusters; ++k){
+        if(j < _free_clusters.size() and _free_clusters[j] == k){
+            ++j;
+            continue;
+        }
+        new_label[k] = k_new;
+        _cluster_counts[k_new] = _cluster_counts[k];
+        ++k_new;
+    }
+    _num_clusters = k_new;
+    _cluster_counts.resize(_num_clusters);
+
+    for(auto &z : _row_assignment)
+        z = new_label[z];
+
     for(auto &f: _features)
-        f.get()->createSingletonCluster(row, current);
+        f.get()->eraseClusters(_free_clusters);
+
+    _free_clusters.clear();
 }
 
 
@@ -367,7 +733,7 @@ void View::setRowAssignment(std::vector<size_t> new_row_assignment)
 {
     _row_assignment = new_row_assignment;
     _num_clusters = utils::vector_max(_row_assignment)+1;
-    _cluster_counts.resize(_num_clusters, 0);
+    _cluster_counts.assign(_num_clusters, 0);
 
     for(size_t &z : _row_assignment)
         ++_cluster_counts[z];
@@ -403,19 +769,35 @@ double View::getCRPAlpha() const
 }
 
 
-std::vector<size_t> View::getRowAssignments() const
+const std::vector<size_t> &View::getRowAssignments() const
 {
     ASSERT_EQUAL(std::cout, _row_assignment.size(), _num_rows);
     return _row_assignment;
 }
 
 
-std::vector<size_t> View::getClusterCounts() const
+const std::vector<size_t> &View::getClusterCounts() const
 {
     return _cluster_counts;
 }
 
 
+std::map<std::string, size_t> View::getSplitMergeStats() const
+{
+    return {{"split_proposals", _num_split_proposals}, {"split_accepts", _num_split_accepts},
+            {"merge_proposals", _num_merge_proposals}, {"merge_accepts", _num_merge_accepts}};
+}
+
+
+void View::clearSplitMergeStats()
+{
+    _num_split_proposals = 0;
+    _num_split_accepts = 0;
+    _num_merge_proposals = 0;
+    _num_merge_accepts = 0;
+}
+
+
 size_t View::getAssignmentOfRow(size_t row) const
 {
     return _row_assignment[row];
@@ -354,4 +354,51 @@ BOOST_AUTO_TEST_CASE(resample_hypers_should_change_hyper_values)
     BOOST_CHECK_EQUAL(hypers_out[0], hypers_1["dirichlet_alpha"]);
 }
 
+BOOST_AUTO_TEST_CASE(incremental_terms_should_match_direct_evaluation)
+{
+    static baxcat::PRNG *prng = new baxcat::PRNG(10);
+
+    size_t K = 50;
+    double dirichlet_alpha = .7;
+    std::vector<double> distargs = {double(K)};
+    Categorical model(distargs);
+    model.setHypers({dirichlet_alpha});
+
+    baxcat::models::CategoricalDirichlet<size_t> msd;
+
+    // a random walk of inserts and removes that empties and refills categories
+    std::vector<size_t> X;
+    std::vector<size_t> counts(K, 0);
+    for(size_t i = 0; i < 2000; ++i){
+        if(X.empty() or prng->urand(0, 1) < .55){
+            size_t x = prng->randuint(K/5);
+            X.push_back(x);
+            model.insertElement(x);
+            ++counts[x];
+        }else{
+            size_t idx = prng->randuint(X.size());
+            size_t x = X[idx];
+            X.erase(X.begin()+idx);
+            model.removeElement(x);
+            --counts[x];
+        }
+    }
+
+    double n = double(X.size());
+    double log_z = msd.logZ(n, counts, dirichlet_alpha);
+
+    BOOST_CHECK_CLOSE_FRACTION(model.logp(), msd.logMarginalLikelihood(n, counts, dirichlet_alpha),
+                               TOL);
+    for(size_t x = 0; x < K; ++x){
+        double logp = log(dirichlet_alpha+counts[x]) - log(n + K*dirichlet_alpha);
+        BOOST_CHECK_CLOSE_FRACTION(model.elementLogp(x), logp, TOL);
+        BOOST_CHECK_EQUAL(model.elementLogp(x),
+                          msd.logPredictiveProbability(x, counts, dirichlet_alpha, log_z));
+    }
+
+    // updateConstants resyncs the running sum exactly
+    model.updateConstants();
+    BOOST_CHECK_EQUAL(model.logp(), msd.logMarginalLikelihood(n, counts, dirichlet_alpha));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,167 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "column_file.hpp"
+#include "ensemble.hpp"
+#include "state.hpp"
+
+BOOST_AUTO_TEST_SUITE (column_file_test)
+
+using std::vector;
+using std::string;
+using std::shared_ptr;
+
+using baxcat::ColumnFile;
+using baxcat::Ensemble;
+using baxcat::State;
+
+// a unique temporary path that is removed when the fixture goes away
+struct TempPath
+{
+    string path;
+    TempPath()
+    {
+        char name[] = "/tmp/baxcat_column_file_XXXXXX";
+        int fd = mkstemp(name);
+        close(fd);
+        path = name;
+    }
+    ~TempPath(){ std::remove(path.c_str()); }
+};
+
+
+BOOST_AUTO_TEST_CASE(written_file_should_map_back_column_major)
+{
+    TempPath tmp;
+    vector<vector<double>> X = {{0.5, 1.5, NAN}, {3, 2, 1}};
+    ColumnFile::write(tmp.path, X);
+
+    ColumnFile file(tmp.path);
+    BOOST_REQUIRE_EQUAL(file.numRows(), 3);
+    BOOST_REQUIRE_EQUAL(file.numColumns(), 2);
+
+    BOOST_CHECK_EQUAL(file.column(0)[1], 1.5);
+    BOOST_CHECK(std::isnan(file.column(0)[2]));
+    BOOST_CHECK_EQUAL(file.column(1)[0], 3);
+    BOOST_CHECK_EQUAL(file.data()[1*3 + 2], 1);
+}
+
+BOOST_AUTO_TEST_CASE(bad_files_should_throw)
+{
+    TempPath tmp;
+    BOOST_CHECK_THROW(ColumnFile file(tmp.path), std::runtime_error);
+
+    {
+        std::ofstream out(tmp.path, std::ios::binary);
+        out << string(ColumnFile::HEADER_BYTES, 'x');
+    }
+    BOOST_CHECK_THROW(ColumnFile file(tmp.path), std::runtime_error);
+
+    // header promises more rows than the file holds
+    ColumnFile::write(tmp.path, {{1, 2, 3}, {4, 5, 6}});
+    truncate(tmp.path.c_str(), ColumnFile::HEADER_BYTES + 5*sizeof(double));
+    BOOST_CHECK_THROW(ColumnFile file(tmp.path), std::runtime_error);
+
+    BOOST_CHECK_THROW(ColumnFile::write(tmp.path, {{1, 2}, {1}}), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(state_over_file_should_match_state_over_vectors)
+{
+    TempPath tmp;
+    vector<vector<double>> X = {
+        {0.5377, 1.8339, -2.2588, 0.8622, 0.3188, NAN},
+        {-1.3077, -0.4336, 0.3426, 3.5784, 2.7694, 1.1},
+        {0, 1, 2, 1, NAN, 0}};
+    vector<string> datatypes = {"continuous", "continuous", "categorical"};
+    vector<vector<double>> distargs = {{0}, {0}, {3}};
+    ColumnFile::write(tmp.path, X);
+
+    shared_ptr<ColumnFile> file(new ColumnFile(tmp.path));
+    State state_file(file, datatypes, distargs, 10);
+    State state_vec(X, datatypes, distargs, 10);
+
+    BOOST_CHECK_EQUAL(state_file.logScore(), state_vec.logScore());
+
+    auto data = state_file.getDataTable();
+    BOOST_CHECK_EQUAL(data[3][1], 3.5784);
+    BOOST_CHECK(std::isnan(data[5][0]));
+
+    // the state keeps the map alive
+    file.reset();
+    state_file.transition({}, {}, {}, 0, 5);
+    BOOST_CHECK(std::isfinite(state_file.logScore()));
+}
+
+BOOST_AUTO_TEST_CASE(partitioned_state_over_file_should_match_state_over_vectors)
+{
+    TempPath tmp;
+    vector<vector<double>> X = {
+        {0.5377, 1.8339, -2.2588, 0.8622, 0.3188, NAN},
+        {-1.3077, -0.4336, 0.3426, 3.5784, 2.7694, 1.1},
+        {0, 1, 2, 1, NAN, 0}};
+    vector<string> datatypes = {"continuous", "continuous", "categorical"};
+    vector<vector<double>> distargs = {{0}, {0}, {3}};
+    ColumnFile::write(tmp.path, X);
+
+    vector<size_t> Zv = {0, 0, 1};
+    vector<vector<size_t>> Zrcv = {{0, 0, 1, 1, 0, 1}, {0, 1, 0, 1, 0, 1}};
+    vector<double> view_alphas = {1, 1};
+
+    shared_ptr<ColumnFile> file(new ColumnFile(tmp.path));
+    State state_file(file, datatypes, distargs, 10, Zv, Zrcv, 1, view_alphas, {});
+    State state_vec(X, datatypes, distargs, 10, Zv, Zrcv, 1, view_alphas, {});
+
+    BOOST_CHECK_EQUAL(state_file.logScore(), state_vec.logScore());
+    BOOST_CHECK(state_file.getColumnAssignment() == Zv);
+    BOOST_CHECK(state_file.getRowAssignments() == Zrcv);
+}
+
+BOOST_AUTO_TEST_CASE(ensemble_over_file_should_match_ensemble_over_vectors)
+{
+    TempPath tmp;
+    vector<vector<double>> X = {
+        {0.5377, 1.8339, -2.2588, 0.8622, 0.3188, NAN},
+        {-1.3077, -0.4336, 0.3426, 3.5784, 2.7694, 1.1},
+        {0, 1, 2, 1, NAN, 0}};
+    vector<string> datatypes = {"continuous", "continuous", "categorical"};
+    vector<vector<double>> distargs = {{0}, {0}, {3}};
+    ColumnFile::write(tmp.path, X);
+
+    shared_ptr<ColumnFile> file(new ColumnFile(tmp.path));
+    Ensemble ensemble_file(file, datatypes, distargs);
+    Ensemble ensemble_vec(X, datatypes, distargs);
+    BOOST_REQUIRE_EQUAL(ensemble_file.getNumRows(), 6);
+    BOOST_REQUIRE_EQUAL(ensemble_file.getNumColumns(), 3);
+
+    for(unsigned int seed : {10, 11}){
+        ensemble_file.addState(seed);
+        ensemble_vec.addState(seed);
+    }
+
+    // same draws from the prior; only the transitions differ (file order row sweeps)
+    BOOST_CHECK(ensemble_file.logScores() == ensemble_vec.logScores());
+    for(size_t i = 0; i < ensemble_file.size(); ++i){
+        auto &a = ensemble_file.getState(i);
+        auto &b = ensemble_vec.getState(i);
+        BOOST_CHECK(a.getColumnAssignment() == b.getColumnAssignment());
+        BOOST_CHECK(a.getRowAssignments() == b.getRowAssignments());
+    }
+
+    // the ensemble keeps the map alive
+    file.reset();
+    ensemble_file.transition({}, {}, {}, {}, 0, 5);
+    for(double logp : ensemble_file.logScores())
+        BOOST_CHECK(std::isfinite(logp));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -321,4 +321,110 @@ BOOST_AUTO_TEST_CASE(cast_and_insert_should_work_different_types){
     BOOST_CHECK_EQUAL(14, B.at(1));
 }
 
+// Strided (borrowed) buffers
+//`````````````````````````````````````````````````````````````````````````````````````````````````
+BOOST_AUTO_TEST_CASE(double_buffer_should_be_borrowed_with_stride){
+    // 3 rows by 2 columns, C-ordered; read the second column
+    std::vector<double> X = {1, 10, 2, NAN, 3, 30};
+    baxcat::DataContainer<double> Y(X.data()+1, 3, 2);
+
+    BOOST_CHECK(Y.is_borrowed());
+    BOOST_REQUIRE_EQUAL(Y.size(), 3);
+    BOOST_CHECK_EQUAL(Y.at(0), 10);
+    BOOST_CHECK(Y.is_missing(1));
+    BOOST_CHECK_EQUAL(Y.at(2), 30);
+
+    // reads go through to the caller's buffer
+    X[5] = 31;
+    BOOST_CHECK_EQUAL(Y.at(2), 31);
+
+    auto set_data = Y.getSetData();
+    BOOST_REQUIRE_EQUAL(set_data.size(), 2);
+    BOOST_CHECK_EQUAL(set_data[1], 31);
+}
+
+BOOST_AUTO_TEST_CASE(mutating_borrowed_buffer_should_copy_it){
+    std::vector<double> X = {1, 10, 2, 20, 3, 30};
+    baxcat::DataContainer<double> Y(X.data(), 3, 2);
+    baxcat::DataContainer<double> Z(Y);
+
+    Y.set(1, 5);
+    Y.append(4);
+
+    BOOST_CHECK(!Y.is_borrowed());
+    BOOST_REQUIRE_EQUAL(Y.size(), 4);
+    BOOST_CHECK_EQUAL(Y.at(0), 1);
+    BOOST_CHECK_EQUAL(Y.at(1), 5);
+    BOOST_CHECK_EQUAL(Y.at(2), 3);
+    BOOST_CHECK_EQUAL(Y.at(3), 4);
+
+    // neither the buffer nor other borrowers change
+    BOOST_CHECK_EQUAL(X[2], 2);
+    BOOST_CHECK(Z.is_borrowed());
+    BOOST_CHECK_EQUAL(Z.at(1), 2);
+}
+
+BOOST_AUTO_TEST_CASE(integral_buffer_should_be_cast_with_stride){
+    std::vector<double> X = {0.9, 10, 2.1, 20, NAN, 30};
+    baxcat::DataContainer<size_t> Y(X.data(), 3, 2);
+
+    BOOST_CHECK(!Y.is_borrowed());
+    BOOST_REQUIRE_EQUAL(Y.size(), 3);
+    BOOST_CHECK_EQUAL(Y.at(0), 1);
+    BOOST_CHECK_EQUAL(Y.at(1), 2);
+    BOOST_CHECK(Y.is_missing(2));
+}
+
+// Set-element bitmap
+//`````````````````````````````````````````````````````````````````````````````````````````````````
+BOOST_AUTO_TEST_CASE(for_each_set_should_visit_set_elements_in_order){
+    // span several 64-bit words: a full word, an empty word, and a sparse tail
+    std::vector<double> X(200, NAN);
+    std::vector<size_t> expected;
+    for(size_t i = 0; i < 64; ++i){
+        X[i] = i;
+        expected.push_back(i);
+    }
+    for(size_t i : {130, 131, 190, 199}){
+        X[i] = i;
+        expected.push_back(i);
+    }
+    baxcat::DataContainer<double> Y(X);
+
+    std::vector<size_t> visited;
+    Y.for_each_set([&](size_t i){ visited.push_back(i); });
+
+    BOOST_REQUIRE_EQUAL(visited.size(), expected.size());
+    for(size_t j = 0; j < expected.size(); ++j)
+        BOOST_CHECK_EQUAL(visited[j], expected[j]);
+    BOOST_CHECK_EQUAL(Y.count_set(), expected.size());
+    BOOST_CHECK_EQUAL(Y.getSetData().size(), expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(append_and_pop_should_cross_word_boundaries){
+    baxcat::DataContainer<size_t> Y;
+    for(size_t i = 0; i < 130; ++i){
+        if(i % 3 == 0)
+            Y.append_unset_element();
+        else
+            Y.append(i);
+    }
+    BOOST_REQUIRE_EQUAL(Y.size(), 130);
+    BOOST_CHECK(Y.is_missing(129));
+    BOOST_CHECK(Y.is_set(128));
+
+    for(size_t i = 0; i < 66; ++i)
+        Y.pop_back();
+    BOOST_REQUIRE_EQUAL(Y.size(), 64);
+
+    // a popped slot must come back unset
+    Y.append_unset_element();
+    BOOST_CHECK(Y.is_missing(64));
+
+    size_t count = 0;
+    for(size_t i = 0; i < Y.size(); ++i)
+        count += Y.is_set(i);
+    BOOST_CHECK_EQUAL(Y.count_set(), count);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -553,4 +553,129 @@ BOOST_AUTO_TEST_CASE(resample_hypers_should_change_hyper_values)
 
 }
 
+BOOST_AUTO_TEST_CASE(cluster_store_should_agree_with_models)
+{
+	std::vector<double> distargs;
+	std::vector<double> hypers = {.5, 1.2, 2.1, 3.3};
+	std::vector<double> X = {-1.5, 0.2, 1.1, 3.4, 2.2};
+
+	baxcat::ClusterStore<baxcat::datatypes::Continuous> store;
+	store.reset(2, distargs, hypers);
+
+	baxcat::datatypes::Continuous model_0(distargs);
+	baxcat::datatypes::Continuous model_1(distargs);
+	model_0.setHypers(hypers);
+	model_1.setHypers(hypers);
+
+	for(size_t i = 0; i < X.size(); ++i){
+		store.insertElement(i % 2, X[i]);
+		if(i % 2 == 0){
+			model_0.insertElement(X[i]);
+		}else{
+			model_1.insertElement(X[i]);
+		}
+	}
+
+	store.removeElement(0, X[0]);
+	model_0.removeElement(X[0]);
+
+	BOOST_CHECK_EQUAL(store.getCount(0), model_0.getCount());
+	BOOST_CHECK_EQUAL(store.getCount(1), model_1.getCount());
+	BOOST_CHECK_EQUAL(store.logp(0), model_0.logp());
+	BOOST_CHECK_EQUAL(store.logp(1), model_1.logp());
+	BOOST_CHECK_EQUAL(store.elementLogp(0, .7), model_0.elementLogp(.7));
+	BOOST_CHECK_EQUAL(store.elementLogp(1, .7), model_1.elementLogp(.7));
+	BOOST_CHECK_EQUAL(store.singletonLogp(.7), model_0.singletonLogp(.7));
+
+	std::vector<double> logps(2, 0);
+	store.addElementLogps(X[1], 1, logps);
+	model_1.removeElement(X[1]);
+	BOOST_CHECK_CLOSE_FRACTION(logps[0], model_0.elementLogp(X[1]), TOL);
+	BOOST_CHECK_EQUAL(logps[1], model_1.elementLogp(X[1]));
+}
+
+BOOST_AUTO_TEST_CASE(cluster_store_cache_should_refresh_only_changed_clusters)
+{
+	std::vector<double> distargs;
+	std::vector<double> hypers = {.5, 1.2, 2.1, 3.3};
+	std::vector<double> X = {-1.5, 0.2, 1.1, 3.4, 2.2, -.3};
+
+	baxcat::ClusterStore<baxcat::datatypes::Continuous> store;
+	store.reset(3, distargs, hypers);
+	for(size_t i = 0; i < X.size(); ++i)
+		store.insertElement(i % 3, X[i]);
+
+	// first pass builds the constants of clusters 1 and 2
+	std::vector<double> logps(3, 0);
+	store.addElementLogps(X[0], 0, logps);
+	auto stats = store.getCacheStats();
+	BOOST_CHECK_EQUAL(stats["hits"], 0);
+	BOOST_CHECK_EQUAL(stats["misses"], 2);
+
+	// nothing changed; cluster 0 is new to the cache
+	store.addElementLogps(X[1], 1, logps);
+	stats = store.getCacheStats();
+	BOOST_CHECK_EQUAL(stats["hits"], 1);
+	BOOST_CHECK_EQUAL(stats["misses"], 3);
+
+	// moving X[1] from cluster 1 to 2 invalidates both
+	store.removeElement(1, X[1]);
+	store.insertElement(2, X[1]);
+	std::fill(logps.begin(), logps.end(), 0);
+	store.addElementLogps(X[2], 2, logps);
+	stats = store.getCacheStats();
+	BOOST_CHECK_EQUAL(stats["hits"], 2);
+	BOOST_CHECK_EQUAL(stats["misses"], 4);
+
+	BOOST_CHECK_CLOSE_FRACTION(logps[0], store.elementLogp(0, X[2]), TOL);
+	BOOST_CHECK_CLOSE_FRACTION(logps[1], store.elementLogp(1, X[2]), TOL);
+
+	// new hypers invalidate every cluster
+	store.setHypers({.1, 1.1, 1.9, 2.8});
+	std::fill(logps.begin(), logps.end(), 0);
+	store.addElementLogps(X[0], 0, logps);
+	stats = store.getCacheStats();
+	BOOST_CHECK_EQUAL(stats["hits"], 2);
+	BOOST_CHECK_EQUAL(stats["misses"], 6);
+	BOOST_CHECK_CLOSE_FRACTION(logps[2], store.elementLogp(2, X[0]), TOL);
+}
+
+BOOST_AUTO_TEST_CASE(cluster_store_should_score_with_the_scalar_path_by_default)
+{
+	using baxcat::models::NormalNormalGamma;
+
+	std::vector<double> distargs;
+	double m = .5, r = 1.2, s = 2.1, nu = 3.3;
+	std::vector<double> X = {-1.5, 0.2, 1.1, 3.4, 2.2, -.3, .8, 1.7, -2.5};
+
+	// 9 clusters so that every SIMD width leaves a tail
+	baxcat::ClusterStore<baxcat::datatypes::Continuous> store;
+	store.reset(9, distargs, {m, r, s, nu});
+	for(size_t i = 0; i < X.size(); ++i)
+		store.insertElement(i, X[i]);
+	for(size_t i = 0; i < X.size(); ++i)
+		store.insertElement(i, X[X.size()-1-i]);
+
+	// the default must not depend on the CPU, so it has to match the scalar function exactly
+	double x = .9;
+	std::vector<double> logps(9, 0);
+	store.addElementLogps(x, 9, logps);
+	for(size_t k = 0; k < 9; ++k){
+		double sum_x = 0, sum_x_sq = 0;
+		NormalNormalGamma::suffstatInsert(X[k], sum_x, sum_x_sq);
+		NormalNormalGamma::suffstatInsert(X[X.size()-1-k], sum_x, sum_x_sq);
+		double loc, prec, shape, log_const;
+		NormalNormalGamma::predictiveConstants(2, sum_x, sum_x_sq, m, r, s, nu, loc, prec, shape,
+		                                       log_const);
+		BOOST_CHECK_EQUAL(logps[k], NormalNormalGamma::logPredictiveProbabilityCached(x, loc,
+		                  prec, shape, log_const));
+	}
+
+	std::vector<double> logps_simd(9, 0);
+	store.setSIMD(true);
+	store.addElementLogps(x, 9, logps_simd);
+	for(size_t k = 0; k < 9; ++k)
+		BOOST_CHECK_CLOSE_FRACTION(logps_simd[k], logps[k], TOL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -178,6 +178,7 @@ BOOST_AUTO_TEST_CASE(logPredictiveProbability_value_checks)
     msd_value = CategoricalDirichlet<size_t>::logPredictiveProbability(0, counts, alpha, log_z);
     BOOST_CHECK_CLOSE_FRACTION(-1.6094379124341, msd_value, ERRTOL);
 
+    n = 22;
     alpha = .25;
     counts = {2, 7, 13};
     log_z = CategoricalDirichlet<size_t>::logZ(n, counts, alpha);
@@ -0,0 +1,112 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <stdexcept>
+#include <vector>
+
+#include "omp.h"
+#include "prng.hpp"
+#include "dependence.hpp"
+
+BOOST_AUTO_TEST_SUITE (dependence_test)
+
+using std::vector;
+
+using baxcat::dependenceProbabilityMatrix;
+using baxcat::dependenceProbabilityPairs;
+
+
+// the dependence probability of a pair, counted the obvious way
+double naiveDependence(const vector<vector<size_t>> &Z, size_t i, size_t j)
+{
+    double count = 0;
+    for(auto &Zv : Z)
+        count += (Zv[i] == Zv[j]);
+    return count/Z.size();
+}
+
+
+// random column assignments of num_models models over num_columns columns
+vector<vector<size_t>> randomAssignments(size_t num_models, size_t num_columns, size_t num_views)
+{
+    baxcat::PRNG rng(1234);
+    vector<vector<size_t>> Z(num_models, vector<size_t>(num_columns));
+    for(auto &Zv : Z)
+        for(auto &z : Zv)
+            z = rng.randuint(num_views);
+    return Z;
+}
+
+
+BOOST_AUTO_TEST_CASE(matrix_should_match_naive_count)
+{
+    // more columns than one block, and not a multiple of the block size
+    const size_t C = 150;
+    auto Z = randomAssignments(7, C, 4);
+
+    auto P = dependenceProbabilityMatrix(Z);
+    BOOST_REQUIRE_EQUAL(P.size(), C*C);
+
+    for(size_t i = 0; i < C; ++i){
+        BOOST_CHECK_EQUAL(P[i*C + i], 1);
+        for(size_t j = 0; j < C; ++j){
+            if(i != j)
+                BOOST_CHECK_EQUAL(P[i*C + j], naiveDependence(Z, i, j));
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(matrix_should_not_depend_on_threads)
+{
+    auto Z = randomAssignments(5, 200, 3);
+
+    // a fixed count, so that the comparison holds even where only one thread is available
+    const int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    auto P_serial = dependenceProbabilityMatrix(Z);
+    omp_set_num_threads(4);
+    auto P_parallel = dependenceProbabilityMatrix(Z);
+    omp_set_num_threads(max_threads);
+
+    BOOST_CHECK(P_serial == P_parallel);
+}
+
+
+BOOST_AUTO_TEST_CASE(pairs_should_be_sorted_entries_above_threshold)
+{
+    const size_t C = 130;
+    auto Z = randomAssignments(6, C, 3);
+    const double threshold = .5;
+
+    auto pairs = dependenceProbabilityPairs(Z, threshold);
+    BOOST_REQUIRE_EQUAL(pairs.first.size(), pairs.second.size());
+    BOOST_REQUIRE_EQUAL(pairs.first.size(), pairs.probability.size());
+
+    vector<size_t> first, second;
+    for(size_t i = 0; i < C; ++i){
+        for(size_t j = i+1; j < C; ++j){
+            if(naiveDependence(Z, i, j) >= threshold){
+                first.push_back(i);
+                second.push_back(j);
+            }
+        }
+    }
+
+    BOOST_CHECK(pairs.first == first);
+    BOOST_CHECK(pairs.second == second);
+    for(size_t k = 0; k < pairs.first.size(); ++k){
+        BOOST_CHECK_EQUAL(pairs.probability[k],
+                          naiveDependence(Z, pairs.first[k], pairs.second[k]));
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(mismatched_models_should_throw)
+{
+    vector<vector<size_t>> Z = {{0, 0, 1}, {0, 1}};
+    BOOST_CHECK_THROW(dependenceProbabilityMatrix(Z), std::invalid_argument);
+    BOOST_CHECK_THROW(dependenceProbabilityPairs({}, .5), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
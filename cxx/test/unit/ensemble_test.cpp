@@ -0,0 +1,84 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include <vector>
+
+#include "omp.h"
+#include "ensemble.hpp"
+#include "test_utils.hpp"
+
+BOOST_AUTO_TEST_SUITE (ensemble_test)
+
+using std::vector;
+using std::string;
+
+using baxcat::Ensemble;
+using baxcat::test_utils::areIdentical;
+
+struct Setup
+{
+    vector<vector<double>> data = {
+        {0.5377, 1.8339, -2.2588, 0.8622, 0.3188, -1.3077, -0.4336, 0.3426},
+        {-1.3077, -0.4336, 0.3426, 3.5784, 2.7694, 0.5377, 1.8339, -2.2588},
+        {0, 1, 2, 1, 0, 2, 1, 0}};
+    vector<string> datatypes = {"continuous", "continuous", "categorical"};
+    vector<vector<double>> distargs = {{0}, {0}, {3}};
+};
+
+
+BOOST_AUTO_TEST_CASE(states_should_share_the_table)
+{
+    Setup s;
+    Ensemble ensemble(s.data, s.datatypes, s.distargs);
+    ensemble.addState(1);
+    ensemble.addState(2, {0, 0, 1}, {vector<size_t>(8, 0), vector<size_t>(8, 0)}, -1, {}, {});
+
+    BOOST_REQUIRE_EQUAL(ensemble.size(), 2);
+    BOOST_CHECK_EQUAL(ensemble.getNumRows(), 8);
+    BOOST_CHECK_EQUAL(ensemble.getNumColumns(), 3);
+    BOOST_CHECK_EQUAL(ensemble.getState(1).getNumViews(), 2);
+
+    for(size_t i = 0; i < ensemble.size(); ++i){
+        auto row = ensemble.getState(i).getDataRow(3);
+        BOOST_CHECK_EQUAL(row[0], 0.8622);
+        BOOST_CHECK_EQUAL(row[1], 3.5784);
+        BOOST_CHECK_EQUAL(row[2], 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transition_should_reject_bad_or_repeated_states)
+{
+    Setup s;
+    Ensemble ensemble(s.data, s.datatypes, s.distargs);
+    ensemble.addState(1);
+    ensemble.addState(2);
+
+    BOOST_CHECK_THROW(ensemble.transition({2}, {}, {}, {}, 0, 1), std::invalid_argument);
+    BOOST_CHECK_THROW(ensemble.transition({1, 1}, {}, {}, {}, 0, 1), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(state_chains_should_not_depend_on_threads_or_other_states)
+{
+    Setup s;
+
+    auto run = [&](int num_threads, vector<size_t> which_states){
+        int max_threads = omp_get_max_threads();
+        omp_set_num_threads(num_threads);
+        Ensemble ensemble(s.data, s.datatypes, s.distargs);
+        for(unsigned int seed = 1; seed <= 4; ++seed)
+            ensemble.addState(seed);
+        ensemble.transition(which_states, {}, {}, {}, 0, 5);
+        omp_set_num_threads(max_threads);
+        return ensemble.getState(2).getRowAssignments();
+    };
+
+    // a fixed count, so that the comparison holds even where only one thread is available
+    auto Z_all = run(4, {});
+    auto Z_one = run(1, {2});
+    BOOST_REQUIRE_EQUAL(Z_all.size(), Z_one.size());
+    for(size_t v = 0; v < Z_all.size(); ++v)
+        BOOST_CHECK(areIdentical(Z_all[v], Z_one[v]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
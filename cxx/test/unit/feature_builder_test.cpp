@@ -76,4 +76,28 @@ BOOST_AUTO_TEST_CASE(construct_single_feature_of_each_type)
     delete rng;
 }
 
+BOOST_AUTO_TEST_CASE(categorical_storage_should_fit_number_of_categories)
+{
+    std::vector<std::vector<double>> data_in = {{0, 1, 5}, {0, 299, 5}, {0, 70000, 5}};
+    std::vector<std::string> datatypes(3, "categorical");
+    std::vector<std::vector<double>> distargs = {{6}, {300}, {70001}};
+    baxcat::PRNG *rng = new baxcat::PRNG;
+
+    auto features_out = baxcat::helpers::genFeatures(data_in, datatypes, distargs, rng);
+
+    using baxcat::datatypes::Categorical;
+    typedef baxcat::Feature<Categorical, uint8_t> Feature8;
+    typedef baxcat::Feature<Categorical, uint16_t> Feature16;
+    typedef baxcat::Feature<Categorical, uint32_t> Feature32;
+    BOOST_CHECK(dynamic_cast<Feature8*>(features_out[0].get()) != nullptr);
+    BOOST_CHECK(dynamic_cast<Feature16*>(features_out[1].get()) != nullptr);
+    BOOST_CHECK(dynamic_cast<Feature32*>(features_out[2].get()) != nullptr);
+
+    auto data = features_out[2].get()->getData();
+    BOOST_REQUIRE_EQUAL(data.size(), 3);
+    BOOST_CHECK_EQUAL(data[1], 70000);
+
+    delete rng;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
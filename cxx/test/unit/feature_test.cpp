@@ -8,6 +8,8 @@
 #include "utils.hpp"
 #include "test_utils.hpp"
 #include "datatypes/continuous.hpp"
+#include "datatypes/categorical.hpp"
+#include "helpers/feature_builder.hpp"
 #include "models/nng.hpp"
 #include "prng.hpp"
 
@@ -362,6 +364,78 @@ BOOST_AUTO_TEST_CASE(destroy_singleton_should_remove_cluster){
     BOOST_CHECK_CLOSE_FRACTION( suffstats[0]["sum_x_sq"], 55, EPSILON );
 }
 
+BOOST_AUTO_TEST_CASE(erase_clusters_should_renumber_remaining_clusters){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+    auto feature = Setup(rng);
+
+    vector<size_t> assignment = {0,2,2,4,4};
+    feature.reassign(assignment);
+
+    BOOST_REQUIRE(feature.getNumClusters() == 5);
+
+    // clusters 1 and 3 are empty
+    feature.eraseClusters({1, 3});
+
+    auto suffstats = feature.getModelSuffstats();
+    BOOST_REQUIRE(suffstats.size() == 3);
+    BOOST_CHECK_CLOSE_FRACTION( suffstats[0]["sum_x"], 1, EPSILON );
+    BOOST_CHECK_CLOSE_FRACTION( suffstats[1]["sum_x"], 2+3, EPSILON );
+    BOOST_CHECK_CLOSE_FRACTION( suffstats[2]["sum_x"], 4+5, EPSILON );
+    BOOST_CHECK_CLOSE_FRACTION( suffstats[2]["sum_x_sq"], 16+25, EPSILON );
+}
+
+BOOST_AUTO_TEST_CASE(assignment_logp_should_match_reassign_and_leave_feature){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+    auto feature = Setup(rng);
+
+    vector<size_t> assignment_start = {0,0,0,1,1};
+    vector<size_t> assignment = {0,1,0,2,1};
+
+    feature.reassign(assignment_start);
+    double logp_start = feature.logp();
+
+    double logp = feature.assignmentLogp(assignment, 3);
+
+    // the feature is unchanged
+    BOOST_CHECK_EQUAL(feature.getNumClusters(), 2);
+    BOOST_CHECK_EQUAL(feature.logp(), logp_start);
+
+    feature.reassign(assignment);
+    BOOST_CHECK_CLOSE_FRACTION(logp, feature.logp(), EPSILON);
+}
+
+BOOST_AUTO_TEST_CASE(categorical_assignment_logp_should_match_incremental_inserts){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+
+    // two columns with different numbers of categories share the per-thread scratch store
+    vector<vector<double>> data = {{0, 2, 1, 1, 0, 2, 2, 1}, {8, 0, 3, 3, 7, 8, 1, 0}};
+    vector<vector<double>> distargs = {{3}, {9}};
+    vector<string> datatypes(2, "categorical");
+    auto features = baxcat::helpers::genFeatures(data, datatypes, distargs, rng);
+
+    vector<vector<size_t>> assignments = {{0,1,0,2,1,0,2,2}, {0,0,0,0,1,1,1,1}};
+    for(size_t pass = 0; pass < 2; ++pass){
+        for(size_t f = 0; f < 2; ++f){
+            auto &assignment = assignments[(f+pass) % 2];
+            size_t num_clusters = baxcat::utils::vector_max(assignment)+1;
+
+            double alpha = features[f]->getHypers()[0];
+            vector<baxcat::datatypes::Categorical> models(num_clusters,
+                baxcat::datatypes::Categorical(distargs[f]));
+            for(auto &model : models)
+                model.setHypers({alpha});
+            for(size_t i = 0; i < assignment.size(); ++i)
+                models[assignment[i]].insertElement(size_t(data[f][i]));
+            double logp = 0;
+            for(auto &model : models)
+                logp += model.logp();
+
+            BOOST_CHECK_CLOSE_FRACTION(features[f]->assignmentLogp(assignment, num_clusters),
+                                       logp, EPSILON);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(pull_data_continuous_should_pull_correct_data)
 {
     static baxcat::PRNG *rng = new baxcat::PRNG(10);
@@ -642,4 +716,29 @@ BOOST_AUTO_TEST_CASE(logp_value_test){
 
     BOOST_CHECK_CLOSE_FRACTION(logp_f, logp_m, TOL);
 }
+BOOST_AUTO_TEST_CASE(add_element_logps_should_match_element_logp){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+    auto f = Setup(rng);
+
+    f.setHypers({0, 1, 1, 1});
+    f.reassign({0, 0, 1, 1, 2});
+
+    // row 1 lives in cluster 0, so cluster 0 is scored without it
+    vector<double> logps(4, 0);
+    f.addElementLogps(1, 0, logps);
+
+    f.removeElement(1, 0);
+    double logp_0 = f.elementLogp(1, 0);
+    f.insertElement(1, 0);
+
+    BOOST_CHECK_EQUAL(logps[0], logp_0);
+    BOOST_CHECK_CLOSE_FRACTION(logps[1], f.elementLogp(1, 1), TOL);
+    BOOST_CHECK_CLOSE_FRACTION(logps[2], f.elementLogp(1, 2), TOL);
+    BOOST_CHECK_EQUAL(logps[3], 0);
+
+    // the suffstats must be restored
+    auto suffstats = f.getModelSuffstats();
+    BOOST_CHECK_EQUAL(suffstats[0]["n"], 2);
+    BOOST_CHECK_EQUAL(suffstats[0]["sum_x"], 3);
+}
 BOOST_AUTO_TEST_SUITE_END()
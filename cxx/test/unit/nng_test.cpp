@@ -6,6 +6,7 @@
 #include <vector>
 #include <iostream>
 
+#include "prng.hpp"
 #include "models/nng.hpp"
 #include "distributions/gamma.hpp"
 #include "distributions/gaussian.hpp"
@@ -185,4 +186,60 @@ BOOST_AUTO_TEST_CASE(predictive_probability_cached_value_checks){
 
 }
 
+BOOST_AUTO_TEST_CASE(batched_predictive_probability_should_match_scalar){
+    namespace nng_simd = baxcat::models::nng_simd;
+
+    baxcat::PRNG *rng = new baxcat::PRNG(10);
+
+    double m = 2.1;
+    double r = 1.2;
+    double s = 1.3;
+    double nu = 1.4;
+
+    // 37 clusters so that every kernel has a scalar tail. Cluster 0 is empty.
+    size_t K = 37;
+    std::vector<double> n(K, 0), sum_x(K, 0), sum_x_sq(K, 0), log_ZN(K);
+    for(size_t k = 0; k < K; ++k){
+        size_t n_k = (k == 0) ? 0 : rng->randuint(k*50)+1;
+        double mu = rng->normrand(0, 10);
+        for(size_t i = 0; i < n_k; ++i)
+            NormalNormalGamma::suffstatInsert(rng->normrand(mu, 1), sum_x[k], sum_x_sq[k]);
+        n[k] = double(n_k);
+
+        double m_n = m, r_n = r, s_n = s, nu_n = nu;
+        NormalNormalGamma::posteriorParameters(n[k], sum_x[k], sum_x_sq[k], m_n, r_n, s_n, nu_n);
+        log_ZN[k] = NormalNormalGamma::logZ(r_n, s_n, nu_n);
+    }
+
+    std::vector<nng_simd::kernel_level> levels = {nng_simd::scalar};
+    if(nng_simd::detectedLevel() >= nng_simd::avx2)
+        levels.push_back(nng_simd::avx2);
+    if(nng_simd::detectedLevel() >= nng_simd::avx512)
+        levels.push_back(nng_simd::avx512);
+
+    std::vector<double> loc(K), prec(K), shape(K), log_const(K);
+    for(size_t k = 0; k < K; ++k)
+        NormalNormalGamma::predictiveConstants(n[k], sum_x[k], sum_x_sq[k], m, r, s, nu, loc[k],
+                                               prec[k], shape[k], log_const[k]);
+
+    std::vector<double> X = {-30.5, -3, 0, 1e-3, 2.1, 3, 150};
+    for(auto level : levels){
+        for(double x : X){
+            std::vector<double> logps(K), logps_cached(K);
+            NormalNormalGamma::logPredictiveProbabilities(x, K, n.data(), sum_x.data(),
+                sum_x_sq.data(), log_ZN.data(), m, r, s, nu, logps.data(), level);
+            NormalNormalGamma::logPredictiveProbabilitiesCached(x, K, loc.data(), prec.data(),
+                shape.data(), log_const.data(), logps_cached.data(), level);
+            for(size_t k = 0; k < K; ++k){
+                double logp = NormalNormalGamma::logPredictiveProbability(x, n[k], sum_x[k],
+                    sum_x_sq[k], m, r, s, nu, log_ZN[k]);
+                BOOST_CHECK_CLOSE_FRACTION(logps[k], logp, 1e-10);
+                BOOST_CHECK_CLOSE_FRACTION(logps_cached[k], logp, 1e-10);
+            }
+        }
+    }
+
+    delete rng;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
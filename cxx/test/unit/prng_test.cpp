@@ -5,13 +5,55 @@
 #include <iostream>
 #include <cassert>
 
+#include <algorithm>
+#include <functional>
+#include <boost/math/distributions/students_t.hpp>
+
 #include "test_utils.hpp"
 #include "utils.hpp"
 #include "prng.hpp"
+#include "distributions/gamma.hpp"
+#include "distributions/gaussian.hpp"
 #include "omp.h"
 
 BOOST_AUTO_TEST_SUITE(baxcat_rng_test)
 
+// Kolmogorov-Smirnov statistic of the sample x against cdf
+static double ksStatistic(std::vector<double> x, std::function<double(double)> cdf)
+{
+    std::sort(x.begin(), x.end());
+    const double n = x.size();
+    double d = 0;
+    for(size_t i = 0; i < x.size(); ++i){
+        double f = cdf(x[i]);
+        d = std::max(d, std::max(f-i/n, (i+1)/n-f));
+    }
+    return d;
+}
+
+// chi-squared statistic of the draws of flip against probabilities p
+static double chiSquared(std::vector<double> p, size_t n, std::function<size_t()> flip)
+{
+    std::vector<double> counts(p.size(), 0);
+    for(size_t i = 0; i < n; ++i)
+        ++counts[flip()];
+
+    double sum_p = 0;
+    for(auto x : p)
+        sum_p += x;
+
+    double chi_sq = 0;
+    for(size_t k = 0; k < p.size(); ++k){
+        double expected = n*p[k]/sum_p;
+        chi_sq += (counts[k]-expected)*(counts[k]-expected)/expected;
+    }
+    return chi_sq;
+}
+
+// critical value of the KS statistic at alpha=.001
+const size_t NUM_DRAWS = 20000;
+const double KS_CRITICAL = 1.95/sqrt(double(NUM_DRAWS));
+
 BOOST_AUTO_TEST_CASE(should_generate_same_number_with_same_seed) {
 
     static baxcat::PRNG prng_1(10);
@@ -76,6 +118,171 @@ BOOST_AUTO_TEST_CASE(number_from_edge_thread_should_be_same_with_seed){
     }
 }
 
+// Test Philox streams
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+BOOST_AUTO_TEST_CASE(philox_should_match_known_answers){
+    // Random123 known-answer vectors for philox4x32-10
+    auto out = baxcat::Philox4x32::block({{0, 0, 0, 0}}, {{0, 0}});
+    BOOST_CHECK_EQUAL(out[0], 0x6627e8d5);
+    BOOST_CHECK_EQUAL(out[1], 0xe169c58d);
+    BOOST_CHECK_EQUAL(out[2], 0xbc57ac4c);
+    BOOST_CHECK_EQUAL(out[3], 0x9b00dbd8);
+
+    out = baxcat::Philox4x32::block({{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}},
+                                    {{0xffffffff, 0xffffffff}});
+    BOOST_CHECK_EQUAL(out[0], 0x408f276d);
+    BOOST_CHECK_EQUAL(out[1], 0x41c83b0e);
+    BOOST_CHECK_EQUAL(out[2], 0xa20bc7c6);
+    BOOST_CHECK_EQUAL(out[3], 0x6d5451fd);
+}
+
+BOOST_AUTO_TEST_CASE(keyed_streams_should_not_depend_on_thread_count){
+    baxcat::PRNG prng(10);
+    const size_t num_tasks = 16;
+
+    auto run = [&prng, num_tasks](int num_threads){
+        std::vector<double> x(num_tasks);
+        #pragma omp parallel for num_threads(num_threads)
+        for(size_t i = 0; i < num_tasks; ++i){
+            baxcat::PRNG::ScopedStream stream(prng, {7, i});
+            x[i] = prng.normrand(0, 1);
+        }
+        return x;
+    };
+
+    // a fixed count, so that the comparison holds even where only one thread is available
+    auto x_1 = run(1);
+    auto x_n = run(4);
+    for(size_t i = 0; i < num_tasks; ++i)
+        BOOST_CHECK_EQUAL(x_1[i], x_n[i]);
+
+    // different keys give different streams
+    BOOST_CHECK(x_1[0] != x_1[1]);
+}
+
+BOOST_AUTO_TEST_CASE(closing_a_keyed_stream_should_restore_the_thread_stream){
+    baxcat::PRNG prng_1(10);
+    baxcat::PRNG prng_2(10);
+
+    double a = prng_1.rand();
+    {
+        baxcat::PRNG::ScopedStream stream(prng_1, {1});
+        {
+            baxcat::PRNG::ScopedStream inner(prng_1, {2});
+            prng_1.rand();
+        }
+        prng_1.rand();
+    }
+    double b = prng_1.rand();
+
+    BOOST_CHECK_EQUAL(a, prng_2.rand());
+    BOOST_CHECK_EQUAL(b, prng_2.rand());
+}
+
+// Test samplers against their distributions
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+BOOST_AUTO_TEST_CASE(worker_threads_should_need_a_keyed_stream){
+    // one slot, then more threads than slots
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    baxcat::PRNG prng(10);
+    omp_set_num_threads(max_threads);
+
+    const int num_threads = 4;
+    std::vector<int> threw(num_threads, -1);
+    std::vector<int> threw_in_scope(num_threads, -1);
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        // an exception must not leave the parallel region
+        try{
+            prng.rand();
+            threw[tid] = 0;
+        }catch(std::logic_error &){
+            threw[tid] = 1;
+        }
+        try{
+            baxcat::PRNG::ScopedStream stream(prng, {uint64_t(tid)});
+            prng.rand();
+            threw_in_scope[tid] = 0;
+        }catch(std::logic_error &){
+            threw_in_scope[tid] = 1;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(threw[0], 0);
+    for(int tid = 1; tid < num_threads; ++tid)
+        BOOST_CHECK(threw[tid] != 0);
+    for(int tid = 0; tid < num_threads; ++tid)
+        BOOST_CHECK(threw_in_scope[tid] != 1);
+}
+
+BOOST_AUTO_TEST_CASE(normrand_should_follow_normal_distribution){
+    baxcat::PRNG rng(10);
+    std::vector<double> x(NUM_DRAWS);
+    for(auto &xi : x)
+        xi = rng.normrand(1, 2);
+
+    auto cdf = [](double y){ return baxcat::dist::gaussian::cdf(y, 1, 1./4.); };
+    BOOST_CHECK_LT(ksStatistic(x, cdf), KS_CRITICAL);
+}
+
+BOOST_AUTO_TEST_CASE(gamrand_should_follow_gamma_distribution){
+    baxcat::PRNG rng(10);
+    for(double shape : {.3, 1., 4.5}){
+        std::vector<double> x(NUM_DRAWS);
+        for(auto &xi : x)
+            xi = rng.gamrand(shape, 2);
+
+        auto cdf = [shape](double y){ return baxcat::dist::gamma::cdf(y, shape, 2); };
+        BOOST_CHECK_LT(ksStatistic(x, cdf), KS_CRITICAL);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(trand_should_follow_students_t_distribution){
+    baxcat::PRNG rng(10);
+    std::vector<double> x(NUM_DRAWS);
+    for(auto &xi : x)
+        xi = rng.trand(3);
+
+    boost::math::students_t_distribution<> dist(3);
+    auto cdf = [&dist](double y){ return boost::math::cdf(dist, y); };
+    BOOST_CHECK_LT(ksStatistic(x, cdf), KS_CRITICAL);
+}
+
+BOOST_AUTO_TEST_CASE(categorical_samplers_should_follow_probabilities){
+    baxcat::PRNG rng(10);
+    std::vector<double> p = {.1, .2, .3, .4};
+    std::vector<double> log_p;
+    for(auto x : p)
+        log_p.push_back(log(x)-30);
+
+    baxcat::AliasTable alias(p);
+
+    // critical value of chi-squared with 3 degrees of freedom at alpha=.001
+    const double chi_sq_critical = 16.27;
+    BOOST_CHECK_LT(chiSquared(p, NUM_DRAWS, [&](){ return rng.lpflip(log_p); }),
+                   chi_sq_critical);
+    BOOST_CHECK_LT(chiSquared(p, NUM_DRAWS, [&](){ return rng.lpflipGumbel(log_p); }),
+                   chi_sq_critical);
+    BOOST_CHECK_LT(chiSquared(p, NUM_DRAWS, [&](){ return alias.draw(&rng); }),
+                   chi_sq_critical);
+}
+
+BOOST_AUTO_TEST_CASE(log_flips_should_skip_impossible_entries_and_reject_invalid){
+    baxcat::PRNG rng(10);
+    std::vector<double> log_p = {-INFINITY, 0, -INFINITY};
+    for(size_t i = 0; i < 100; ++i){
+        BOOST_CHECK_EQUAL(rng.lpflip(log_p), 1);
+        BOOST_CHECK_EQUAL(rng.lpflipGumbel(log_p), 1);
+    }
+
+    std::vector<double> all_impossible = {-INFINITY, -INFINITY};
+    BOOST_CHECK_THROW(rng.lpflip(all_impossible), baxcat::InvalidMultinomialProbabilities);
+    BOOST_CHECK_THROW(rng.lpflipGumbel(all_impossible),
+                      baxcat::InvalidMultinomialProbabilities);
+}
+
 // Test random element
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 BOOST_AUTO_TEST_CASE(random_element_should_return_an_element){
@@ -0,0 +1,162 @@
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "prng.hpp"
+#include "row_similarity.hpp"
+
+BOOST_AUTO_TEST_SUITE (row_similarity_test)
+
+using std::vector;
+
+using baxcat::RowSimilarity;
+using baxcat::SimilarRows;
+
+
+// two models over five rows and three columns
+struct Setup
+{
+    size_t num_rows = 5;
+    vector<vector<size_t>> Zv = {{0, 0, 1}, {0, 0, 0}};
+    vector<vector<vector<size_t>>> Zrcv = {
+        {{0, 0, 1, 1, 2}, {0, 1, 1, 0, 0}},
+        {{0, 0, 0, 1, 1}}};
+};
+
+
+BOOST_AUTO_TEST_CASE(similarity_should_average_shared_views_over_models)
+{
+    Setup s;
+    RowSimilarity rs(s.num_rows, s.Zv, s.Zrcv);
+
+    // rows 0 and 1: model 0 shares view 0 only (1/2), model 1 shares its view (1)
+    BOOST_CHECK_CLOSE(rs.similarity(0, 1), .75, 1e-10);
+    // rows 3 and 4: model 0 shares view 1 (1/2), model 1 shares its view (1)
+    BOOST_CHECK_CLOSE(rs.similarity(3, 4), .75, 1e-10);
+    // rows 0 and 4: model 0 shares view 1 (1/2), model 1 shares nothing
+    BOOST_CHECK_CLOSE(rs.similarity(0, 4), .25, 1e-10);
+    BOOST_CHECK_EQUAL(rs.similarity(1, 4), 0);
+    BOOST_CHECK_EQUAL(rs.similarity(2, 2), 1);
+
+    // with respect to column 2, model 0 looks only at view 1
+    BOOST_CHECK_CLOSE(rs.similarity(0, 3, {2}), .5, 1e-10);
+    BOOST_CHECK_CLOSE(rs.similarity(0, 1, {2}), .5, 1e-10);
+}
+
+
+BOOST_AUTO_TEST_CASE(top_k_should_rank_rows_by_similarity)
+{
+    Setup s;
+    RowSimilarity rs(s.num_rows, s.Zv, s.Zrcv);
+
+    SimilarRows similar = rs.topK(0, 2);
+    BOOST_REQUIRE_EQUAL(similar.rows.size(), 2);
+    BOOST_CHECK_EQUAL(similar.rows[0], 1);
+    BOOST_CHECK_CLOSE(similar.similarity[0], .75, 1e-10);
+    BOOST_CHECK_EQUAL(similar.rows[1], 2);
+    BOOST_CHECK_CLOSE(similar.similarity[1], .5, 1e-10);
+
+    // rows 3 and 4 tie at .25; the lower index comes first
+    SimilarRows all = rs.topK(0, 10);
+    BOOST_REQUIRE_EQUAL(all.rows.size(), 4);
+    BOOST_CHECK_EQUAL(all.rows[2], 3);
+    BOOST_CHECK_EQUAL(all.rows[3], 4);
+
+    // only rows with non-zero similarity are returned; rows 3 and 4 share nothing with row 1
+    BOOST_CHECK_EQUAL(rs.topK(1, 10).rows.size(), 2);
+}
+
+
+BOOST_AUTO_TEST_CASE(top_k_should_match_pairwise_similarity)
+{
+    const size_t N = 300;
+    const size_t num_views = 3;
+    baxcat::PRNG rng(42);
+
+    vector<vector<size_t>> Zv;
+    vector<vector<vector<size_t>>> Zrcv;
+    for(size_t m = 0; m < 4; ++m){
+        Zv.push_back({0, 1, 2, 0, 1});
+        Zrcv.emplace_back(num_views, vector<size_t>(N));
+        for(auto &Z : Zrcv.back())
+            for(auto &z : Z)
+                z = rng.randuint(6);
+    }
+    RowSimilarity rs(N, Zv, Zrcv);
+
+    for(vector<size_t> wrt : {vector<size_t>{}, vector<size_t>{1, 4}}){
+        auto batch = rs.topKBatch({0, 17, 299}, N, wrt);
+        for(size_t q = 0; q < 3; ++q){
+            const size_t row = vector<size_t>{0, 17, 299}[q];
+            auto single = rs.topK(row, N, wrt);
+            BOOST_CHECK(batch[q].rows == single.rows);
+            BOOST_CHECK(batch[q].similarity == single.similarity);
+
+            size_t num_similar = 0;
+            for(size_t r = 0; r < N; ++r){
+                if(r != row and rs.similarity(row, r, wrt) > 0)
+                    ++num_similar;
+            }
+            BOOST_CHECK_EQUAL(single.rows.size(), num_similar);
+            for(size_t j = 0; j < single.rows.size(); ++j){
+                BOOST_CHECK_EQUAL(single.similarity[j], rs.similarity(row, single.rows[j], wrt));
+                if(j > 0)
+                    BOOST_CHECK(single.similarity[j] <= single.similarity[j-1]);
+            }
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(subsampled_models_should_only_count_models_with_both_rows)
+{
+    // model 0 holds rows {0, 1, 2}; model 1 holds rows {1, 2, 3}
+    vector<vector<size_t>> Zv = {{0}, {0}};
+    vector<vector<vector<size_t>>> Zrcv = {{{0, 0, 1}}, {{0, 1, 1}}};
+    vector<vector<size_t>> model_rows = {{0, 1, 2}, {1, 2, 3}};
+    RowSimilarity rs(4, Zv, Zrcv, model_rows);
+
+    BOOST_CHECK_EQUAL(rs.similarity(0, 1), 1);
+    BOOST_CHECK_EQUAL(rs.similarity(1, 2), 0);
+    BOOST_CHECK_EQUAL(rs.similarity(2, 3), 1);
+    BOOST_CHECK(std::isnan(rs.similarity(0, 3)));
+
+    SimilarRows similar = rs.topK(2, 5);
+    BOOST_REQUIRE_EQUAL(similar.rows.size(), 1);
+    BOOST_CHECK_EQUAL(similar.rows[0], 3);
+    BOOST_CHECK_EQUAL(similar.similarity[0], 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(bad_input_should_throw)
+{
+    Setup s;
+    BOOST_CHECK_THROW(RowSimilarity(4, s.Zv, s.Zrcv), std::invalid_argument);
+
+    RowSimilarity rs(s.num_rows, s.Zv, s.Zrcv);
+    BOOST_CHECK_THROW(rs.topK(5, 1), std::invalid_argument);
+    BOOST_CHECK_THROW(rs.topKBatch({0}, 1, {3}), std::invalid_argument);
+}
+
+
+BOOST_AUTO_TEST_CASE(reused_scratch_should_not_leak_between_queries)
+{
+    Setup s;
+    RowSimilarity rs(s.num_rows, s.Zv, s.Zrcv);
+
+    auto first = rs.topK(0, 4);
+    BOOST_CHECK_THROW(rs.topK(0, 4, {3}), std::invalid_argument);
+    rs.topKBatch({1, 2, 3, 4}, 4);
+    rs.topK(4, 4, {2});
+
+    for(int i = 0; i < 3; ++i){
+        auto again = rs.topK(0, 4);
+        BOOST_CHECK(again.rows == first.rows);
+        BOOST_CHECK(again.similarity == first.similarity);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -219,6 +219,434 @@ BOOST_AUTO_TEST_CASE(col_partition_should_eventually_change)
 
 }
 
+BOOST_AUTO_TEST_CASE(column_transitions_should_leave_dense_view_labels)
+{
+    Setup s;
+    vector<vector<double>> data;
+    for(size_t i = 0; i < 4; ++i){
+        data.push_back(s.data[0]);
+        data.push_back(s.data[1]);
+    }
+    vector<string> datatypes(data.size(), "continuous");
+    vector<vector<double>> distargs(data.size(), {0});
+
+    State state(data, datatypes, distargs, s.seed);
+
+    for(size_t which_kernel = 0; which_kernel < 3; ++which_kernel){
+        for(int i = 0; i < 50; i++){
+            state.transition({"column_assignment", "row_assignment"}, vector<size_t>(),
+                             vector<size_t>(), which_kernel, 1);
+            BOOST_REQUIRE_EQUAL(state.checkPartitions(), 1);
+
+            auto column_assignment = state.getColumnAssignment();
+            auto num_views = state.getNumViews();
+            BOOST_REQUIRE_EQUAL(baxcat::utils::vector_max(column_assignment)+1, num_views);
+            BOOST_REQUIRE_EQUAL(state.getRowAssignments().size(), num_views);
+
+            vector<size_t> view_counts(num_views, 0);
+            for(auto v : column_assignment)
+                ++view_counts[v];
+            for(auto ct : view_counts)
+                BOOST_REQUIRE(ct > 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transitions_should_not_depend_on_thread_count)
+{
+    Setup s;
+    vector<vector<double>> data;
+    for(size_t i = 0; i < 4; ++i){
+        data.push_back(s.data[0]);
+        data.push_back(s.data[1]);
+    }
+    vector<string> datatypes(data.size(), "continuous");
+    vector<vector<double>> distargs(data.size(), {0});
+
+    auto run = [&](int num_threads, size_t which_row_kernel){
+        int max_threads = omp_get_max_threads();
+        omp_set_num_threads(num_threads);
+        State state(data, datatypes, distargs, s.seed);
+        state.transition({}, vector<size_t>(), vector<size_t>(), 0, 10, 1, which_row_kernel);
+        omp_set_num_threads(max_threads);
+        return state;
+    };
+
+    // kernel 1 splits the row scoring across threads, so it is checked too
+    for(size_t which_row_kernel : {0, 1}){
+        // a fixed count, so that the comparison holds even where only one thread is available
+        State state_1 = run(1, which_row_kernel);
+        State state_n = run(4, which_row_kernel);
+
+        BOOST_CHECK(areIdentical(state_1.getColumnAssignment(), state_n.getColumnAssignment()));
+        auto Z_1 = state_1.getRowAssignments();
+        auto Z_n = state_n.getRowAssignments();
+        BOOST_REQUIRE_EQUAL(Z_1.size(), Z_n.size());
+        for(size_t v = 0; v < Z_1.size(); ++v)
+            BOOST_CHECK(areIdentical(Z_1[v], Z_n[v]));
+        BOOST_CHECK_EQUAL(state_1.logScore(), state_n.logScore());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transition_should_reject_unknown_kernels)
+{
+    Setup s;
+    State state(s.data, s.datatypes, s.distargs, s.seed);
+    BOOST_CHECK_THROW(state.transition({"column_assignment"}, vector<size_t>(),
+                                       vector<size_t>(), 3, 1),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(state.transition({"row_assignment"}, vector<size_t>(), vector<size_t>(),
+                                       0, 1, 1, 3),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(precomputed_column_logps_should_not_change_the_chain)
+{
+    // Columns 0-3 and 4 split the rows even/odd; columns 5 and 6 split them into the first and
+    // second half. Column 4 starts alone in a view with one cluster, so it moves into view 0 and
+    // frees slot 1. Column 5 starts in view 0, where it fits badly, so it moves to a new singleton
+    // view, which takes slot 1. Column 6 is then scored against the new view in slot 1, whose
+    // precomputed logp (for column 4's old view) is stale.
+    const size_t num_rows = 20;
+    vector<vector<double>> data(7, vector<double>(num_rows));
+    for(size_t r = 0; r < num_rows; ++r){
+        double jitter = .01*double(r);
+        for(size_t c = 0; c < 5; ++c)
+            data[c][r] = (r % 2 == 0 ? 10 : -10) + jitter*double(c+1);
+        for(size_t c = 5; c < 7; ++c)
+            data[c][r] = (r < num_rows/2 ? 10 : -10) - jitter*double(c);
+    }
+    vector<string> datatypes(data.size(), "continuous");
+    vector<vector<double>> distargs(data.size(), {0});
+    vector<map<string, double>> hypers(data.size(), {{"m", 0}, {"r", .1}, {"s", 1}, {"nu", 1}});
+
+    vector<size_t> Zv = {0, 0, 0, 0, 1, 0, 0};
+    vector<vector<size_t>> Zrcv(2, vector<size_t>(num_rows, 0));
+    for(size_t r = 0; r < num_rows; ++r)
+        Zrcv[0][r] = r % 2;
+
+    const size_t m = 20;
+    for(size_t which_kernel = 0; which_kernel < 2; ++which_kernel){
+        auto run = [&](bool precompute){
+            State state(data, datatypes, distargs, 10, Zv, Zrcv, 1, {1, 1}, hypers);
+            state.__setPrecomputeColumnLogps(precompute);
+            state.transition({"column_assignment"}, vector<size_t>(), {4, 5, 6}, which_kernel, 1,
+                             m);
+            return state;
+        };
+
+        State state_pre = run(true);
+        State state_seq = run(false);
+
+        // the slot was freed and reused within the transition
+        auto Zv_pre = state_pre.getColumnAssignment();
+        BOOST_REQUIRE_EQUAL(Zv_pre[4], Zv_pre[0]);
+        BOOST_REQUIRE(Zv_pre[5] != Zv_pre[0]);
+
+        BOOST_CHECK(areIdentical(Zv_pre, state_seq.getColumnAssignment()));
+        auto Z_pre = state_pre.getRowAssignments();
+        auto Z_seq = state_seq.getRowAssignments();
+        BOOST_REQUIRE_EQUAL(Z_pre.size(), Z_seq.size());
+        for(size_t v = 0; v < Z_pre.size(); ++v)
+            BOOST_CHECK(areIdentical(Z_pre[v], Z_seq[v]));
+        BOOST_CHECK_EQUAL(state_pre.logScore(), state_seq.logScore());
+    }
+}
+
+// bootstrap column kernel
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+struct BootstrapSetup
+{
+    Setup s;
+    vector<vector<double>> data;
+    vector<string> datatypes;
+    vector<vector<double>> distargs;
+
+    BootstrapSetup()
+    {
+        for(size_t i = 0; i < 4; ++i){
+            data.push_back(s.data[0]);
+            data.push_back(s.data[1]);
+        }
+        datatypes.assign(data.size(), "continuous");
+        distargs.assign(data.size(), {0});
+    }
+};
+
+BOOST_AUTO_TEST_CASE(bootstrap_proposals_should_be_reused_while_hypers_are_unchanged)
+{
+    BootstrapSetup b;
+    const size_t num_cols = b.data.size();
+    State state(b.data, b.datatypes, b.distargs, b.s.seed);
+
+    state.transition({"column_assignment"}, vector<size_t>(), vector<size_t>(), 1, 1);
+    auto stats = state.getBootstrapStats();
+    BOOST_CHECK_EQUAL(stats["built"], num_cols);
+    BOOST_CHECK_EQUAL(stats["reused"], 0);
+
+    // only the proposals that were accepted into the state need rebuilding
+    state.transition({"column_assignment"}, vector<size_t>(), vector<size_t>(), 1, 1);
+    stats = state.getBootstrapStats();
+    BOOST_CHECK_EQUAL(stats["built"] + stats["reused"], 2*num_cols);
+    BOOST_CHECK_GT(stats["reused"], 0);
+}
+
+BOOST_AUTO_TEST_CASE(bootstrap_proposals_should_be_built_once_per_listed_column)
+{
+    BootstrapSetup b;
+    State state(b.data, b.datatypes, b.distargs, b.s.seed);
+
+    state.transition({"column_assignment"}, vector<size_t>(), {0, 0, 1, 0}, 1, 1);
+    auto stats = state.getBootstrapStats();
+    BOOST_CHECK_EQUAL(stats["built"], 2);
+    BOOST_CHECK_EQUAL(stats["reused"], 0);
+}
+
+BOOST_AUTO_TEST_CASE(bootstrap_proposals_should_be_rebuilt_after_hypers_or_data_change)
+{
+    BootstrapSetup b;
+    const size_t num_cols = b.data.size();
+    State state(b.data, b.datatypes, b.distargs, b.s.seed);
+    vector<double> row(num_cols, .5);
+
+    vector<std::function<void()>> changes = {
+        [&](){state.transition({"column_hypers"}, vector<size_t>(), vector<size_t>(), 0, 1);},
+        [&](){state.appendRow(row, true);},
+        [&](){state.popRow();},
+        [&](){state.replaceRowData(0, row);}
+    };
+
+    state.transition({"column_assignment"}, vector<size_t>(), vector<size_t>(), 1, 1);
+    for(auto &change : changes){
+        // no proposals left over from the last change
+        state.transition({"column_assignment"}, vector<size_t>(), vector<size_t>(), 1, 1);
+
+        auto stats_before = state.getBootstrapStats();
+        change();
+        state.transition({"column_assignment"}, vector<size_t>(), vector<size_t>(), 1, 1);
+        auto stats_after = state.getBootstrapStats();
+
+        BOOST_CHECK_EQUAL(stats_after["built"], stats_before["built"] + num_cols);
+        BOOST_CHECK_EQUAL(stats_after["reused"], stats_before["reused"]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bootstrap_kernel_should_not_depend_on_thread_count)
+{
+    BootstrapSetup b;
+
+    auto run = [&](int num_threads){
+        int max_threads = omp_get_max_threads();
+        omp_set_num_threads(num_threads);
+        State state(b.data, b.datatypes, b.distargs, b.s.seed);
+        for(size_t i = 0; i < 10; ++i)
+            state.transition({"column_assignment", "row_assignment"}, vector<size_t>(),
+                             vector<size_t>(), 1, 1);
+        omp_set_num_threads(max_threads);
+        return state;
+    };
+
+    State state_1 = run(1);
+    State state_4 = run(4);
+
+    BOOST_CHECK(areIdentical(state_1.getColumnAssignment(), state_4.getColumnAssignment()));
+    auto Z_1 = state_1.getRowAssignments();
+    auto Z_4 = state_4.getRowAssignments();
+    BOOST_REQUIRE_EQUAL(Z_1.size(), Z_4.size());
+    for(size_t v = 0; v < Z_1.size(); ++v)
+        BOOST_CHECK(areIdentical(Z_1[v], Z_4[v]));
+    BOOST_CHECK_EQUAL(state_1.logScore(), state_4.logScore());
+    BOOST_CHECK_GT(state_4.getBootstrapStats()["reused"], 0);
+}
+
+BOOST_AUTO_TEST_CASE(buffer_constructor_should_match_vector_constructor)
+{
+    Setup s;
+    size_t num_rows = s.data[0].size();
+    size_t num_cols = s.data.size();
+
+    // C-ordered rows-by-columns copy of the table
+    vector<double> buffer(num_rows*num_cols);
+    for(size_t r = 0; r < num_rows; ++r)
+        for(size_t c = 0; c < num_cols; ++c)
+            buffer[r*num_cols + c] = s.data[c][r];
+
+    State state_vec(s.data, s.datatypes, s.distargs, s.seed);
+    State state_buf(buffer.data(), num_rows, num_cols, num_cols, 1, s.datatypes, s.distargs,
+                    s.seed);
+
+    BOOST_CHECK(areIdentical(state_vec.getColumnAssignment(), state_buf.getColumnAssignment()));
+    BOOST_CHECK_EQUAL(state_vec.logScore(), state_buf.logScore());
+
+    auto data = state_buf.getDataTable();
+    BOOST_CHECK_CLOSE_FRACTION(data[3][0], 0.8622, EPSILON);
+    BOOST_CHECK_CLOSE_FRACTION(data[3][1], 3.5784, EPSILON);
+
+    state_vec.transition({}, vector<size_t>(), vector<size_t>(), 0, 5);
+    state_buf.transition({}, vector<size_t>(), vector<size_t>(), 0, 5);
+    BOOST_CHECK_EQUAL(state_vec.logScore(), state_buf.logScore());
+}
+
+// predictive probability
+// ````````````````````````````````````````````````````````````````````````````````````````````````
+BOOST_AUTO_TEST_CASE(constrained_predictive_logp_should_match_inserted_data)
+{
+    Setup s;
+    vector<map<string, double>> hypers(2, {{"m", 0}, {"r", 1}, {"s", 1}, {"nu", 1}});
+    State state(s.data, s.datatypes, s.distargs, s.seed, s.column_assignment,
+                s.row_assignments, -1, vector<double>(), hypers);
+
+    // the same table with the constraint as an extra row in the same cluster of column 0
+    auto data = s.data;
+    data[0].push_back(5.0);
+    data[1].push_back(1.0);
+    vector<vector<size_t>> row_assignments = {{0,0,0,0,0,0},{0,1,2,3,4,5}};
+    State state_plus(data, s.datatypes, s.distargs, s.seed, s.column_assignment,
+                     row_assignments, -1, vector<double>(), hypers);
+
+    double score = state.logScore();
+
+    vector<vector<size_t>> query = {{0, 0}, {7, 0}};
+    vector<double> values = {0.5, 0.5};
+    auto logps = state.predictiveLogp(query, values, {{1, 0}}, {5.0});
+    auto logps_plus = state_plus.predictiveLogp({{0, 0}}, {0.5}, {}, {});
+    BOOST_CHECK_CLOSE_FRACTION(logps[0], logps_plus[0], EPSILON);
+
+    // constraints in other columns don't bear on the query
+    auto logps_other = state.predictiveLogp(query, values, {{1, 1}}, {5.0});
+    auto logps_none = state.predictiveLogp(query, values, {}, {});
+    BOOST_CHECK_EQUAL(logps_other[0], logps_none[0]);
+    BOOST_CHECK(logps[0] != logps_none[0]);
+
+    // the state is unchanged, so repeating the query gives the same answer
+    BOOST_CHECK_EQUAL(state.logScore(), score);
+    auto logps_again = state.predictiveLogp(query, values, {{1, 0}}, {5.0});
+    BOOST_CHECK_EQUAL(logps_again[0], logps[0]);
+    BOOST_CHECK_EQUAL(logps_again[1], logps[1]);
+
+    // per-query constraints
+    vector<vector<vector<size_t>>> batch_indices = {{{1, 0}}, {}};
+    vector<vector<double>> batch_values = {{5.0}, {}};
+    auto logps_batch = state.predictiveLogpBatch(query, values, batch_indices, batch_values);
+    BOOST_CHECK_EQUAL(logps_batch[0], logps[0]);
+    BOOST_CHECK_EQUAL(logps_batch[1], logps_none[1]);
+}
+
+BOOST_AUTO_TEST_CASE(new_row_constraints_should_weight_the_clusters_of_their_row)
+{
+    Setup s;
+    vector<size_t> column_assignment = {0, 0};
+    vector<vector<size_t>> row_assignments = {{0,0,1,1,1}};
+    State state(s.data, s.datatypes, s.distargs, s.seed, column_assignment, row_assignments, -1,
+                vector<double>(), vector<map<string, double>>());
+
+    vector<vector<size_t>> query = {{7, 0}};
+    vector<double> values = {0.5};
+    auto logps_none = state.predictiveLogp(query, values, {}, {});
+    auto logps_row = state.predictiveLogp(query, values, {{7, 1}}, {3.0});
+    auto logps_other_row = state.predictiveLogp(query, values, {{8, 1}}, {3.0});
+
+    BOOST_CHECK(logps_row[0] != logps_none[0]);
+    BOOST_CHECK_EQUAL(logps_other_row[0], logps_none[0]);
+
+    auto logps_batch = state.predictiveLogpBatch(query, values, {{{7, 1}}}, {{3.0}});
+    BOOST_CHECK_EQUAL(logps_batch[0], logps_row[0]);
+}
+
+BOOST_AUTO_TEST_CASE(predictive_logp_should_reject_bad_indices)
+{
+    Setup s;
+    State state(s.data, s.datatypes, s.distargs, s.seed, s.column_assignment,
+                s.row_assignments, -1, vector<double>(), vector<map<string, double>>());
+
+    BOOST_CHECK_THROW(state.predictiveLogp({{0, 2}}, {0.5}, {}, {}), std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveLogp({{0}}, {0.5}, {}, {}), std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveLogp({{0, 0}}, {0.5}, {{1, 2}}, {1.0}),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveLogp({{0, 0}}, {0.5}, {{1, 0}}, {}),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveLogpBatch({{0, 0}}, {0.5}, {{{1, 0}}}, {{}}),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveLogpBatch({{0, 0}}, {0.5}, {{{1, 2}}}, {{1.0}}),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(constrained_predictive_draw_should_leave_state_unchanged)
+{
+    Setup s;
+    State state(s.data, s.datatypes, s.distargs, s.seed, s.column_assignment,
+                s.row_assignments, -1, vector<double>(), vector<map<string, double>>());
+    double score = state.logScore();
+    auto suffstats = state.getSuffstats();
+    state.predictiveDraw({{0, 0}, {7, 1}}, {{1, 0}, {2, 1}}, {5.0, 3.0}, 3);
+    BOOST_CHECK_EQUAL(state.logScore(), score);
+    BOOST_CHECK(state.getSuffstats() == suffstats);
+
+    BOOST_CHECK_THROW(state.predictiveDraw({{0, 2}}, {}, {}, 1), std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveDraw({{0, 0}}, {{1, 2}}, {1.0}, 1),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(state.predictiveDraw({{0, 0}}, {{1, 0}}, {}, 1), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(observed_row_draws_should_follow_the_overlaid_constraints)
+{
+    Setup s;
+    vector<map<string, double>> hypers(2, {{"m", 0}, {"r", 1}, {"s", 1}, {"nu", 1}});
+    State state(s.data, s.datatypes, s.distargs, s.seed, s.column_assignment,
+                s.row_assignments, -1, vector<double>(), hypers);
+
+    // row 1 shares row 0's cluster in column 0
+    const size_t N = 1000;
+    vector<vector<size_t>> constraint_indices(20, {1, 0});
+    vector<double> constraint_values(20, 50.0);
+    auto given = state.predictiveDraw({{0, 0}}, constraint_indices, constraint_values, N);
+    auto none = state.predictiveDraw({{0, 0}}, {}, {}, N);
+
+    double mean_given = 0;
+    double mean_none = 0;
+    for(size_t n = 0; n < N; ++n){
+        mean_given += given[n][0]/N;
+        mean_none += none[n][0]/N;
+    }
+    BOOST_CHECK_GT(mean_given, 20);
+    BOOST_CHECK_LT(mean_none, 5);
+}
+
+BOOST_AUTO_TEST_CASE(new_row_draws_should_share_a_cluster_within_a_view)
+{
+    vector<vector<double>> data = {
+        {-10.1, -9.8, -10.3, -9.9, -10.0, 10.2, 9.7, 10.1, 9.9, 10.0},
+        {-10.0, -10.2, -9.7, -10.1, -9.9, 9.8, 10.3, 10.0, 10.1, 9.9}};
+    vector<string> datatypes = {"continuous", "continuous"};
+    vector<vector<double>> distargs = {{0}, {0}};
+    vector<map<string, double>> hypers(2, {{"m", 0}, {"r", .1}, {"s", 1}, {"nu", 1}});
+    vector<vector<size_t>> row_assignments = {{0, 0, 0, 0, 0, 1, 1, 1, 1, 1}};
+    State state(data, datatypes, distargs, 10, {0, 0}, row_assignments, -1, {1}, hypers);
+
+    const size_t N = 1000;
+    const size_t new_row = data[0].size();
+
+    // both columns are in one view, so each draw takes them from the same cluster
+    auto samples = state.predictiveDraw({{new_row, 0}, {new_row, 1}}, {}, {}, N);
+    BOOST_REQUIRE_EQUAL(samples.size(), N);
+    size_t num_agree = 0;
+    for(auto &sample : samples)
+        num_agree += (sample[0] > 0) == (sample[1] > 0);
+    BOOST_CHECK_GT(num_agree, .8*N);
+
+    // a constraint in the new row picks the cluster
+    auto given_high = state.predictiveDraw({{new_row, 1}}, {{new_row, 0}}, {10.0}, N);
+    auto given_low = state.predictiveDraw({{new_row, 1}}, {{new_row, 0}}, {-10.0}, N);
+    double mean_high = 0;
+    double mean_low = 0;
+    for(size_t n = 0; n < N; ++n){
+        mean_high += given_high[n][0]/N;
+        mean_low += given_low[n][0]/N;
+    }
+    BOOST_CHECK_GT(mean_high, 5);
+    BOOST_CHECK_LT(mean_low, -5);
+}
+
 // geweke functions
 // ````````````````````````````````````````````````````````````````````````````````````````````````
 BOOST_AUTO_TEST_CASE(geweke_pullDataColumn_value_checks)
@@ -237,4 +237,154 @@ BOOST_AUTO_TEST_CASE(transition_rows_should_run){
     BOOST_CHECK_EQUAL( view.checkPartitions(), 1);
 }
 
+BOOST_AUTO_TEST_CASE(transition_rows_should_leave_dense_labels){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+    Setup s(rng);
+
+    // a large alpha keeps creating and destroying singletons
+    View view( s.features, rng, 10.0 );
+    vector<double> X1 = {-2,-1,0,1,2};
+
+    for(size_t which_kernel = 0; which_kernel < 3; ++which_kernel){
+        for(size_t i = 0; i < 50; ++i){
+            view.transitionRows(which_kernel);
+            BOOST_REQUIRE_EQUAL( view.checkPartitions(), 1);
+
+            auto K = view.getNumCategories();
+            auto Z = view.getRowAssignments();
+            auto counts = view.getClusterCounts();
+            BOOST_REQUIRE_EQUAL( baxcat::utils::vector_max(Z)+1, K);
+            for(auto ct : counts)
+                BOOST_REQUIRE( ct > 0 );
+
+            for(auto &f : s.features)
+                BOOST_REQUIRE_EQUAL( f.get()->getNumClusters(), K);
+
+            // the features' clusters are renumbered along with the view
+            auto suffstats = s.f1.get()->getModelSuffstats();
+            for(size_t k = 0; k < K; ++k){
+                double sum_x = 0;
+                for(size_t r = 0; r < Z.size(); ++r)
+                    sum_x += (Z[r] == k) ? X1[r] : 0;
+                BOOST_CHECK_EQUAL( suffstats[k]["n"], counts[k]);
+                BOOST_CHECK_SMALL( suffstats[k]["sum_x"]-sum_x, 10e-8);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(feature_parallel_row_kernel_should_match_sequential){
+    // same seed, same draws. The kernels differ only in the order of the logp sums.
+    int num_threads = omp_get_max_threads();
+    omp_set_num_threads(3);
+
+    baxcat::PRNG *rng_0 = new baxcat::PRNG(10);
+    baxcat::PRNG *rng_1 = new baxcat::PRNG(10);
+    Setup s_0(rng_0);
+    Setup s_1(rng_1);
+
+    View view_0(s_0.features, rng_0, 1.5, {0, 0, 0, 0, 0});
+    View view_1(s_1.features, rng_1, 1.5, {0, 0, 0, 0, 0});
+
+    for(size_t i = 0; i < 10; ++i){
+        view_0.transitionRows(0);
+        view_1.transitionRows(1);
+        BOOST_REQUIRE_EQUAL(view_1.checkPartitions(), 1);
+        BOOST_CHECK(baxcat::test_utils::areIdentical(view_0.getRowAssignments(),
+                                                     view_1.getRowAssignments()));
+    }
+
+    omp_set_num_threads(num_threads);
+    delete rng_0;
+    delete rng_1;
+}
+
+BOOST_AUTO_TEST_CASE(split_merge_should_merge_singletons){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+    Setup s(rng);
+
+    View view(s.features, rng, 1, {0, 1, 2, 3, 4});
+
+    for(size_t i = 0; i < 20; ++i){
+        view.transitionRows(2);
+        BOOST_REQUIRE_EQUAL(view.checkPartitions(), 1);
+    }
+
+    auto stats = view.getSplitMergeStats();
+    BOOST_CHECK_EQUAL(stats["split_proposals"] + stats["merge_proposals"] > 0, true);
+    BOOST_CHECK(stats["merge_accepts"] > 0);
+    BOOST_CHECK(stats["split_accepts"] <= stats["split_proposals"]);
+    BOOST_CHECK(stats["merge_accepts"] <= stats["merge_proposals"]);
+
+    view.clearSplitMergeStats();
+    BOOST_CHECK_EQUAL(view.getSplitMergeStats()["merge_proposals"], 0);
+}
+
+// With fixed alpha and hypers, the chain over the 52 partitions of 5 rows should visit each
+// partition in proportion to exp(logScore).
+BOOST_AUTO_TEST_CASE(split_merge_kernel_should_leave_posterior_invariant){
+    static baxcat::PRNG *rng = new baxcat::PRNG(10);
+    Setup s(rng);
+
+    View view(s.features, rng, 1.2, {0, 0, 0, 0, 0});
+    for(auto &f : s.features)
+        f.get()->setHypers(vector<double>({0, 1, 1, 1}));
+
+    // enumerate partitions as restricted growth strings
+    vector<vector<size_t>> partitions = {{0}};
+    for(size_t n = 1; n < 5; ++n){
+        vector<vector<size_t>> grown;
+        for(auto &z : partitions){
+            size_t k_max = baxcat::utils::vector_max(z);
+            for(size_t k = 0; k <= k_max+1; ++k){
+                grown.push_back(z);
+                grown.back().push_back(k);
+            }
+        }
+        partitions = grown;
+    }
+    BOOST_REQUIRE_EQUAL(partitions.size(), 52);
+
+    vector<double> logps;
+    for(auto &z : partitions){
+        view.setRowAssignment(z);
+        logps.push_back(view.logScore());
+    }
+    double log_norm = baxcat::numerics::logsumexp(logps);
+
+    auto canonical = [](vector<size_t> z){
+        std::map<size_t, size_t> relabel;
+        for(auto &k : z){
+            if(relabel.find(k) == relabel.end()){
+                size_t new_label = relabel.size();
+                relabel[k] = new_label;
+            }
+            k = relabel[k];
+        }
+        return z;
+    };
+
+    view.setRowAssignment({0, 0, 0, 0, 0});
+    size_t num_samples = 20000;
+    vector<double> freqs(partitions.size(), 0);
+    for(size_t i = 0; i < num_samples; ++i){
+        view.transitionRows(2);
+        auto z = canonical(view.getRowAssignments());
+        for(size_t p = 0; p < partitions.size(); ++p){
+            if(z == partitions[p]){
+                freqs[p] += 1./num_samples;
+                break;
+            }
+        }
+    }
+
+    double tv = 0;
+    for(size_t p = 0; p < partitions.size(); ++p)
+        tv += .5*fabs(freqs[p] - exp(logps[p]-log_norm));
+
+    BOOST_CHECK_LT(tv, .03);
+    BOOST_CHECK(view.getSplitMergeStats()["split_accepts"] > 0);
+    BOOST_CHECK(view.getSplitMergeStats()["merge_accepts"] > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -22,7 +22,11 @@ extensions = [
                        os.path.join(SRC, 'view.cpp'),
                        os.path.join(SRC, 'categorical.cpp'),
                        os.path.join(SRC, 'continuous.cpp'),
-                       os.path.join(SRC, 'feature_tree.cpp')],
+                       os.path.join(SRC, 'feature_tree.cpp'),
+                       os.path.join(SRC, 'column_file.cpp'),
+                       os.path.join(SRC, 'ensemble.cpp'),
+                       os.path.join(SRC, 'dependence.cpp'),
+                       os.path.join(SRC, 'row_similarity.cpp')],
               extra_compile_args=['-std=c++11', '-Wno-comment', '-fopenmp'],
               extra_link_args=['-lstdc++', '-fopenmp'],
               include_dirs=[SRC, INC, np.get_include()],
@@ -34,6 +38,7 @@ extensions = [
                        os.path.join(SRC, 'categorical.cpp'),
                        os.path.join(SRC, 'continuous.cpp'),
                        os.path.join(SRC, 'feature_tree.cpp'),
+                       os.path.join(SRC, 'column_file.cpp'),
                        os.path.join(SRC, 'geweke_tester.cpp')],
               extra_compile_args=['-std=c++11', '-Wno-comment', '-fopenmp'],
               extra_link_args=['-lstdc++', '-fopenmp'],